@@ -5,7 +5,7 @@
 #include "MessageAliases.h"
 #include "MessageData.h"
 #include "MessageComponent.h"
-#include "../../CommonCore/NotificationManager.h"
+#include "NotificationManager.h"
 #include <QDateTime>
 #include <QJsonDocument>
 #include <QJsonObject>
@@ -236,14 +236,9 @@ void ClientController::displayFileMessage(const QString &fileName, qint64 fileSi
     }
 }
 
-void ClientController::onMessageReceived(const QString &message)
+void ClientController::onMessageReceived(const QJsonObject &obj)
 {
-    // 1. Parse JSON
-    QJsonDocument doc = QJsonDocument::fromJson(message.toUtf8());
-    if (!doc.isObject()) {
-        return;
-    }
-    QJsonObject obj = doc.object();
+    // 1. JSON was already decrypted and parsed by WebSocketClient
     // 2. Create MessageData object (Model)
     MessageData msgData;
     msgData.senderType = MessageData::User_Other; // Always from other side
@@ -5,6 +5,7 @@
 #include <QString>
 #include <QStringList>
 #include <QWidget>
+#include <QJsonObject>
 
 class ClientChatWindow;
 class WebSocketClient;
@@ -34,7 +35,7 @@ public slots:
     void displayFileMessage(const QString &fileName, qint64 fileSize, const QString &fileUrl, const QString &sender = "", const QString &serverHost = "");
 
 private slots:
-    void onMessageReceived(const QString &message);
+    void onMessageReceived(const QJsonObject &obj);
     void onFileUploaded(const QString &fileName, const QString &url, qint64 fileSize, const QString &serverHost = "", const QVector<qreal> &waveform = QVector<qreal>());
     void onTextMessageCopyRequested(const QString &text);
     void onTextMessageEditRequested(TextMessageItem *item);
@@ -14,6 +14,7 @@ ConnectPageController::ConnectPageController(ConnectPage *connectPage, QObject *
     , m_clientController(nullptr)
     , m_client(nullptr)
     , m_db(nullptr)
+    , m_batchWindowMs(-1)
 {
     if (m_connectPage) {
         connect(m_connectPage, &ConnectPage::connectClient, this, &ConnectPageController::onConnectClient);
@@ -63,6 +64,9 @@ void ConnectPageController::onConnectClient(const QString &ipAddress)
     // Create client components
     m_chatWindow = new ClientChatWindow();
     m_client = new WebSocketClient();
+    if (m_batchWindowMs >= 0) {
+        m_client->setBatchingEnabled(true, m_batchWindowMs);
+    }
     m_db = new DatabaseManager("client_chat.db");
     
     // Initialize database
@@ -16,6 +16,9 @@ public:
     explicit ConnectPageController(ConnectPage *connectPage, QObject *parent = nullptr);
     ~ConnectPageController();
 
+    // Applied to the connection made next; < 0 turns batching off
+    void setBatchWindow(int windowMs) { m_batchWindowMs = windowMs; }
+
 private slots:
     void onConnectClient(const QString &ipAddress);
     void onConnectionSuccess();
@@ -28,6 +31,7 @@ private:
     WebSocketClient *m_client;
     DatabaseManager *m_db;
     QString m_serverUrl;
+    int m_batchWindowMs;
 };
 
 #endif // CONNECTPAGECONTROLLER_H
@@ -1,10 +1,28 @@
 #include "Model/Network/WebSocketClient.h"
 #include <QDebug>
 #include <QHostAddress>
+#include <QJsonDocument>
+#include <QJsonArray>
 #include "CryptoManager.h"
+#include "WireProtocol.h"
 WebSocketClient::WebSocketClient(QObject *parent)
     : QObject(parent)
+    , m_binaryWire(false)
+    , m_batchAccepted(false)
+    , m_versionedEnvelope(false)
+    , m_cipher(AeadCipher::Aes256Gcm)
+    , m_codec(PayloadCodec::None)
+    , m_batchingEnabled(false)
+    , m_handshaking(false)
 {
+    m_flushTimer.setSingleShot(true);
+    m_flushTimer.setInterval(0);
+    connect(&m_flushTimer, &QTimer::timeout, this, &WebSocketClient::flushPending);
+
+    // Servers from before negotiation never answer the hello
+    m_handshakeTimer.setSingleShot(true);
+    m_handshakeTimer.setInterval(HANDSHAKE_TIMEOUT_MS);
+    connect(&m_handshakeTimer, &QTimer::timeout, this, &WebSocketClient::finishHandshake);
 
     connect(&m_webSocket, &QWebSocket::connected,
             this, &WebSocketClient::onConnected);
@@ -17,7 +35,11 @@ WebSocketClient::WebSocketClient(QObject *parent)
             this, &WebSocketClient::onError, Qt::UniqueConnection);
 
     connect(&m_webSocket, &QWebSocket::textMessageReceived,
-            this, &WebSocketClient::onMessageReceived);
+            this, &WebSocketClient::onTextMessageReceived);
+
+    // Accepted at any time: the server's welcome is the first binary frame
+    connect(&m_webSocket, &QWebSocket::binaryMessageReceived,
+            this, &WebSocketClient::onBinaryMessageReceived);
 }
 
 WebSocketClient::~WebSocketClient()
@@ -27,6 +49,31 @@ WebSocketClient::~WebSocketClient()
 
 void WebSocketClient::onConnected()
 {
+    m_binaryWire = false;
+    m_batchAccepted = false;
+    m_versionedEnvelope = false;
+    m_cipher = AeadCipher::Aes256Gcm;
+    m_codec = PayloadCodec::None;
+    m_outbound.reset();
+    m_inbound.reset();
+    m_sessionSalt = MessageSession::generateSalt();
+
+    // Offer our capabilities over the text path in the legacy envelope;
+    // servers that do not know about negotiation simply never answer and we
+    // stay on what they understand
+    QJsonObject hello = WireProtocol::makeControlMessage(WireProtocol::TypeHello,
+                                                         {WireProtocol::CapBinary,
+                                                          WireProtocol::CapBatch,
+                                                          WireProtocol::CapEnvelope});
+    hello["ciphers"] = QJsonArray::fromStringList(CryptoManager::supportedCiphers());
+    hello["codecs"] = QJsonArray::fromStringList(CryptoManager::supportedCodecs());
+    if (!m_sessionSalt.isEmpty()) {
+        hello["salt"] = QString::fromLatin1(m_sessionSalt.toBase64());
+    }
+    sendFrame(QJsonDocument(hello).toJson(QJsonDocument::Compact));
+    m_handshaking = true;
+    m_handshakeTimer.start();
+
     emit connected();
 }
 
@@ -51,14 +98,107 @@ void WebSocketClient::connectToServer(const QUrl &url)
     m_webSocket.open(url);
 }
 
-void WebSocketClient::onMessageReceived(QString message)
+void WebSocketClient::onTextMessageReceived(const QString &message)
+{
+    // The decoded buffer is ours alone, so decrypt it where it lies
+    QByteArray envelope = QByteArray::fromBase64(message.toLatin1());
+    QByteArrayView plaintext;
+    if (CryptoManager::decryptInPlace(envelope, plaintext, &m_inbound)) {
+        processPlaintext(QByteArray::fromRawData(plaintext.data(), plaintext.size()));
+    }
+}
+
+void WebSocketClient::onBinaryMessageReceived(const QByteArray &message)
+{
+    processPlaintext(CryptoManager::decryptPayload(message, &m_inbound));
+}
+
+void WebSocketClient::processPlaintext(const QByteArray &plaintext)
+{
+    QJsonDocument doc = QJsonDocument::fromJson(plaintext);
+    QJsonArray messages;
+    if (doc.isObject()) {
+        messages.append(doc.object());
+    } else if (doc.isArray()) {
+        messages = doc.array();
+    }
+
+    for (const QJsonValue &value : std::as_const(messages)) {
+        QJsonObject obj = value.toObject();
+        if (obj.isEmpty()) {
+            continue;
+        }
+        const QString type = obj["type"].toString();
+        if (WireProtocol::isControlType(type)) {
+            if (type == WireProtocol::TypeWelcome) {
+                handleWelcome(obj);
+            }
+            continue;
+        }
+        emit messageReceived(obj);
+    }
+}
+
+void WebSocketClient::handleWelcome(const QJsonObject &welcome)
+{
+    const QStringList accepted = WireProtocol::capabilitiesOf(welcome);
+    m_binaryWire = accepted.contains(WireProtocol::CapBinary);
+    m_batchAccepted = accepted.contains(WireProtocol::CapBatch);
+    m_versionedEnvelope = accepted.contains(WireProtocol::CapEnvelope);
+    if (!m_versionedEnvelope) {
+        finishHandshake();
+        return;
+    }
+    if (!CryptoManager::cipherFromName(welcome["cipher"].toString(), m_cipher)) {
+        m_cipher = AeadCipher::Aes256Gcm;
+    }
+    m_codec = CryptoManager::negotiateCodec(WireProtocol::codecsOf(welcome));
+
+    // Servers without counter nonces leave out the salt; keep random IVs
+    const QByteArray serverSalt = QByteArray::fromBase64(welcome["salt"].toString().toLatin1());
+    if (!serverSalt.isEmpty() && !m_sessionSalt.isEmpty()) {
+        const quint32 stream = quint32(welcome["stream"].toInt());
+        if (!m_inbound.start(serverSalt, stream, m_cipher, AeadContext::Direction::Decrypt)
+            || !m_outbound.start(m_sessionSalt, 0, m_cipher, AeadContext::Direction::Encrypt)) {
+            m_inbound.reset();
+            m_outbound.reset();
+        }
+    }
+    if (!m_handshaking && m_outbound.isActive()) {
+        qWarning() << "Welcome arrived after the handshake timed out; the server dropped what was sent meanwhile";
+    }
+    finishHandshake();
+}
+
+void WebSocketClient::finishHandshake()
 {
-    QString decryptedMessage = CryptoManager::decryptMessage(message);
-    emit messageReceived(decryptedMessage);
+    m_handshaking = false;
+    m_handshakeTimer.stop();
+    flushPending();
 }
 
 void WebSocketClient::onDisconnected()
 {
+    m_binaryWire = false;
+    m_batchAccepted = false;
+    m_versionedEnvelope = false;
+    m_cipher = AeadCipher::Aes256Gcm;
+    m_codec = PayloadCodec::None;
+    m_outbound.reset();
+    m_inbound.reset();
+    m_flushTimer.stop();
+    m_handshaking = false;
+    m_handshakeTimer.stop();
+    m_pending.clear();
+}
+
+void WebSocketClient::setBatchingEnabled(bool enabled, int windowMs)
+{
+    m_batchingEnabled = enabled;
+    m_flushTimer.setInterval(qMax(0, windowMs));
+    if (!enabled && !m_handshaking) {
+        flushPending();
+    }
 }
 
 void WebSocketClient::onError(QAbstractSocket::SocketError error)
@@ -69,9 +209,70 @@ void WebSocketClient::onError(QAbstractSocket::SocketError error)
 
 void WebSocketClient::sendMessage(const QString &message)
 {
-    QString encryptedMessage = CryptoManager::encryptMessage(message);
-    if (m_webSocket.state() == QAbstractSocket::ConnectedState) {
-        m_webSocket.sendTextMessage(encryptedMessage);
+    if (m_webSocket.state() != QAbstractSocket::ConnectedState) {
+        return;
+    }
+
+    if (m_handshaking) {
+        m_pending.append(message.toUtf8());
+        return;
+    }
+    if (!m_batchingEnabled || !m_batchAccepted) {
+        sendFrame(message.toUtf8());
+        return;
+    }
+
+    m_pending.append(message.toUtf8());
+    if (!m_flushTimer.isActive()) {
+        m_flushTimer.start();
+    }
+}
+
+void WebSocketClient::flushPending()
+{
+    if (m_pending.isEmpty()) {
+        return;
+    }
+    if (m_pending.size() == 1 || !m_batchAccepted) {
+        // Held through the handshake by a server that takes no batches
+        const QList<QByteArray> pending = std::move(m_pending);
+        m_pending.clear();
+        for (const QByteArray &message : pending) {
+            sendFrame(message);
+        }
+        return;
+    }
+
+    // Messages are already serialized JSON objects, so the batch array is
+    // plain concatenation
+    QByteArray batch("[");
+    batch.append(m_pending.join(','));
+    batch.append(']');
+    m_pending.clear();
+    sendFrame(batch);
+}
+
+void WebSocketClient::sendFrame(const QByteArray &plaintext)
+{
+    if (m_webSocket.state() != QAbstractSocket::ConnectedState) {
+        return;
+    }
+
+    QByteArray envelope;
+    if (!m_versionedEnvelope) {
+        envelope = CryptoManager::encryptLegacyPayload(plaintext);
+    } else if (m_outbound.isActive()) {
+        envelope = CryptoManager::encryptPayload(plaintext, m_outbound, m_codec);
+    } else {
+        envelope = CryptoManager::encryptPayload(plaintext, m_cipher, m_codec);
+    }
+    if (envelope.isEmpty()) {
+        return;
+    }
+
+    if (m_binaryWire) {
+        m_webSocket.sendBinaryMessage(envelope);
     } else {
+        m_webSocket.sendTextMessage(QString::fromLatin1(envelope.toBase64()));
     }
 }
@@ -3,8 +3,12 @@
 
 #include <QObject>
 #include <QtWebSockets/QWebSocket>
+#include <QJsonObject>
 #include <QUrl>
 #include <QTimer>
+#include "AeadContext.h"
+#include "CryptoManager.h"
+#include "MessageSession.h"
 class WebSocketClient : public QObject
 {
     Q_OBJECT
@@ -15,15 +19,24 @@ public:
 
     void sendMessage(const QString &message);
 
+    // Coalesce messages sent within windowMs (0: one event-loop tick) into a
+    // single frame, once the server has agreed to batches
+    void setBatchingEnabled(bool enabled, int windowMs = 0);
+
+    // True once the server has agreed to raw binary frames
+    bool isBinaryWire() const { return m_binaryWire; }
+
 signals:
     void connected();
     void connectionFailed(const QString &errorMessage);
-    void messageReceived(const QString &message);
+    // Decrypted and parsed; transport control messages are filtered out
+    void messageReceived(const QJsonObject &message);
 
 private slots:
 
     void onConnected();
-    void onMessageReceived(QString message);
+    void onTextMessageReceived(const QString &message);
+    void onBinaryMessageReceived(const QByteArray &message);
     void onDisconnected();
     void onError(QAbstractSocket::SocketError error);
 
@@ -31,9 +44,32 @@ public slots:
     void connectToServer(const QUrl &url);
 
 private:
+    void processPlaintext(const QByteArray &plaintext);
+    void handleWelcome(const QJsonObject &welcome);
+    void finishHandshake();
+    void sendFrame(const QByteArray &plaintext);
+    void flushPending();
+
     QWebSocket m_webSocket;
     QUrl m_url;
     QTimer *m_reconnectTimer;
+    bool m_binaryWire;
+    bool m_batchAccepted;
+    bool m_versionedEnvelope;   // Legacy envelopes until the server agrees
+    AeadCipher m_cipher;
+    PayloadCodec m_codec;
+    QByteArray m_sessionSalt;   // Offered in the hello
+    MessageSession m_outbound;
+    MessageSession m_inbound;
+    bool m_batchingEnabled;
+    QTimer m_flushTimer;
+    // Between hello and welcome messages wait in m_pending: once the server
+    // has our salt it takes nothing but session envelopes
+    bool m_handshaking;
+    QTimer m_handshakeTimer;
+    QList<QByteArray> m_pending;
+
+    static const int HANDSHAKE_TIMEOUT_MS = 5000;
 };
 
 #endif // WEBSOCKETCLIENT_H
@@ -20,6 +20,7 @@
 #include <QTextEdit>
 #include <QTextCursor>
 #include <QTimer>
+#include <QPointer>
 #include <QStyle>
 #if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
 #include <QMediaRecorder>
@@ -34,7 +35,7 @@
 #include <QVideoEncoderSettings>
 #include <QMultimedia>
 #endif
-#include "TusUploader.h"
+#include "TransferScheduler.h"
 #include "AudioWaveform.h"
 #include "FileMessage.h"
 #include "AudioMessage.h"
@@ -275,7 +276,11 @@ void ClientChatWindow::onSendFileClicked()
     if (filePath.isEmpty()) {
         return;
     }
+    uploadFile(filePath);
+}
 
+void ClientChatWindow::uploadFile(const QString &filePath)
+{
     // **FIX: ایجاد FileMessage قبل از شروع آپلود**
     QFileInfo fileInfo(filePath);
     QString fileName = fileInfo.fileName();
@@ -302,20 +307,21 @@ void ClientChatWindow::onSendFileClicked()
     // --- Start TUS Upload ---
     QString tusEndpointUrl = QString("http://%1:1080/files/").arg(m_serverHost);
     QUrl tusEndpoint(tusEndpointUrl);
-    TusUploader *uploader = new TusUploader(this);
+    QPointer<TransferJob> upload = TransferScheduler::instance().submitUpload(
+        filePath, tusEndpoint, TransferScheduler::priorityFor(fileName));
+    fileItem->setTransfer(upload);
 
     // **FIX: اتصال progress به InfoCard**
     InfoCard* infoCard = fileItem->findChild<InfoCard*>();
     if (infoCard) {
-        connect(uploader, &TusUploader::uploadProgress, infoCard, &InfoCard::updateProgress);
+        connect(upload, &TransferJob::progress, infoCard, &InfoCard::updateProgress);
         
         // **NEW: اتصال دکمه Cancel**
         connect(infoCard, &InfoCard::cancelClicked, this, [=]() {
             
             // Cancel upload safely
-            if (uploader) {
-                uploader->cancelUpload();
-                uploader->deleteLater();
+            if (upload) {
+                upload->cancel();
             }
             
             // **FIX: حذف QListWidgetItem از لیست چت**
@@ -331,7 +337,7 @@ void ClientChatWindow::onSendFileClicked()
         });
     }
 
-    connect(uploader, &TusUploader::finished, this, [=](const QString &uploadUrl, qint64 uploadedSize) {
+    connect(upload, &TransferJob::finished, this, [=](const QString &uploadUrl, qint64 uploadedSize) {
         // **FIX: به جای ساخت FileMessage جدید، فقط state را تغییر بده**
         if (infoCard) {
             infoCard->setState(InfoCard::State::Completed_Sent);
@@ -339,17 +345,13 @@ void ClientChatWindow::onSendFileClicked()
         
         // Emit signal for saving to database and sending via WebSocket
         emit fileUploaded(fileName, uploadUrl, uploadedSize, m_serverHost);
-        uploader->deleteLater();
     });
 
-    connect(uploader, &TusUploader::error, this, [=](const QString &error) {
+    connect(upload, &TransferJob::error, this, [=](const QString &error) {
         QMessageBox::critical(this, "Upload Error", error);
         // حذف FileMessage در صورت خطا
         fileItem->deleteLater();
-        uploader->deleteLater();
     });
-
-    uploader->startUpload(filePath, tusEndpoint);
 }
 
 void ClientChatWindow::onRecordVoiceButtonClicked()
@@ -517,17 +519,18 @@ void ClientChatWindow::onRecorderStateChanged(QMediaRecorder::RecorderState stat
                 addMessageItem(voiceItem);
                 
                 // Now upload with waveform data
-                TusUploader *uploader = new TusUploader(this);
                 QUrl tusEndpoint = QUrl("http://" + m_serverHost + ":1080/files/");
+                TransferJob *upload = TransferScheduler::instance().submitUpload(
+                    recordingPath, tusEndpoint, TransferPriority::Voice);
 
                 // Connect progress to AudioMessage
-                connect(uploader, &TusUploader::uploadProgress, this, [voiceItem](qint64 bytesSent, qint64 bytesTotal) {
+                connect(upload, &TransferJob::progress, this, [voiceItem](qint64 bytesSent, qint64 bytesTotal) {
                     if (voiceItem && bytesTotal > 0) {
                         voiceItem->setInProgressState(bytesSent, bytesTotal);
                     }
                 });
 
-                connect(uploader, &TusUploader::finished, this, [this, uploader, fileInfo, waveform, voiceItem](const QString &fileUrl, qint64 uploadedSize, const QByteArray &) {
+                connect(upload, &TransferJob::finished, this, [this, fileInfo, waveform, voiceItem](const QString &fileUrl, qint64 uploadedSize, const QByteArray &) {
                     
                     // Update voice item with actual URL
                     if (voiceItem) {
@@ -537,21 +540,16 @@ void ClientChatWindow::onRecorderStateChanged(QMediaRecorder::RecorderState stat
                     
                     // Emit with waveform data
                     emit fileUploaded(fileInfo.fileName(), fileUrl, fileInfo.size(), m_serverHost, waveform);
-                    
-                    uploader->deleteLater();
                 });
 
-                connect(uploader, &TusUploader::error, this, [this, uploader, voiceItem](const QString &errorMsg) {
+                connect(upload, &TransferJob::error, this, [voiceItem](const QString &errorMsg) {
                     
                     // Remove voice item on error
                     if (voiceItem) {
                         voiceItem->deleteLater();
                     }
-                    
-                    uploader->deleteLater();
                 });
 
-                uploader->startUpload(recordingPath, tusEndpoint, false);
                 waveformGen->deleteLater();
             });
             
@@ -79,6 +79,7 @@ private:
     QProgressBar *m_uploadProgressBar;
     QString m_serverHost; // --- ADD: Store server host
     void updateInputModeButtons();
+    void uploadFile(const QString &filePath);
     
     // Voice recording
     bool ensureMicrophonePermission();
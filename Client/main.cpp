@@ -1,4 +1,5 @@
 #include <QApplication>
+#include <QCommandLineParser>
 #include "View/ConnectPage.h"
 #include "ConnectPageController.h"
 #include "View/ClientChatWindow.h"
@@ -6,12 +7,21 @@
 int main(int argc, char *argv[])
 {
     QApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption batchWindowOption("batch-window",
+        "Coalesce outgoing messages for this many milliseconds (0: one event-loop tick, default: off).",
+        "ms", "-1");
+    parser.addOption(batchWindowOption);
+    parser.process(app);
     
     // Client-only setup
     ConnectPage *connectPage = new ConnectPage();
     
     // Create controller for client
     ConnectPageController *controller = new ConnectPageController(connectPage);
+    controller->setBatchWindow(parser.value(batchWindowOption).toInt());
     
     // Show connect page
     connectPage->show();
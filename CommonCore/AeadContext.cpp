@@ -0,0 +1,226 @@
+#include "AeadContext.h"
+#include <QDebug>
+#include <openssl/err.h>
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#elif defined(__linux__) && (defined(__aarch64__) || defined(__arm__))
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+namespace {
+QString openSslError()
+{
+    char buffer[256];
+    ERR_error_string_n(ERR_get_error(), buffer, sizeof(buffer));
+    return QString(buffer);
+}
+
+const EVP_CIPHER *evpCipher(AeadCipher cipher)
+{
+    return cipher == AeadCipher::ChaCha20Poly1305 ? EVP_chacha20_poly1305() : EVP_aes_256_gcm();
+}
+
+bool detectAesAcceleration()
+{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    int info[4] = {};
+    __cpuid(info, 1);
+    return (info[2] & (1 << 25)) && (info[2] & (1 << 1));   // AES-NI, PCLMULQDQ
+#elif defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("aes") && __builtin_cpu_supports("pclmul");
+#elif defined(__APPLE__) && defined(__aarch64__)
+    return true;   // Every Apple Silicon core has the crypto extensions
+#elif defined(__linux__) && defined(__aarch64__)
+    const unsigned long hwcap = getauxval(AT_HWCAP);
+    return (hwcap & HWCAP_AES) && (hwcap & HWCAP_PMULL);
+#elif defined(__linux__) && defined(__arm__)
+    const unsigned long hwcap2 = getauxval(AT_HWCAP2);
+    return (hwcap2 & HWCAP2_AES) && (hwcap2 & HWCAP2_PMULL);
+#else
+    return false;
+#endif
+}
+}
+
+AeadContext::AeadContext(Direction direction, AeadCipher cipher)
+    : m_direction(direction)
+    , m_cipher(cipher)
+    , m_ctx(EVP_CIPHER_CTX_new())
+{
+    if (!m_ctx) {
+        qWarning() << "Failed to create cipher context:" << openSslError();
+    }
+}
+
+AeadContext::~AeadContext()
+{
+    EVP_CIPHER_CTX_free(m_ctx);
+}
+
+AeadContext &AeadContext::forThread(Direction direction, AeadCipher cipher)
+{
+    thread_local AeadContext gcmEncrypt(Direction::Encrypt, AeadCipher::Aes256Gcm);
+    thread_local AeadContext gcmDecrypt(Direction::Decrypt, AeadCipher::Aes256Gcm);
+    thread_local AeadContext chachaEncrypt(Direction::Encrypt, AeadCipher::ChaCha20Poly1305);
+    thread_local AeadContext chachaDecrypt(Direction::Decrypt, AeadCipher::ChaCha20Poly1305);
+    if (cipher == AeadCipher::ChaCha20Poly1305) {
+        return direction == Direction::Encrypt ? chachaEncrypt : chachaDecrypt;
+    }
+    return direction == Direction::Encrypt ? gcmEncrypt : gcmDecrypt;
+}
+
+bool AeadContext::hasAesAcceleration()
+{
+    static const bool accelerated = detectAesAcceleration();
+    return accelerated;
+}
+
+bool AeadContext::setKey(const QByteArray &key)
+{
+    if (!m_ctx) {
+        return false;
+    }
+    if (key.size() != KeySize) {
+        qWarning() << "AEAD ciphers require a 32-byte key";
+        return false;
+    }
+    if (key == m_key) {
+        return true;
+    }
+
+    const auto *keyData = reinterpret_cast<const unsigned char*>(key.constData());
+    const int ok = m_direction == Direction::Encrypt
+        ? EVP_EncryptInit_ex(m_ctx, evpCipher(m_cipher), nullptr, nullptr, nullptr)
+              && EVP_CIPHER_CTX_ctrl(m_ctx, EVP_CTRL_AEAD_SET_IVLEN, IvSize, nullptr)
+              && EVP_EncryptInit_ex(m_ctx, nullptr, nullptr, keyData, nullptr)
+        : EVP_DecryptInit_ex(m_ctx, evpCipher(m_cipher), nullptr, nullptr, nullptr)
+              && EVP_CIPHER_CTX_ctrl(m_ctx, EVP_CTRL_AEAD_SET_IVLEN, IvSize, nullptr)
+              && EVP_DecryptInit_ex(m_ctx, nullptr, nullptr, keyData, nullptr);
+    if (!ok) {
+        qWarning() << "Failed to load AEAD key:" << openSslError();
+        invalidate();
+        return false;
+    }
+
+    m_key = key;
+    return true;
+}
+
+bool AeadContext::begin(const unsigned char *iv)
+{
+    if (m_key.isEmpty()) {
+        qWarning() << "AeadContext used before setKey()";
+        return false;
+    }
+    // A null cipher and key keep the loaded schedule; only the IV changes
+    const int ok = m_direction == Direction::Encrypt
+        ? EVP_EncryptInit_ex(m_ctx, nullptr, nullptr, nullptr, iv)
+        : EVP_DecryptInit_ex(m_ctx, nullptr, nullptr, nullptr, iv);
+    if (ok != 1) {
+        qWarning() << "Failed to set IV:" << openSslError();
+        invalidate();
+        return false;
+    }
+    return true;
+}
+
+bool AeadContext::seal(const unsigned char *iv,
+                       const unsigned char *aad, int aadLength,
+                       const unsigned char *in, int length,
+                       unsigned char *out, unsigned char *tag)
+{
+    if (m_direction != Direction::Encrypt || !begin(iv)) {
+        return false;
+    }
+
+    int outlen = 0;
+    if (aadLength > 0 && EVP_EncryptUpdate(m_ctx, nullptr, &outlen, aad, aadLength) != 1) {
+        qWarning() << "Failed to set AAD:" << openSslError();
+        invalidate();
+        return false;
+    }
+
+    int total = 0;
+    if (length > 0) {
+        if (EVP_EncryptUpdate(m_ctx, out, &outlen, in, length) != 1) {
+            qWarning() << "Failed to encrypt data:" << openSslError();
+            invalidate();
+            return false;
+        }
+        total = outlen;
+    }
+
+    // Both suites are stream ciphers: Final writes nothing, it only computes the tag
+    if (EVP_EncryptFinal_ex(m_ctx, out + total, &outlen) != 1
+        || EVP_CIPHER_CTX_ctrl(m_ctx, EVP_CTRL_AEAD_GET_TAG, TagSize, tag) != 1) {
+        qWarning() << "Failed to finalize encryption:" << openSslError();
+        invalidate();
+        return false;
+    }
+    return true;
+}
+
+bool AeadContext::open(const unsigned char *iv,
+                       const unsigned char *aad, int aadLength,
+                       const unsigned char *in, int length,
+                       const unsigned char *tag, unsigned char *out)
+{
+    if (m_direction != Direction::Decrypt || !begin(iv)) {
+        return false;
+    }
+
+    int outlen = 0;
+    if (aadLength > 0 && EVP_DecryptUpdate(m_ctx, nullptr, &outlen, aad, aadLength) != 1) {
+        qWarning() << "Failed to set AAD:" << openSslError();
+        invalidate();
+        return false;
+    }
+
+    int total = 0;
+    if (length > 0) {
+        if (EVP_DecryptUpdate(m_ctx, out, &outlen, in, length) != 1) {
+            qWarning() << "Failed to decrypt data:" << openSslError();
+            invalidate();
+            return false;
+        }
+        total = outlen;
+    }
+
+    if (EVP_CIPHER_CTX_ctrl(m_ctx, EVP_CTRL_AEAD_SET_TAG, TagSize,
+                            const_cast<unsigned char*>(tag)) != 1) {
+        qWarning() << "Failed to set authentication tag:" << openSslError();
+        invalidate();
+        return false;
+    }
+
+    // A tag mismatch is an ordinary outcome (legacy probing, tampering); the
+    // context stays usable for the next message
+    return EVP_DecryptFinal_ex(m_ctx, out + total, &outlen) > 0;
+}
+
+bool AeadContext::rewind(const unsigned char *iv, unsigned char *data, int length)
+{
+    if (!begin(iv)) {
+        return false;
+    }
+    int outlen = 0;
+    const int ok = m_direction == Direction::Encrypt
+        ? EVP_EncryptUpdate(m_ctx, data, &outlen, data, length)
+        : EVP_DecryptUpdate(m_ctx, data, &outlen, data, length);
+    if (ok != 1) {
+        qWarning() << "Failed to restore ciphertext:" << openSslError();
+        invalidate();
+        return false;
+    }
+    // Left unfinished; the next begin() starts over
+    return true;
+}
+
+void AeadContext::invalidate()
+{
+    // Force a full re-initialisation on the next setKey()
+    m_key.clear();
+    ERR_clear_error();
+}
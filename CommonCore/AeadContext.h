@@ -0,0 +1,74 @@
+#ifndef AEADCONTEXT_H
+#define AEADCONTEXT_H
+
+#include <QByteArray>
+#include <QtGlobal>
+#include <openssl/evp.h>
+
+// AEAD suites an envelope can name. Both take a 32-byte key, a 12-byte
+// nonce and produce a 16-byte tag, so the envelope layout does not change.
+enum class AeadCipher : quint8 {
+    Aes256Gcm = 0,
+    ChaCha20Poly1305 = 1   // Faster on CPUs without AES instructions
+};
+
+// An AEAD EVP context that keeps its key schedule between messages. Setting
+// up a context (allocation, cipher fetch, IV length, key expansion) costs
+// more than sealing a short chat message, so each thread keeps one context
+// per direction and cipher, and only the IV is reset per call.
+//
+// Not thread-safe; use forThread() or own one per session.
+class AeadContext
+{
+public:
+    enum class Direction { Encrypt, Decrypt };
+
+    static constexpr int KeySize = 32;
+    static constexpr int IvSize = 12;
+    static constexpr int TagSize = 16;
+
+    explicit AeadContext(Direction direction, AeadCipher cipher = AeadCipher::Aes256Gcm);
+    ~AeadContext();
+
+    AeadContext(const AeadContext&) = delete;
+    AeadContext& operator=(const AeadContext&) = delete;
+
+    // The calling thread's context for this direction and cipher
+    static AeadContext &forThread(Direction direction, AeadCipher cipher = AeadCipher::Aes256Gcm);
+
+    // Whether this CPU has AES and carry-less multiply instructions, i.e.
+    // whether GCM runs in hardware. Detected once.
+    static bool hasAesAcceleration();
+
+    AeadCipher cipher() const { return m_cipher; }
+
+    // Re-expands the key schedule only when key differs from the loaded one
+    bool setKey(const QByteArray &key);
+
+    // out must have room for length bytes and may alias in. iv is IvSize
+    // bytes, tag TagSize bytes.
+    bool seal(const unsigned char *iv,
+              const unsigned char *aad, int aadLength,
+              const unsigned char *in, int length,
+              unsigned char *out, unsigned char *tag);
+    // Returns false if the tag does not authenticate; out is then garbage
+    bool open(const unsigned char *iv,
+              const unsigned char *aad, int aadLength,
+              const unsigned char *in, int length,
+              const unsigned char *tag, unsigned char *out);
+    // Undoes a failed in-place open() under the same iv. Both suites XOR
+    // with a keystream that is the same in either direction, so applying it
+    // again restores the ciphertext for another parsing attempt.
+    bool rewind(const unsigned char *iv, unsigned char *data, int length);
+
+private:
+    bool begin(const unsigned char *iv);
+    void invalidate();
+
+    Direction m_direction;
+    AeadCipher m_cipher;
+    EVP_CIPHER_CTX *m_ctx;
+    QByteArray m_key;     // Empty until a key schedule is loaded
+};
+
+#endif // AEADCONTEXT_H
@@ -0,0 +1,151 @@
+#include "ChunkedStream.h"
+#include "CryptoManager.h"
+#include <QDebug>
+#include <QtEndian>
+#include <cstring>
+#include <openssl/rand.h>
+
+namespace {
+constexpr char kMagic[4] = {'C', 'A', 'E', 'F'};
+constexpr quint8 kVersion = 1;
+constexpr int kSaltOffset = 12;
+constexpr int kSaltSize = ChunkedStream::HeaderSize - kSaltOffset;
+}
+
+ChunkedStream::ChunkedStream()
+    : m_cipher(AeadCipher::Aes256Gcm)
+    , m_chunkSize(0)
+{
+}
+
+bool ChunkedStream::create(const QByteArray &key, AeadCipher cipher, int chunkSize)
+{
+    reset();
+    if (chunkSize < MinChunkSize || chunkSize > MaxChunkSize) {
+        qWarning() << "Chunk size out of range:" << chunkSize;
+        return false;
+    }
+
+    QByteArray header(HeaderSize, 0);
+    char *h = header.data();
+    memcpy(h, kMagic, sizeof(kMagic));
+    h[4] = char(kVersion);
+    h[5] = char(cipher);
+    qToBigEndian<quint32>(quint32(chunkSize), h + 8);
+    if (RAND_bytes(reinterpret_cast<unsigned char*>(h + kSaltOffset), kSaltSize) != 1) {
+        qWarning() << "Failed to generate stream salt";
+        return false;
+    }
+
+    m_header = header;
+    m_cipher = cipher;
+    m_chunkSize = chunkSize;
+    return start(key);
+}
+
+bool ChunkedStream::open(const QByteArray &key, QByteArrayView header)
+{
+    reset();
+    if (header.size() != HeaderSize || memcmp(header.data(), kMagic, sizeof(kMagic)) != 0
+        || quint8(header[4]) != kVersion || header[6] != 0 || header[7] != 0) {
+        qWarning() << "Not an encrypted stream header";
+        return false;
+    }
+    if (quint8(header[5]) > quint8(AeadCipher::ChaCha20Poly1305)) {
+        qWarning() << "Unknown cipher in stream header:" << quint8(header[5]);
+        return false;
+    }
+    const quint32 chunkSize = qFromBigEndian<quint32>(header.data() + 8);
+    if (chunkSize < quint32(MinChunkSize) || chunkSize > quint32(MaxChunkSize)) {
+        qWarning() << "Chunk size out of range:" << chunkSize;
+        return false;
+    }
+
+    m_header = header.toByteArray();
+    m_cipher = AeadCipher(header[5]);
+    m_chunkSize = int(chunkSize);
+    return start(key);
+}
+
+void ChunkedStream::reset()
+{
+    m_key.clear();
+    m_header.clear();
+    m_chunkSize = 0;
+}
+
+bool ChunkedStream::start(const QByteArray &key)
+{
+    // The salt makes the key unique per stream, so the index alone keeps
+    // nonces unique
+    QByteArray info("chatapp file ");
+    info.append(CryptoManager::cipherName(m_cipher).toLatin1());
+
+    QByteArray streamKey;
+    if (!CryptoManager::deriveKey(key, m_header.mid(kSaltOffset, kSaltSize), info, streamKey)) {
+        qWarning() << "Failed to derive stream key";
+        reset();
+        return false;
+    }
+    m_key = streamKey;
+    return true;
+}
+
+qint64 ChunkedStream::chunkCount(qint64 plainSize) const
+{
+    if (m_chunkSize <= 0) {
+        return 0;
+    }
+    return qMax<qint64>(1, (plainSize + m_chunkSize - 1) / m_chunkSize);
+}
+
+qint64 ChunkedStream::encryptedSize(qint64 plainSize) const
+{
+    return HeaderSize + plainSize + chunkCount(plainSize) * AeadContext::TagSize;
+}
+
+// 7 zero bytes, the chunk index, then 1 for the final chunk
+void ChunkedStream::chunkNonce(quint32 index, bool last, unsigned char *nonce)
+{
+    memset(nonce, 0, AeadContext::IvSize);
+    qToBigEndian<quint32>(index, nonce + 7);
+    nonce[AeadContext::IvSize - 1] = last ? 1 : 0;
+}
+
+bool ChunkedStream::sealChunk(quint32 index, bool last, char *data, qsizetype length) const
+{
+    if (!isValid() || length < 0 || length > m_chunkSize || (!last && length != m_chunkSize)) {
+        qWarning() << "Cannot seal chunk" << index << "of" << length << "bytes";
+        return false;
+    }
+
+    unsigned char nonce[AeadContext::IvSize];
+    chunkNonce(index, last, nonce);
+    // setKey() is free while the thread keeps working on the same stream
+    AeadContext &ctx = AeadContext::forThread(AeadContext::Direction::Encrypt, m_cipher);
+    const auto *aad = reinterpret_cast<const unsigned char*>(m_header.constData());
+    auto *plain = reinterpret_cast<unsigned char*>(data);
+    return ctx.setKey(m_key)
+        && ctx.seal(nonce, aad, HeaderSize, plain, int(length), plain, plain + length);
+}
+
+bool ChunkedStream::openChunk(quint32 index, bool last, char *data, qsizetype sealedLength) const
+{
+    const qsizetype length = sealedLength - AeadContext::TagSize;
+    if (!isValid() || length < 0 || length > m_chunkSize || (!last && length != m_chunkSize)) {
+        qWarning() << "Chunk" << index << "has the wrong size:" << sealedLength;
+        return false;
+    }
+
+    unsigned char nonce[AeadContext::IvSize];
+    chunkNonce(index, last, nonce);
+    AeadContext &ctx = AeadContext::forThread(AeadContext::Direction::Decrypt, m_cipher);
+    const auto *aad = reinterpret_cast<const unsigned char*>(m_header.constData());
+    auto *sealed = reinterpret_cast<unsigned char*>(data);
+    if (!ctx.setKey(m_key)
+        || !ctx.open(nonce, aad, HeaderSize, sealed, int(length), sealed + length, sealed)) {
+        qWarning() << "Authentication failed for chunk" << index;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,71 @@
+#ifndef CHUNKEDSTREAM_H
+#define CHUNKEDSTREAM_H
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include "AeadContext.h"
+
+// Chunked AEAD layout shared by encrypted files and encrypted TUS uploads:
+//
+//   header(28) | chunk 0 | chunk 1 | ... | chunk n,   chunk = ciphertext | tag(16)
+//   header     = "CAEF" | version(1) | cipher(1) | reserved(2) |
+//                chunk size(4, big endian) | salt(16)
+//
+// Every chunk but the last holds chunkSize plaintext bytes. Chunks are sealed
+// under a key derived from the caller's key and the salt, with the header as
+// AAD and a nonce made of the chunk index and a final-chunk flag. The header
+// is the only metadata, whatever the file size: any chunk can be located and
+// decrypted from its index alone, and truncating, reordering or splicing
+// chunks between streams fails authentication.
+//
+// create(), open() and reset() are not thread-safe. sealChunk() and
+// openChunk() run on the calling thread's AeadContext, so several threads
+// may process chunks of one stream at once.
+class ChunkedStream
+{
+public:
+    static constexpr int HeaderSize = 28;
+    static constexpr int MinChunkSize = 4 * 1024;
+    static constexpr int MaxChunkSize = 64 * 1024 * 1024;
+
+    ChunkedStream();
+
+    ChunkedStream(const ChunkedStream&) = delete;
+    ChunkedStream& operator=(const ChunkedStream&) = delete;
+
+    // Writer: new header with a fresh salt
+    bool create(const QByteArray &key, AeadCipher cipher, int chunkSize);
+    // Reader: header as written by create()
+    bool open(const QByteArray &key, QByteArrayView header);
+    void reset();
+
+    bool isValid() const { return !m_key.isEmpty(); }
+    const QByteArray &header() const { return m_header; }
+    AeadCipher cipher() const { return m_cipher; }
+    int chunkSize() const { return m_chunkSize; }
+    qint64 sealedChunkSize() const { return qint64(m_chunkSize) + AeadContext::TagSize; }
+
+    // Stream offset of a chunk, header included
+    qint64 chunkOffset(qint64 index) const { return HeaderSize + index * sealedChunkSize(); }
+    // Whole stream for a plaintext of plainSize; an empty plaintext still
+    // gets one (empty) final chunk
+    qint64 encryptedSize(qint64 plainSize) const;
+    qint64 chunkCount(qint64 plainSize) const;
+
+    // data holds length plaintext bytes and room for the tag behind them
+    bool sealChunk(quint32 index, bool last, char *data, qsizetype length) const;
+    // data holds a sealed chunk; its sealedLength - TagSize plaintext bytes
+    // overwrite the start of it
+    bool openChunk(quint32 index, bool last, char *data, qsizetype sealedLength) const;
+
+private:
+    bool start(const QByteArray &key);
+    static void chunkNonce(quint32 index, bool last, unsigned char *nonce);
+
+    QByteArray m_key;
+    QByteArray m_header;
+    AeadCipher m_cipher;
+    int m_chunkSize;
+};
+
+#endif // CHUNKEDSTREAM_H
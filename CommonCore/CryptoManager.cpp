@@ -1,6 +1,135 @@
 #include "CryptoManager.h"
+#include "AeadContext.h"
+#include "MessageSession.h"
+#include "ChunkedStream.h"
 #include <QDebug>
 #include <openssl/err.h>
+#include <QtEndian>
+#include <QSaveFile>
+#include <limits>
+#include <openssl/kdf.h>
+#include <atomic>
+#ifdef CHATAPP_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+namespace {
+constexpr quint8 kEnvelopeVersion = 0xC1;
+// Counter-nonce envelope of a negotiated MessageSession
+constexpr quint8 kSessionVersion = 0xC2;
+constexpr quint8 kFlagCodecMask = 0x03;
+constexpr quint8 kFlagCipherMask = 0x0C;
+constexpr int kFlagCipherShift = 2;
+constexpr int kEnvelopeHeaderSize = 2;
+constexpr int kGcmOverhead = AeadContext::IvSize + AeadContext::TagSize;
+constexpr int kSessionHeaderSize = kEnvelopeHeaderSize + 8;   // + 64-bit counter
+// Refuse to inflate anything that claims to be larger than this
+constexpr qint64 kMaxDecompressedSize = 64 * 1024 * 1024;
+
+// Packed so encryptPayload reads the whole policy in one load
+std::atomic<quint32> g_compressionPolicy{
+    (quint32(PayloadCodec::Deflate) << 24) | (quint32(0xFF) << 16) | 512u};
+
+constexpr int kMaxThreshold = 0xFFFF;
+constexpr int kMaxLevel = 22;
+
+// setCompressionPolicy() has checked the ranges
+quint32 packPolicy(const CompressionPolicy &policy)
+{
+    const quint32 level = quint32(quint8(qint8(policy.level)));
+    return (quint32(policy.codec) << 24) | (level << 16) | quint32(policy.threshold);
+}
+
+// Decoded once; generateAES256Key() decodes base64 on every call
+const QByteArray &sharedKey()
+{
+    static const QByteArray key = CryptoManager::generateAES256Key();
+    return key;
+}
+
+const unsigned char *bytes(const char *data)
+{
+    return reinterpret_cast<const unsigned char*>(data);
+}
+
+unsigned char *bytes(char *data)
+{
+    return reinterpret_cast<unsigned char*>(data);
+}
+
+quint8 envelopeFlags(PayloadCodec codec, AeadCipher cipher)
+{
+    return (quint8(codec) & kFlagCodecMask)
+         | ((quint8(cipher) << kFlagCipherShift) & kFlagCipherMask);
+}
+
+bool cipherFromFlags(quint8 flags, AeadCipher &cipher)
+{
+    const quint8 id = (flags & kFlagCipherMask) >> kFlagCipherShift;
+    if (id > quint8(AeadCipher::ChaCha20Poly1305)) {
+        return false;
+    }
+    cipher = AeadCipher(id);
+    return true;
+}
+
+// A legacy envelope starts with a random IV, so a matching version byte is
+// only a hint; authentication decides which format it really is
+bool looksVersioned(QByteArrayView envelope)
+{
+    AeadCipher cipher;
+    return envelope.size() >= kEnvelopeHeaderSize + kGcmOverhead
+        && quint8(envelope[0]) == kEnvelopeVersion
+        && (quint8(envelope[1]) & ~(kFlagCodecMask | kFlagCipherMask)) == 0
+        && cipherFromFlags(quint8(envelope[1]), cipher);
+}
+
+bool looksSession(QByteArrayView envelope, const MessageSession &session)
+{
+    AeadCipher cipher;
+    return session.isActive()
+        && envelope.size() >= kSessionHeaderSize + AeadContext::TagSize
+        && quint8(envelope[0]) == kSessionVersion
+        && (quint8(envelope[1]) & ~(kFlagCodecMask | kFlagCipherMask)) == 0
+        && cipherFromFlags(quint8(envelope[1]), cipher)
+        && cipher == session.cipher();
+}
+
+// QIODevice::read may return short counts before the end
+qint64 readFully(QIODevice &device, char *data, qint64 size)
+{
+    qint64 total = 0;
+    while (total < size) {
+        const qint64 n = device.read(data + total, size - total);
+        if (n < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        total += n;
+    }
+    return total;
+}
+
+// -1: follow the CPU
+std::atomic<int> g_preferredCipher{-1};
+
+const QLatin1String kCipherAesGcm("aes-256-gcm");
+const QLatin1String kCipherChaCha("chacha20-poly1305");
+
+const QLatin1String kCodecDeflate("deflate");
+const QLatin1String kCodecZstd("zstd");
+
+CompressionPolicy unpackPolicy(quint32 packed)
+{
+    CompressionPolicy policy;
+    policy.codec = PayloadCodec(packed >> 24);
+    policy.level = qint8(quint8(packed >> 16));
+    policy.threshold = int(packed & 0xFFFF);
+    return policy;
+}
+}
 
 CryptoManager::CryptoManager(QObject *parent)
     : QObject(parent)
@@ -20,312 +149,700 @@ CryptoManager::~CryptoManager()
 // Simplified static methods for easy use
 QString CryptoManager::encryptMessage(const QString &message)
 {
-    // Convert QString to UTF-8 QByteArray
-    QByteArray plaintext = message.toUtf8();
-
-    // Generate key and IV
-    QByteArray key = generateAES256Key();
-    QByteArray iv = generateGCMIV();
-
-    if (key.isEmpty() || iv.isEmpty()) {
-        qWarning() << "Failed to generate key or IV";
+    QByteArray combinedData = encryptPayload(message.toUtf8());
+    if (combinedData.isEmpty()) {
         return QString();
     }
 
-    QByteArray ciphertext, tag;
+    // Convert to base64 string for easy string handling
+    return QString::fromLatin1(combinedData.toBase64());
+}
 
-    // Encrypt the message
-if (!encryptAESGCM256(plaintext, key, ciphertext, iv, tag)) {
-        qWarning() << "Encryption failed";
-    return QString();
-        }
+QString CryptoManager::decryptMessage(const QString &encryptedData)
+{
+    // Convert base64 string back to QByteArray
+    QByteArray combinedData = QByteArray::fromBase64(encryptedData.toLatin1());
 
-     QByteArray combinedData;
-    combinedData.append(iv);
-    combinedData.append(tag);
-    combinedData.append(ciphertext);
+    // Convert decrypted bytes back to QString
+    return QString::fromUtf8(decryptPayload(combinedData));
+}
 
+QByteArray CryptoManager::encryptPayload(const QByteArray &plaintext, AeadCipher cipher, PayloadCodec codec)
+{
+    const QByteArray compressed = compressForPolicy(plaintext, codec);
+    const QByteArrayView body = codec == PayloadCodec::None ? QByteArrayView(plaintext)
+                                                            : QByteArrayView(compressed);
 
-                 // Convert to base64 string for easy string handling
-return QString(combinedData.toBase64());
+    QByteArray envelope(kEnvelopeHeaderSize + kGcmOverhead + body.size(), Qt::Uninitialized);
+    if (!sealEnvelope(body, codec, cipher, envelope.data())) {
+        qWarning() << "Encryption failed";
+        return QByteArray();
     }
+    return envelope;
+}
 
-QString CryptoManager::decryptMessage(const QString &encryptedData)
+QByteArray CryptoManager::encryptLegacyPayload(const QByteArray &plaintext)
 {
-    // Convert base64 string back to QByteArray
-    QByteArray combinedData = QByteArray::fromBase64(encryptedData.toUtf8());
+    QByteArray envelope(kGcmOverhead + plaintext.size(), Qt::Uninitialized);
+    char *iv = envelope.data();
+    char *tag = iv + AeadContext::IvSize;
+    char *ciphertext = tag + AeadContext::TagSize;
+    if (RAND_bytes(bytes(iv), AeadContext::IvSize) != 1) {
+        qWarning() << "Failed to generate random IV:" << getOpenSSLErrorString();
+        return QByteArray();
+    }
+
+    AeadContext &ctx = AeadContext::forThread(AeadContext::Direction::Encrypt);
+    if (!ctx.setKey(sharedKey())
+        || !ctx.seal(bytes(iv), nullptr, 0,
+                     bytes(plaintext.constData()), int(plaintext.size()), bytes(ciphertext), bytes(tag))) {
+        qWarning() << "Encryption failed";
+        return QByteArray();
+    }
+    return envelope;
+}
 
+QByteArray CryptoManager::encryptPayload(const QByteArray &plaintext, MessageSession &session, PayloadCodec codec)
+{
+    const QByteArray compressed = compressForPolicy(plaintext, codec);
+    const QByteArrayView body = codec == PayloadCodec::None ? QByteArrayView(plaintext)
+                                                            : QByteArrayView(compressed);
+
+    // version | flags | counter | tag | ciphertext; the nonce itself is
+    // rebuilt by the receiver from its copy of the session
+    QByteArray envelope(kSessionHeaderSize + AeadContext::TagSize + body.size(), Qt::Uninitialized);
+    char *out = envelope.data();
+    char *tag = out + kSessionHeaderSize;
+    char *ciphertext = tag + AeadContext::TagSize;
+
+    quint64 counter = 0;
+    unsigned char nonce[AeadContext::IvSize];
+    if (!session.nextNonce(counter, nonce)) {
+        qWarning() << "Message session not started or exhausted";
+        return QByteArray();
+    }
+    out[0] = char(kSessionVersion);
+    out[1] = char(envelopeFlags(codec, session.cipher()));
+    qToBigEndian<quint64>(counter, out + kEnvelopeHeaderSize);
 
-if (combinedData.size() < 28) {
-     qWarning() << "Encrypted data too small. Minimum 28 bytes required.";
-     return QString();
+    if (!session.context().seal(nonce, bytes(out), kSessionHeaderSize,
+                                bytes(body.data()), int(body.size()), bytes(ciphertext), bytes(tag))) {
+        qWarning() << "Encryption failed";
+        return QByteArray();
+    }
+    return envelope;
 }
-    // Get the pre-shared secret key
-     QByteArray key = generateAES256Key();
 
-     // Extract components
-     QByteArray iv = combinedData.mid(0, 12);
-     QByteArray tag = combinedData.mid(12, 16);
-     QByteArray ciphertext = combinedData.mid(28);
-     QByteArray plaintext;
-     // Decrypt the message
-     if (!decryptAESGCM256(ciphertext, key, iv, tag, plaintext)) {
-    qWarning() << "Decryption failed";
-        return QString();
+QByteArray CryptoManager::decryptPayload(const QByteArray &envelope, MessageSession *session)
+{
+    if (envelope.size() < kSessionHeaderSize + AeadContext::TagSize) {
+        qWarning() << "Encrypted data too small. Minimum 26 bytes required.";
+        return QByteArray();
     }
 
-    // Convert decrypted bytes back to QString
-    return QString::fromUtf8(plaintext);
+    PayloadCodec codec = PayloadCodec::None;
+    QByteArray body;
+
+    if (session && session->isActive()) {
+        // Anything else is sealed under the shared key and could be replayed
+        // at will, which is what the session exists to prevent
+        if (!looksSession(envelope, *session)) {
+            qWarning() << "Dropped frame outside the message session";
+            return QByteArray();
+        }
+        const quint64 counter = qFromBigEndian<quint64>(envelope.constData() + kEnvelopeHeaderSize);
+        if (!session->isFresh(counter)) {
+            qWarning() << "Dropped replayed or reordered frame";
+            return QByteArray();
+        }
+        body.resize(envelope.size() - kSessionHeaderSize - AeadContext::TagSize);
+        if (!openSessionEnvelope(envelope, body.data(), *session, counter, codec)) {
+            qWarning() << "Decryption failed";
+            return QByteArray();
+        }
+    } else {
+        // Versioned first, then legacy. Each decrypts into its own output
+        // buffer, so a failed attempt leaves the envelope intact.
+        bool opened = false;
+        if (looksVersioned(envelope)) {
+            body.resize(envelope.size() - kEnvelopeHeaderSize - kGcmOverhead);
+            AeadCipher cipher = AeadCipher::Aes256Gcm;
+            opened = openEnvelope(envelope, body.data(), codec, cipher);
+        }
+        if (!opened && envelope.size() >= kGcmOverhead) {
+            body.resize(envelope.size() - kGcmOverhead);
+            codec = PayloadCodec::None;
+            opened = openLegacyEnvelope(envelope, body.data());
+        }
+        if (!opened) {
+            qWarning() << "Decryption failed";
+            return QByteArray();
+        }
+    }
+
+    if (codec == PayloadCodec::None) {
+        return body;
+    }
+    QByteArray plaintext;
+    if (!decompress(body, codec, plaintext)) {
+        qWarning() << "Failed to decompress payload, codec" << int(codec);
+        return QByteArray();
+    }
+    return plaintext;
 }
 
-QFile CryptoManager::encryptFile(const QFile &file)
+bool CryptoManager::decryptInPlace(QByteArray &envelope, QByteArrayView &plaintext, MessageSession *session)
 {
-    // TODO: Implement full file encryption if needed
-    return QFile();
+    if (envelope.size() < kSessionHeaderSize + AeadContext::TagSize) {
+        qWarning() << "Encrypted data too small. Minimum 26 bytes required.";
+        return false;
+    }
+
+    char *data = envelope.data();
+
+    if (session && session->isActive()) {
+        // Session envelopes only, as in decryptPayload()
+        if (!looksSession(envelope, *session)) {
+            qWarning() << "Dropped frame outside the message session";
+            return false;
+        }
+        const quint64 counter = qFromBigEndian<quint64>(data + kEnvelopeHeaderSize);
+        if (!session->isFresh(counter)) {
+            qWarning() << "Dropped replayed or reordered frame";
+            return false;
+        }
+        char *body = data + kSessionHeaderSize + AeadContext::TagSize;
+        const qsizetype bodySize = envelope.size() - kSessionHeaderSize - AeadContext::TagSize;
+        PayloadCodec codec = PayloadCodec::None;
+        if (!openSessionEnvelope(envelope, body, *session, counter, codec)) {
+            qWarning() << "Decryption failed";
+            return false;
+        }
+        return finishInPlace(envelope, body, bodySize, codec, plaintext);
+    }
+
+    // Versioned first, decrypting over its own ciphertext and rewinding it
+    // when the tag does not match, then legacy
+    if (looksVersioned(envelope)) {
+        char *body = data + kEnvelopeHeaderSize + kGcmOverhead;
+        const qsizetype bodySize = envelope.size() - kEnvelopeHeaderSize - kGcmOverhead;
+        PayloadCodec codec = PayloadCodec::None;
+        AeadCipher cipher = AeadCipher::Aes256Gcm;
+        if (openEnvelope(envelope, body, codec, cipher)) {
+            return finishInPlace(envelope, body, bodySize, codec, plaintext);
+        }
+        AeadContext &ctx = AeadContext::forThread(AeadContext::Direction::Decrypt, cipher);
+        if (!ctx.rewind(bytes(data + kEnvelopeHeaderSize), bytes(body), int(bodySize))) {
+            return false;
+        }
+    }
+
+    if (envelope.size() < kGcmOverhead || !openLegacyEnvelope(envelope, data + kGcmOverhead)) {
+        qWarning() << "Decryption failed";
+        return false;
+    }
+    plaintext = QByteArrayView(data + kGcmOverhead, envelope.size() - kGcmOverhead);
+    return true;
 }
 
-QFile CryptoManager::decryptFile(const QFile &file)
+QByteArray CryptoManager::compressForPolicy(const QByteArray &plaintext, PayloadCodec &codec)
 {
-    // TODO: Implement full file decryption if needed
-    return QFile();
+    // Compress first; encrypted bytes look random and never shrink
+    const CompressionPolicy policy = compressionPolicy();
+    const PayloadCodec negotiated = codec;
+    codec = PayloadCodec::None;
+    if (negotiated == PayloadCodec::None || plaintext.size() < policy.threshold) {
+        return QByteArray();
+    }
+    QByteArray compressed = compress(plaintext, negotiated, policy.level);
+    if (compressed.isEmpty() || compressed.size() >= plaintext.size()) {
+        return QByteArray();
+    }
+    codec = negotiated;
+    return compressed;
 }
 
-bool CryptoManager::encryptChunk(const QByteArray &plainChunk,
-                                const QByteArray &key,
-                                QByteArray &encryptedChunk,
-                                ChunkMetadata &metadata)
+bool CryptoManager::finishInPlace(QByteArray &envelope, char *body, qsizetype bodySize,
+                                  PayloadCodec codec, QByteArrayView &plaintext)
 {
-    if (plainChunk.isEmpty()) {
-        qWarning() << "Cannot encrypt empty chunk";
+    if (codec == PayloadCodec::None) {
+        plaintext = QByteArrayView(body, bodySize);
+        return true;
+    }
+    QByteArray inflated;
+    if (!decompress(QByteArray::fromRawData(body, bodySize), codec, inflated)) {
+        qWarning() << "Failed to decompress payload, codec" << int(codec);
         return false;
     }
+    envelope = inflated;
+    plaintext = envelope;
+    return true;
+}
 
-    // Generate a unique IV for this chunk
-    metadata.iv = generateGCMIV();
-    if (metadata.iv.isEmpty()) {
-        qWarning() << "Failed to generate IV for chunk";
+bool CryptoManager::sealEnvelope(QByteArrayView body, PayloadCodec codec, AeadCipher cipher, char *out)
+{
+    // version | flags | IV | tag | ciphertext, written in place; body may
+    // already sit at the ciphertext offset
+    char *iv = out + kEnvelopeHeaderSize;
+    char *tag = iv + AeadContext::IvSize;
+    char *ciphertext = tag + AeadContext::TagSize;
+
+    out[0] = char(kEnvelopeVersion);
+    out[1] = char(envelopeFlags(codec, cipher));
+    if (RAND_bytes(bytes(iv), AeadContext::IvSize) != 1) {
+        qWarning() << "Failed to generate random IV:" << getOpenSSLErrorString();
         return false;
     }
 
-    metadata.originalSize = plainChunk.size();
+    // The header is bound as AAD so flags cannot be flipped
+    AeadContext &ctx = AeadContext::forThread(AeadContext::Direction::Encrypt, cipher);
+    return ctx.setKey(sharedKey())
+        && ctx.seal(bytes(iv), bytes(out), kEnvelopeHeaderSize,
+                    bytes(body.data()), int(body.size()), bytes(ciphertext), bytes(tag));
+}
 
-    // Encrypt the chunk using AES-GCM-256
-    QByteArray tag;
-    if (!encryptAESGCM256(plainChunk, key, encryptedChunk, metadata.iv, tag)) {
-        qWarning() << "Failed to encrypt chunk";
+bool CryptoManager::openEnvelope(QByteArrayView envelope, char *out, PayloadCodec &codec, AeadCipher &cipher)
+{
+    const char *data = envelope.data();
+    const char *iv = data + kEnvelopeHeaderSize;
+    const char *tag = iv + AeadContext::IvSize;
+    const char *ciphertext = tag + AeadContext::TagSize;
+    codec = PayloadCodec(quint8(data[1]) & kFlagCodecMask);
+    if (!cipherFromFlags(quint8(data[1]), cipher)) {
         return false;
     }
 
-    metadata.tag = tag;
-    metadata.encryptedSize = encryptedChunk.size();
+    AeadContext &ctx = AeadContext::forThread(AeadContext::Direction::Decrypt, cipher);
+    return ctx.setKey(sharedKey())
+        && ctx.open(bytes(iv), bytes(data), kEnvelopeHeaderSize,
+                    bytes(ciphertext), int(envelope.size() - kEnvelopeHeaderSize - kGcmOverhead),
+                    bytes(tag), bytes(out));
+}
 
+bool CryptoManager::openSessionEnvelope(QByteArrayView envelope, char *out, MessageSession &session,
+                                        quint64 counter, PayloadCodec &codec)
+{
+    const char *data = envelope.data();
+    const char *tag = data + kSessionHeaderSize;
+    const char *ciphertext = tag + AeadContext::TagSize;
+    codec = PayloadCodec(quint8(data[1]) & kFlagCodecMask);
+
+    unsigned char nonce[AeadContext::IvSize];
+    session.nonceFor(counter, nonce);
+    if (!session.context().open(nonce, bytes(data), kSessionHeaderSize,
+                                bytes(ciphertext), int(envelope.size() - kSessionHeaderSize - AeadContext::TagSize),
+                                bytes(tag), bytes(out))) {
+        return false;
+    }
+    session.accept(counter);
     return true;
 }
 
-bool CryptoManager::decryptChunk(const QByteArray &encryptedChunk,
-                                const QByteArray &key,
-                                const ChunkMetadata &metadata,
-                                QByteArray &plainChunk)
+bool CryptoManager::openLegacyEnvelope(QByteArrayView envelope, char *out)
+{
+    // IV | tag | ciphertext, no header
+    const char *iv = envelope.data();
+    const char *tag = iv + AeadContext::IvSize;
+    const char *ciphertext = tag + AeadContext::TagSize;
+
+    AeadContext &ctx = AeadContext::forThread(AeadContext::Direction::Decrypt);
+    return ctx.setKey(sharedKey())
+        && ctx.open(bytes(iv), nullptr, 0,
+                    bytes(ciphertext), int(envelope.size() - kGcmOverhead),
+                    bytes(tag), bytes(out));
+}
+
+bool CryptoManager::setCompressionPolicy(const CompressionPolicy &policy)
 {
-    if (encryptedChunk.isEmpty()) {
-        qWarning() << "Cannot decrypt empty chunk";
+    // The packed policy has 16 bits of threshold and a signed byte of level
+    if (policy.threshold < 0 || policy.threshold > kMaxThreshold) {
+        qWarning() << "Compression threshold" << policy.threshold << "outside 0 -" << kMaxThreshold
+                   << "- keeping" << compressionPolicy().threshold;
         return false;
     }
-
-    if (metadata.iv.size() != 12) {
-        qWarning() << "Invalid IV size for chunk" << metadata.chunkIndex;
+    if (policy.level < -1 || policy.level > kMaxLevel) {
+        qWarning() << "Compression level" << policy.level << "outside -1 -" << kMaxLevel
+                   << "- keeping" << compressionPolicy().level;
         return false;
     }
 
-    if (metadata.tag.size() != 16) {
-        qWarning() << "Invalid tag size for chunk" << metadata.chunkIndex;
-        return false;
+    CompressionPolicy applied = policy;
+    if (!isCodecAvailable(applied.codec)) {
+        qWarning() << "Payload codec" << int(applied.codec) << "not available, using deflate";
+        applied.codec = PayloadCodec::Deflate;
     }
+    g_compressionPolicy.store(packPolicy(applied), std::memory_order_relaxed);
+    return true;
+}
 
-    // Decrypt the chunk using AES-GCM-256
-    if (!decryptAESGCM256(encryptedChunk, key, metadata.iv, metadata.tag, plainChunk)) {
-        qWarning() << "Failed to decrypt chunk" << metadata.chunkIndex;
+CompressionPolicy CryptoManager::compressionPolicy()
+{
+    return unpackPolicy(g_compressionPolicy.load(std::memory_order_relaxed));
+}
+
+bool CryptoManager::isCodecAvailable(PayloadCodec codec)
+{
+    switch (codec) {
+    case PayloadCodec::None:
+    case PayloadCodec::Deflate:
+        return true;
+    case PayloadCodec::Zstd:
+#ifdef CHATAPP_WITH_ZSTD
+        return true;
+#else
         return false;
+#endif
     }
+    return false;
+}
 
-    return true;
+QStringList CryptoManager::supportedCodecs()
+{
+    QStringList codecs{kCodecDeflate};
+    if (isCodecAvailable(PayloadCodec::Zstd)) {
+        codecs.append(kCodecZstd);
+    }
+    return codecs;
 }
 
-bool CryptoManager::encryptAESGCM256(const QByteArray &plaintext,
-                                   const QByteArray &key,
-                                   QByteArray &ciphertext,
-                                   QByteArray &iv,
-                                   QByteArray &tag)
+PayloadCodec CryptoManager::negotiateCodec(const QStringList &peerCodecs)
 {
-    if (key.size() != 32) {
-        qWarning() << "AES-GCM-256 requires a 32-byte key";
-        return false;
+    const PayloadCodec preferred = compressionPolicy().codec;
+    if (preferred == PayloadCodec::None) {
+        return PayloadCodec::None;
+    }
+    if (peerCodecs.contains(codecName(preferred))) {
+        return preferred;
     }
+    return peerCodecs.contains(kCodecDeflate) ? PayloadCodec::Deflate : PayloadCodec::None;
+}
 
-    if (iv.size() != 12) {
-        qWarning() << "AES-GCM requires a 12-byte IV";
-        return false;
+QString CryptoManager::codecName(PayloadCodec codec)
+{
+    switch (codec) {
+    case PayloadCodec::Deflate:
+        return kCodecDeflate;
+    case PayloadCodec::Zstd:
+        return kCodecZstd;
+    case PayloadCodec::None:
+        break;
+    }
+    return QStringLiteral("none");
+}
+
+void CryptoManager::setPreferredCipher(AeadCipher cipher)
+{
+    g_preferredCipher.store(int(cipher), std::memory_order_relaxed);
+}
+
+void CryptoManager::clearPreferredCipher()
+{
+    g_preferredCipher.store(-1, std::memory_order_relaxed);
+}
+
+AeadCipher CryptoManager::preferredCipher()
+{
+    const int preferred = g_preferredCipher.load(std::memory_order_relaxed);
+    if (preferred >= 0) {
+        return AeadCipher(preferred);
     }
+    return AeadContext::hasAesAcceleration() ? AeadCipher::Aes256Gcm : AeadCipher::ChaCha20Poly1305;
+}
 
-    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
-    if (!ctx) {
-        qWarning() << "Failed to create cipher context:" << getOpenSSLErrorString();
-        return false;
+QStringList CryptoManager::supportedCiphers()
+{
+    if (preferredCipher() == AeadCipher::ChaCha20Poly1305) {
+        return {kCipherChaCha, kCipherAesGcm};
     }
+    return {kCipherAesGcm, kCipherChaCha};
+}
 
-    // Initialize encryption context
-    if (EVP_EncryptInit_ex(ctx, EVP_aes_256_gcm(), nullptr, nullptr, nullptr) != 1) {
-        qWarning() << "Failed to initialize AES-GCM encryption:" << getOpenSSLErrorString();
-        EVP_CIPHER_CTX_free(ctx);
-        return false;
+AeadCipher CryptoManager::negotiateCipher(const QStringList &peerCiphers)
+{
+    // Peers that list nothing predate negotiation and only speak AES-GCM
+    if (!peerCiphers.contains(kCipherChaCha)) {
+        return AeadCipher::Aes256Gcm;
+    }
+    // Software AES is several times slower than ChaCha20 while hardware AES
+    // is only slightly faster, so one slow side decides
+    if (peerCiphers.first() == kCipherChaCha || preferredCipher() == AeadCipher::ChaCha20Poly1305) {
+        return AeadCipher::ChaCha20Poly1305;
     }
+    return AeadCipher::Aes256Gcm;
+}
 
-    // Set IV length for GCM
-    if (EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_IVLEN, iv.size(), nullptr) != 1) {
-        qWarning() << "Failed to set IV length:" << getOpenSSLErrorString();
-        EVP_CIPHER_CTX_free(ctx);
-        return false;
+QString CryptoManager::cipherName(AeadCipher cipher)
+{
+    return cipher == AeadCipher::ChaCha20Poly1305 ? QString(kCipherChaCha) : QString(kCipherAesGcm);
+}
+
+bool CryptoManager::cipherFromName(const QString &name, AeadCipher &cipher)
+{
+    if (name == kCipherAesGcm) {
+        cipher = AeadCipher::Aes256Gcm;
+        return true;
+    }
+    if (name == kCipherChaCha) {
+        cipher = AeadCipher::ChaCha20Poly1305;
+        return true;
     }
+    return false;
+}
 
-    // Initialize key and IV
-    if (EVP_EncryptInit_ex(ctx, nullptr, nullptr,
-                          reinterpret_cast<const unsigned char*>(key.data()),
-                          reinterpret_cast<const unsigned char*>(iv.data())) != 1) {
-        qWarning() << "Failed to set key and IV:" << getOpenSSLErrorString();
-        EVP_CIPHER_CTX_free(ctx);
-        return false;
+QByteArray CryptoManager::compress(const QByteArray &data, PayloadCodec codec, int level)
+{
+    switch (codec) {
+    case PayloadCodec::Deflate:
+        // qCompress prefixes the big-endian uncompressed size
+        return qCompress(data, qBound(-1, level, 9));
+    case PayloadCodec::Zstd: {
+#ifdef CHATAPP_WITH_ZSTD
+        QByteArray out(int(ZSTD_compressBound(size_t(data.size()))), Qt::Uninitialized);
+        const size_t written = ZSTD_compress(out.data(), size_t(out.size()),
+                                             data.constData(), size_t(data.size()),
+                                             level < 0 ? ZSTD_CLEVEL_DEFAULT : level);
+        if (ZSTD_isError(written)) {
+            qWarning() << "zstd compression failed:" << ZSTD_getErrorName(written);
+            return QByteArray();
+        }
+        out.resize(int(written));
+        return out;
+#else
+        return QByteArray();
+#endif
     }
+    case PayloadCodec::None:
+        break;
+    }
+    return QByteArray();
+}
 
-    // Prepare output buffer
-    ciphertext.resize(plaintext.size());
-    int outlen = 0;
-
-    // Encrypt the plaintext
-    if (EVP_EncryptUpdate(ctx,
-                         reinterpret_cast<unsigned char*>(ciphertext.data()),
-                         &outlen,
-                         reinterpret_cast<const unsigned char*>(plaintext.data()),
-                         plaintext.size()) != 1) {
-        qWarning() << "Failed to encrypt data:" << getOpenSSLErrorString();
-        EVP_CIPHER_CTX_free(ctx);
+bool CryptoManager::decompress(const QByteArray &data, PayloadCodec codec, QByteArray &out)
+{
+    switch (codec) {
+    case PayloadCodec::Deflate: {
+        if (data.size() < 4) {
+            return false;
+        }
+        const quint32 expected = qFromBigEndian<quint32>(data.constData());
+        if (expected > kMaxDecompressedSize) {
+            qWarning() << "Compressed payload claims" << expected << "bytes, refusing";
+            return false;
+        }
+        out = qUncompress(data);
+        return !out.isEmpty() || expected == 0;
+    }
+    case PayloadCodec::Zstd: {
+#ifdef CHATAPP_WITH_ZSTD
+        const unsigned long long expected = ZSTD_getFrameContentSize(data.constData(), size_t(data.size()));
+        if (expected == ZSTD_CONTENTSIZE_ERROR || expected == ZSTD_CONTENTSIZE_UNKNOWN
+            || expected > quint64(kMaxDecompressedSize)) {
+            return false;
+        }
+        out.resize(qsizetype(expected));
+        const size_t written = ZSTD_decompress(out.data(), size_t(out.size()),
+                                               data.constData(), size_t(data.size()));
+        if (ZSTD_isError(written) || written != expected) {
+            out.clear();
+            return false;
+        }
+        return true;
+#else
+        qWarning() << "Received zstd payload but zstd support is not built in";
         return false;
+#endif
     }
+    case PayloadCodec::None:
+        out = data;
+        return true;
+    }
+    return false;
+}
 
-    int total_len = outlen;
-
-    // Finalize encryption
-    if (EVP_EncryptFinal_ex(ctx, reinterpret_cast<unsigned char*>(ciphertext.data()) + total_len, &outlen) != 1) {
-        qWarning() << "Failed to finalize encryption:" << getOpenSSLErrorString();
-        EVP_CIPHER_CTX_free(ctx);
+bool CryptoManager::encryptFile(const QString &sourcePath, const QString &destinationPath,
+                                const QByteArray &key, int segmentSize)
+{
+    QFile source(sourcePath);
+    if (!source.open(QIODevice::ReadOnly)) {
+        qWarning() << "Cannot open" << sourcePath << ":" << source.errorString();
+        return false;
+    }
+    QSaveFile destination(destinationPath);
+    if (!destination.open(QIODevice::WriteOnly)) {
+        qWarning() << "Cannot create" << destinationPath << ":" << destination.errorString();
         return false;
     }
-    total_len += outlen;
 
-    // Get the authentication tag
-    tag.resize(16); // AES-GCM tag is always 16 bytes
-    if (EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, 16,
-                           reinterpret_cast<unsigned char*>(tag.data())) != 1) {
-        qWarning() << "Failed to get authentication tag:" << getOpenSSLErrorString();
-        EVP_CIPHER_CTX_free(ctx);
+    ChunkedStream stream;
+    if (!stream.create(key.isEmpty() ? sharedKey() : key, preferredCipher(), segmentSize)
+        || destination.write(stream.header()) != ChunkedStream::HeaderSize) {
+        qWarning() << "Failed to start file encryption";
         return false;
     }
 
-    // Resize ciphertext to actual size
-    ciphertext.resize(total_len);
+    // One buffer for the whole file: plaintext is sealed in place and the
+    // tag lands right behind it, so each segment is a single write
+    QByteArray buffer(stream.sealedChunkSize(), Qt::Uninitialized);
+    for (quint32 index = 0;; ++index) {
+        const qint64 length = readFully(source, buffer.data(), segmentSize);
+        if (length < 0) {
+            qWarning() << "Read failed:" << source.errorString();
+            return false;
+        }
+        const bool last = length < segmentSize || source.atEnd();
+        if (!stream.sealChunk(index, last, buffer.data(), length)) {
+            return false;
+        }
+        const qint64 sealed = length + AeadContext::TagSize;
+        if (destination.write(buffer.constData(), sealed) != sealed) {
+            qWarning() << "Write failed:" << destination.errorString();
+            return false;
+        }
+        if (last) {
+            break;
+        }
+        if (index == std::numeric_limits<quint32>::max()) {
+            qWarning() << "File too large for" << segmentSize << "byte segments";
+            return false;
+        }
+    }
 
-    EVP_CIPHER_CTX_free(ctx);
-    return true;
+    return destination.commit();
 }
 
-bool CryptoManager::decryptAESGCM256(const QByteArray &ciphertext,
-                                   const QByteArray &key,
-                                   const QByteArray &iv,
-                                   const QByteArray &tag,
-                                   QByteArray &plaintext)
+bool CryptoManager::decryptFile(const QString &sourcePath, const QString &destinationPath,
+                                const QByteArray &key)
 {
-    if (key.size() != 32) {
-        qWarning() << "AES-GCM-256 requires a 32-byte key";
+    QFile source(sourcePath);
+    if (!source.open(QIODevice::ReadOnly)) {
+        qWarning() << "Cannot open" << sourcePath << ":" << source.errorString();
         return false;
     }
 
-    if (iv.size() != 12) {
-        qWarning() << "AES-GCM requires a 12-byte IV";
+    ChunkedStream stream;
+    if (!stream.open(key.isEmpty() ? sharedKey() : key, source.read(ChunkedStream::HeaderSize))) {
+        qWarning() << sourcePath << "is not an encrypted file";
         return false;
     }
 
-    if (tag.size() != 16) {
-        qWarning() << "AES-GCM requires a 16-byte authentication tag";
+    QSaveFile destination(destinationPath);
+    if (!destination.open(QIODevice::WriteOnly)) {
+        qWarning() << "Cannot create" << destinationPath << ":" << destination.errorString();
         return false;
     }
 
-    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
-    if (!ctx) {
-        qWarning() << "Failed to create cipher context:" << getOpenSSLErrorString();
-        return false;
+    const qint64 sealedSegment = stream.sealedChunkSize();
+    QByteArray buffer(sealedSegment, Qt::Uninitialized);
+    for (quint32 index = 0;; ++index) {
+        const qint64 sealed = readFully(source, buffer.data(), sealedSegment);
+        if (sealed < AeadContext::TagSize) {
+            qWarning() << sourcePath << "is truncated";
+            return false;
+        }
+        // A short segment or the end of the file marks the final segment;
+        // if that is not what the writer sealed, authentication fails
+        const bool last = sealed < sealedSegment || source.atEnd();
+        if (!stream.openChunk(index, last, buffer.data(), sealed)) {
+            qWarning() << "Cannot decrypt" << sourcePath;
+            return false;
+        }
+        const qint64 length = sealed - AeadContext::TagSize;
+        if (destination.write(buffer.constData(), length) != length) {
+            qWarning() << "Write failed:" << destination.errorString();
+            return false;
+        }
+        if (last) {
+            break;
+        }
     }
 
-    // Initialize decryption context
-    if (EVP_DecryptInit_ex(ctx, EVP_aes_256_gcm(), nullptr, nullptr, nullptr) != 1) {
-        qWarning() << "Failed to initialize AES-GCM decryption:" << getOpenSSLErrorString();
-        EVP_CIPHER_CTX_free(ctx);
+    return destination.commit();
+}
+
+bool CryptoManager::deriveKey(const QByteArray &secret, const QByteArray &salt,
+                              const QByteArray &info, QByteArray &key)
+{
+    key.resize(AeadContext::KeySize);
+    size_t keyLength = size_t(key.size());
+
+    EVP_PKEY_CTX *pctx = EVP_PKEY_CTX_new_id(EVP_PKEY_HKDF, nullptr);
+    const bool ok = pctx
+        && EVP_PKEY_derive_init(pctx) > 0
+        && EVP_PKEY_CTX_set_hkdf_md(pctx, EVP_sha256()) > 0
+        && EVP_PKEY_CTX_set1_hkdf_salt(pctx, bytes(salt.constData()), salt.size()) > 0
+        && EVP_PKEY_CTX_set1_hkdf_key(pctx, bytes(secret.constData()), secret.size()) > 0
+        && EVP_PKEY_CTX_add1_hkdf_info(pctx, bytes(info.constData()), info.size()) > 0
+        && EVP_PKEY_derive(pctx, bytes(key.data()), &keyLength) > 0
+        && keyLength == size_t(AeadContext::KeySize);
+    EVP_PKEY_CTX_free(pctx);
+    if (!ok) {
+        qWarning() << "Key derivation failed:" << getOpenSSLErrorString();
+        key.clear();
+    }
+    return ok;
+}
+
+bool CryptoManager::encryptAESGCM256(const QByteArray &plaintext,
+                                   const QByteArray &key,
+                                   QByteArray &ciphertext,
+                                   QByteArray &iv,
+                                   QByteArray &tag,
+                                   const QByteArray &aad)
+{
+    if (iv.size() != AeadContext::IvSize) {
+        qWarning() << "AES-GCM requires a 12-byte IV";
         return false;
     }
 
-    // Set IV length for GCM
-    if (EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_IVLEN, iv.size(), nullptr) != 1) {
-        qWarning() << "Failed to set IV length:" << getOpenSSLErrorString();
-        EVP_CIPHER_CTX_free(ctx);
+    // The thread's context keeps the key schedule; only the IV is reset
+    AeadContext &ctx = AeadContext::forThread(AeadContext::Direction::Encrypt);
+    if (!ctx.setKey(key)) {
         return false;
     }
 
-    // Initialize key and IV
-    if (EVP_DecryptInit_ex(ctx, nullptr, nullptr,
-                          reinterpret_cast<const unsigned char*>(key.data()),
-                          reinterpret_cast<const unsigned char*>(iv.data())) != 1) {
-        qWarning() << "Failed to set key and IV:" << getOpenSSLErrorString();
-        EVP_CIPHER_CTX_free(ctx);
+    ciphertext.resize(plaintext.size());
+    tag.resize(AeadContext::TagSize);
+    return ctx.seal(reinterpret_cast<const unsigned char*>(iv.constData()),
+                    reinterpret_cast<const unsigned char*>(aad.constData()), aad.size(),
+                    reinterpret_cast<const unsigned char*>(plaintext.constData()), plaintext.size(),
+                    reinterpret_cast<unsigned char*>(ciphertext.data()),
+                    reinterpret_cast<unsigned char*>(tag.data()));
+}
+
+bool CryptoManager::decryptAESGCM256(const QByteArray &ciphertext,
+                                   const QByteArray &key,
+                                   const QByteArray &iv,
+                                   const QByteArray &tag,
+                                   QByteArray &plaintext,
+                                   const QByteArray &aad)
+{
+    if (iv.size() != AeadContext::IvSize) {
+        qWarning() << "AES-GCM requires a 12-byte IV";
         return false;
     }
 
-    // Prepare output buffer
-    plaintext.resize(ciphertext.size());
-    int outlen = 0;
-
-    // Decrypt the ciphertext
-    if (EVP_DecryptUpdate(ctx,
-                         reinterpret_cast<unsigned char*>(plaintext.data()),
-                         &outlen,
-                         reinterpret_cast<const unsigned char*>(ciphertext.data()),
-                         ciphertext.size()) != 1) {
-        qWarning() << "Failed to decrypt data:" << getOpenSSLErrorString();
-        EVP_CIPHER_CTX_free(ctx);
+    if (tag.size() != AeadContext::TagSize) {
+        qWarning() << "AES-GCM requires a 16-byte authentication tag";
         return false;
     }
 
-    int total_len = outlen;
-
-    // Set the expected authentication tag
-    if (EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, tag.size(),
-                           reinterpret_cast<unsigned char*>(const_cast<QByteArray&>(tag).data())) != 1) {
-        qWarning() << "Failed to set authentication tag:" << getOpenSSLErrorString();
-        EVP_CIPHER_CTX_free(ctx);
+    AeadContext &ctx = AeadContext::forThread(AeadContext::Direction::Decrypt);
+    if (!ctx.setKey(key)) {
         return false;
     }
 
-    // Finalize decryption and verify authentication tag
-    int ret = EVP_DecryptFinal_ex(ctx, reinterpret_cast<unsigned char*>(plaintext.data()) + total_len, &outlen);
-
-    if (ret > 0) {
-        total_len += outlen;
-        plaintext.resize(total_len);
-        EVP_CIPHER_CTX_free(ctx);
-        return true;
-    } else {
+    plaintext.resize(ciphertext.size());
+    if (!ctx.open(reinterpret_cast<const unsigned char*>(iv.constData()),
+                  reinterpret_cast<const unsigned char*>(aad.constData()), aad.size(),
+                  reinterpret_cast<const unsigned char*>(ciphertext.constData()), ciphertext.size(),
+                  reinterpret_cast<const unsigned char*>(tag.constData()),
+                  reinterpret_cast<unsigned char*>(plaintext.data()))) {
         // Authentication failed
         qWarning() << "Authentication failed - data may be corrupted or tampered with";
-        EVP_CIPHER_CTX_free(ctx);
+        plaintext.clear();
         return false;
     }
+    return true;
 }
 
 QByteArray CryptoManager::generateAES256Key()
@@ -371,58 +888,3 @@ QString CryptoManager::getOpenSSLErrorString()
     ERR_error_string_n(ERR_get_error(), buffer, sizeof(buffer));
     return QString(buffer);
 }
-
-QByteArray CryptoManager::serializeMetadata(const QVector<ChunkMetadata> &metadataList)
-{
-    QByteArray result;
-    QDataStream stream(&result, QIODevice::WriteOnly);
-    stream.setVersion(QDataStream::Qt_5_15);
-
-    // Write number of chunks
-    stream << static_cast<qint32>(metadataList.size());
-
-    // Write each chunk's metadata
-    for (const ChunkMetadata &meta : metadataList) {
-        stream << meta.iv;
-        stream << meta.tag;
-        stream << meta.chunkIndex;
-        stream << meta.originalSize;
-        stream << meta.encryptedSize;
-    }
-
-    return result;
-}
-
-QVector<ChunkMetadata> CryptoManager::deserializeMetadata(const QByteArray &data)
-{
-    QVector<ChunkMetadata> result;
-    QDataStream stream(data);
-    stream.setVersion(QDataStream::Qt_5_15);
-
-    qint32 count = 0;
-    stream >> count;
-
-    if (count < 0 || count > 100000) { // Sanity check
-        qWarning() << "Invalid chunk count in metadata:" << count;
-        return result;
-    }
-
-    result.reserve(count);
-
-    for (qint32 i = 0; i < count; i++) {
-        ChunkMetadata meta;
-        stream >> meta.iv;
-        stream >> meta.tag;
-        stream >> meta.chunkIndex;
-        stream >> meta.originalSize;
-        stream >> meta.encryptedSize;
-
-        if (stream.status() != QDataStream::Ok) {
-            return QVector<ChunkMetadata>();
-        }
-
-        result.append(meta);
-    }
-
-    return result;
-}
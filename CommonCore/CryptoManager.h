@@ -6,17 +6,29 @@
 #include <openssl/rand.h>
 #include <QObject>
 #include <QByteArray>
+#include <QByteArrayView>
 #include <QString>
 #include <QFile>
 #include <QVector>
+#include <QStringList>
+#include "AeadContext.h"
 
-// Structure to hold chunk encryption metadata
-struct ChunkMetadata {
-    QByteArray iv;    // 12 bytes for GCM
-    QByteArray tag;   // 16 bytes for GCM authentication tag
-    qint64 chunkIndex; // Sequential chunk number
-    qint64 originalSize; // Size before encryption
-    qint64 encryptedSize; // Size after encryption
+class MessageSession;
+
+// Optional compression applied to message payloads before encryption.
+// Ciphertext is incompressible, so this is the only place it can help.
+enum class PayloadCodec : quint8 {
+    None = 0,
+    Deflate = 1,   // zlib via qCompress, always available
+    Zstd = 2       // Only when built with CHATAPP_WITH_ZSTD
+};
+
+// The codec is what this side prefers to send; each connection compresses
+// with the one negotiated against what its peer can inflate.
+struct CompressionPolicy {
+    PayloadCodec codec = PayloadCodec::Deflate;
+    int threshold = 512;   // Payloads smaller than this are sent as-is, 0-65535
+    int level = -1;        // Codec default, otherwise up to 22
 };
 
 class CryptoManager : public QObject
@@ -31,32 +43,94 @@ public:
     static QString encryptMessage(const QString &message);
     static QString decryptMessage(const QString &encryptedData);
 
-    static QFile encryptFile(const QFile &file);
-    static QFile decryptFile(const QFile &file);
+    // Binary envelope without the base64 layer (binary wire mode):
+    //   version(1) | flags(1) | IV(12) | tag(16) | ciphertext
+    // The two header bytes are authenticated as AAD. Flag bits 0-1 name the
+    // codec the plaintext was compressed with, bits 2-3 the AEAD cipher.
+    // Payloads from the policy threshold up are compressed with codec.
+    // Only send this envelope, a cipher other than AES-GCM or a codec to a
+    // peer that negotiated them.
+    static QByteArray encryptPayload(const QByteArray &plaintext,
+                                     AeadCipher cipher = AeadCipher::Aes256Gcm,
+                                     PayloadCodec codec = PayloadCodec::None);
+
+    // Legacy IV(12) | tag(16) | ciphertext, AES-GCM and never compressed:
+    // the only format peers from before the version byte can decrypt
+    static QByteArray encryptLegacyPayload(const QByteArray &plaintext);
+
+    // Counter-nonce envelope for a connection with a negotiated session:
+    //   version(1) | flags(1) | counter(8) | tag(16) | ciphertext
+    // No RNG call per message and four bytes smaller than the IV envelope.
+    static QByteArray encryptPayload(const QByteArray &plaintext, MessageSession &session,
+                                     PayloadCodec codec = PayloadCodec::None);
+
+    // Without an active receiving session, accepts the IV and legacy
+    // envelopes. Once the session is active only its envelopes are accepted,
+    // and each must carry a counter above the last accepted one; replayed or
+    // reordered frames are dropped, as is anything under the shared key.
+    static QByteArray decryptPayload(const QByteArray &envelope, MessageSession *session = nullptr);
 
-    // Chunk-based encryption for streaming (TUS uploads)
-    static bool encryptChunk(const QByteArray &plainChunk,
-                           const QByteArray &key,
-                           QByteArray &encryptedChunk,
-                           ChunkMetadata &metadata);
+    // Zero-copy decrypt: works inside the envelope's own buffer (inflating
+    // into it if the payload was compressed) and points plaintext at the
+    // result.
+    static bool decryptInPlace(QByteArray &envelope, QByteArrayView &plaintext,
+                               MessageSession *session = nullptr);
 
-    static bool decryptChunk(const QByteArray &encryptedChunk,
-                           const QByteArray &key,
-                           const ChunkMetadata &metadata,
-                           QByteArray &plainChunk);
+    // Process-wide; safe to change while other threads encrypt. A threshold
+    // or level outside the documented range is refused and the current
+    // policy kept; an unavailable codec falls back to deflate.
+    static bool setCompressionPolicy(const CompressionPolicy &policy);
+    static CompressionPolicy compressionPolicy();
+    static bool isCodecAvailable(PayloadCodec codec);
+
+    // Codec negotiation. supportedCodecs() lists the wire names this build
+    // can inflate; negotiateCodec() picks the policy codec if the peer listed
+    // it, deflate if the peer can at least inflate that, and None for peers
+    // that list nothing or when compression is off.
+    static QStringList supportedCodecs();
+    static PayloadCodec negotiateCodec(const QStringList &peerCodecs);
+    static QString codecName(PayloadCodec codec);
+
+    // Cipher negotiation. The local preference is ChaCha20-Poly1305 when the
+    // CPU lacks AES instructions, unless overridden. supportedCiphers() lists
+    // wire names in that order; negotiateCipher() picks ChaCha20 when both
+    // sides support it and either side prefers it, AES-GCM otherwise.
+    static void setPreferredCipher(AeadCipher cipher);
+    static void clearPreferredCipher();
+    static AeadCipher preferredCipher();
+    static QStringList supportedCiphers();
+    static AeadCipher negotiateCipher(const QStringList &peerCiphers);
+    static QString cipherName(AeadCipher cipher);
+    static bool cipherFromName(const QString &name, AeadCipher &cipher);
+
+    // Streaming file encryption at rest with constant memory use, in the
+    // ChunkedStream format with segmentSize chunks. An empty key means the
+    // shared message key; the cipher follows preferredCipher(). Output goes
+    // through QSaveFile, so a failed run never leaves a partial destination.
+    static constexpr int FileSegmentSize = 1024 * 1024;
+    static bool encryptFile(const QString &sourcePath, const QString &destinationPath,
+                            const QByteArray &key = QByteArray(), int segmentSize = FileSegmentSize);
+    static bool decryptFile(const QString &sourcePath, const QString &destinationPath,
+                            const QByteArray &key = QByteArray());
+
+    // HKDF-SHA256 with a 32-byte output
+    static bool deriveKey(const QByteArray &secret, const QByteArray &salt,
+                          const QByteArray &info, QByteArray &key);
 
     // AES-GCM-256 methods (for advanced usage)
     static bool encryptAESGCM256(const QByteArray &plaintext,
                                 const QByteArray &key,
                                 QByteArray &ciphertext,
                                 QByteArray &iv,
-                                QByteArray &tag);
+                                QByteArray &tag,
+                                const QByteArray &aad = QByteArray());
 
     static bool decryptAESGCM256(const QByteArray &ciphertext,
                                 const QByteArray &key,
                                 const QByteArray &iv,
                                 const QByteArray &tag,
-                                QByteArray &plaintext);
+                                QByteArray &plaintext,
+                                const QByteArray &aad = QByteArray());
 
     // Key generation
     static QByteArray generateAES256Key();
@@ -66,13 +140,21 @@ public:
     static QString bytesToHex(const QByteArray &bytes);
     static QByteArray hexToBytes(const QString &hex);
 
-    // Metadata serialization for storage/transmission
-    static QByteArray serializeMetadata(const QVector<ChunkMetadata> &metadataList);
-    static QVector<ChunkMetadata> deserializeMetadata(const QByteArray &data);
-
 private:
     // Helper method for OpenSSL error handling
     static QString getOpenSSLErrorString();
+
+    static QByteArray compress(const QByteArray &data, PayloadCodec codec, int level);
+    static bool decompress(const QByteArray &data, PayloadCodec codec, QByteArray &out);
+    static bool sealEnvelope(QByteArrayView body, PayloadCodec codec, AeadCipher cipher, char *out);
+    static bool openEnvelope(QByteArrayView envelope, char *out, PayloadCodec &codec, AeadCipher &cipher);
+    static bool openSessionEnvelope(QByteArrayView envelope, char *out, MessageSession &session,
+                                    quint64 counter, PayloadCodec &codec);
+    // codec is the negotiated one on entry and the one applied on return
+    static QByteArray compressForPolicy(const QByteArray &plaintext, PayloadCodec &codec);
+    static bool finishInPlace(QByteArray &envelope, char *body, qsizetype bodySize,
+                              PayloadCodec codec, QByteArrayView &plaintext);
+    static bool openLegacyEnvelope(QByteArrayView envelope, char *out);
 };
 
 #endif // CRYPTOMANAGER_H
@@ -0,0 +1,251 @@
+#include "DownloadWriter.h"
+#include <QCoreApplication>
+#include <QDir>
+#include <QFileInfo>
+#include <QThread>
+#include <QTimer>
+#include <cstring>
+
+DownloadWriter::DownloadWriter(QObject *parent)
+    : QObject(parent)
+    , m_decrypt(false)
+    , m_failed(false)
+    , m_headerRead(false)
+    , m_chunkIndex(0)
+    , m_slabFilled(0)
+    , m_writeBuffered(0)
+    , m_flushTimer(new QTimer(this))
+{
+    m_flushTimer->setSingleShot(true);
+    m_flushTimer->setInterval(FlushIntervalMs);
+    connect(m_flushTimer, &QTimer::timeout, this, [this]() {
+        if (!m_failed && !flushWrites()) {
+            fail("Failed to write to file: " + m_file.errorString());
+        }
+    });
+}
+
+DownloadWriter::~DownloadWriter()
+{
+    if (!m_failed && m_file.isOpen()) {
+        flushWrites();
+    }
+    m_file.close();
+}
+
+QThread *DownloadWriter::ioThread()
+{
+    static QThread *thread = []() {
+        auto *io = new QThread;
+        io->setObjectName(QStringLiteral("download-io"));
+        io->start();
+        // Stopped from the main thread; a thread cannot wait for itself
+        QObject::connect(qApp, &QCoreApplication::aboutToQuit, qApp, [io]() {
+            io->quit();
+            io->wait();
+        });
+        return io;
+    }();
+    return thread;
+}
+
+void DownloadWriter::open(const QString &path, bool decrypt, const QByteArray &key, const QByteArray &header)
+{
+    m_decrypt = decrypt;
+    m_key = key;
+
+    // A header handed over with the download must match the stream's own
+    if (m_decrypt && !header.isEmpty() && !m_stream.open(m_key, header)) {
+        fail("Invalid encryption header");
+        return;
+    }
+
+    // Create directory if it doesn't exist
+    QDir dir = QFileInfo(path).absoluteDir();
+    if (!dir.exists()) {
+        dir.mkpath(".");
+    }
+
+    // Unbuffered: the write buffer below is the only copy of small writes
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Unbuffered)) {
+        fail("Failed to create file: " + m_file.errorString());
+        return;
+    }
+    m_writeBuffer.resize(WriteBufferSize);
+    m_sinceFlush.start();
+}
+
+void DownloadWriter::append(QByteArray data)
+{
+    const qint64 size = data.size();
+    if (!m_failed && size > 0) {
+        m_stats.bytesReceived += size;
+        if (!m_decrypt) {
+            if (!writeOut(data.constData(), size)) {
+                fail("Failed to write to file: " + m_file.errorString());
+            }
+        } else {
+            feed(data.data(), size);
+        }
+    }
+    emit consumed(size);
+}
+
+void DownloadWriter::finish()
+{
+    if (m_failed) {
+        return;
+    }
+
+    // Whatever is in the slab is the final chunk; a stream cut short at a
+    // chunk boundary fails here because that chunk was not sealed as the last
+    if (m_decrypt) {
+        if (!m_headerRead) {
+            fail("Encrypted download is truncated");
+            return;
+        }
+        if (!openChunk(m_slab.data(), m_slabFilled, true)) {
+            return;
+        }
+        m_stats.chunksFromSlab++;
+        m_slabFilled = 0;
+    }
+
+    if (!flushWrites()) {
+        fail("Failed to write to file: " + m_file.errorString());
+        return;
+    }
+    m_file.close();
+    emit finished();
+}
+
+void DownloadWriter::abort()
+{
+    m_failed = true;
+    m_flushTimer->stop();
+    if (m_file.isOpen()) {
+        m_file.close();
+        // Remove incomplete file
+        m_file.remove();
+    }
+    m_writeBuffered = 0;
+    m_slabFilled = 0;
+}
+
+bool DownloadWriter::feed(char *data, qsizetype size)
+{
+    qsizetype pos = 0;
+    if (!m_headerRead) {
+        const qsizetype take = qMin(size, qsizetype(ChunkedStream::HeaderSize) - m_header.size());
+        m_header.append(data, take);
+        pos = take;
+        if (m_header.size() < ChunkedStream::HeaderSize) {
+            return true;
+        }
+        const bool ok = m_stream.isValid() ? m_header == m_stream.header()
+                                           : m_stream.open(m_key, m_header);
+        if (!ok) {
+            fail("Invalid encryption header");
+            return false;
+        }
+        m_headerRead = true;
+        m_slab.resize(m_stream.sealedChunkSize());
+    }
+
+    // A full chunk is only known not to be the last once more data follows
+    // it, so the final sealed chunk's worth of input always waits in the slab
+    const qsizetype sealed = m_stream.sealedChunkSize();
+    while (pos < size) {
+        if (m_slabFilled == sealed) {
+            if (!openChunk(m_slab.data(), sealed, false)) {
+                return false;
+            }
+            m_stats.chunksFromSlab++;
+            m_slabFilled = 0;
+            continue;
+        }
+        if (m_slabFilled == 0 && size - pos > sealed) {
+            if (!openChunk(data + pos, sealed, false)) {
+                return false;
+            }
+            m_stats.chunksInPlace++;
+            pos += sealed;
+            continue;
+        }
+
+        const qsizetype take = qMin(size - pos, sealed - m_slabFilled);
+        memcpy(m_slab.data() + m_slabFilled, data + pos, take);
+        m_slabFilled += take;
+        pos += take;
+        m_stats.bytesCopied += take;
+        m_stats.peakBuffered = qMax<qint64>(m_stats.peakBuffered, m_slabFilled + m_writeBuffered);
+    }
+    return true;
+}
+
+bool DownloadWriter::openChunk(char *chunk, qsizetype length, bool last)
+{
+    if (!m_stream.openChunk(quint32(m_chunkIndex), last, chunk, length)) {
+        fail(QString("Failed to decrypt chunk %1").arg(m_chunkIndex));
+        return false;
+    }
+    if (!writeOut(chunk, length - AeadContext::TagSize)) {
+        fail("Failed to write decrypted data to file");
+        return false;
+    }
+    m_chunkIndex++;
+    return true;
+}
+
+bool DownloadWriter::writeOut(const char *data, qint64 size)
+{
+    if (m_writeBuffered + size > WriteBufferSize && !flushWrites()) {
+        return false;
+    }
+    // Whole decrypted chunks skip the buffer
+    if (size >= WriteBufferSize) {
+        return writeFully(data, size);
+    }
+
+    memcpy(m_writeBuffer.data() + m_writeBuffered, data, size);
+    m_writeBuffered += size;
+    m_stats.bytesCopied += size;
+    m_stats.peakBuffered = qMax<qint64>(m_stats.peakBuffered, m_slabFilled + m_writeBuffered);
+
+    if (m_sinceFlush.hasExpired(FlushIntervalMs)) {
+        return flushWrites();
+    }
+    if (!m_flushTimer->isActive()) {
+        m_flushTimer->start();
+    }
+    return true;
+}
+
+bool DownloadWriter::writeFully(const char *data, qint64 size)
+{
+    while (size > 0) {
+        const qint64 written = m_file.write(data, size);
+        if (written <= 0) {
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+bool DownloadWriter::flushWrites()
+{
+    m_flushTimer->stop();
+    m_sinceFlush.restart();
+    const qsizetype pending = m_writeBuffered;
+    m_writeBuffered = 0;
+    return writeFully(m_writeBuffer.constData(), pending);
+}
+
+void DownloadWriter::fail(const QString &message)
+{
+    abort();
+    emit failed(message);
+}
@@ -0,0 +1,87 @@
+#ifndef DOWNLOADWRITER_H
+#define DOWNLOADWRITER_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QString>
+#include "ChunkedStream.h"
+
+class QThread;
+class QTimer;
+
+// What a DownloadWriter did with the bytes it was given
+struct DownloadWriterStats {
+    qint64 bytesReceived = 0;
+    qint64 bytesCopied = 0;     // Into the chunk slab or the write buffer
+    qint64 peakBuffered = 0;    // Most bytes held in the slab and write buffer at once
+    qint64 chunksInPlace = 0;   // Decrypted inside the received data
+    qint64 chunksFromSlab = 0;  // Straddled two reads, reassembled first
+};
+
+// Disk side of a TusDownloader. Lives on a shared I/O thread, decrypts the
+// ChunkedStream when there is one and writes the file, so neither decryption
+// nor disk writes run on the GUI thread. Driven by queued calls in order;
+// reports back through queued signals.
+//
+// Memory is fixed per download: a chunk that arrives whole inside one read
+// is decrypted where it lies; only chunks split across reads are copied, into
+// a slab of one sealed chunk. Plaintext smaller than the write buffer is
+// gathered and flushed when the buffer fills or FlushIntervalMs passes.
+class DownloadWriter : public QObject
+{
+    Q_OBJECT
+
+public:
+    static constexpr int WriteBufferSize = 1024 * 1024;
+    static constexpr int FlushIntervalMs = 250;
+
+    explicit DownloadWriter(QObject *parent = nullptr);
+    ~DownloadWriter();
+
+    // The thread all writers live on, started on first use
+    static QThread *ioThread();
+
+    void open(const QString &path, bool decrypt, const QByteArray &key, const QByteArray &header);
+    // Decrypts in place inside data when nothing else shares it
+    void append(QByteArray data);
+    // Nothing follows: the buffered tail is the final chunk
+    void finish();
+    // Drops the partial file
+    void abort();
+
+    const DownloadWriterStats &stats() const { return m_stats; }
+
+signals:
+    // Bytes from append() that have been processed, freeing queue space
+    void consumed(qint64 bytes);
+    void finished();
+    void failed(const QString &message);
+
+private:
+    bool feed(char *data, qsizetype size);
+    bool openChunk(char *chunk, qsizetype length, bool last);
+    bool writeOut(const char *data, qint64 size);
+    bool writeFully(const char *data, qint64 size);
+    bool flushWrites();
+    void fail(const QString &message);
+
+    QFile m_file;
+    bool m_decrypt;
+    bool m_failed;
+    QByteArray m_key;
+    ChunkedStream m_stream;
+    QByteArray m_header;      // Until HeaderSize bytes have arrived
+    bool m_headerRead;
+    qint64 m_chunkIndex;
+    QByteArray m_slab;        // One sealed chunk, allocated once
+    qsizetype m_slabFilled;
+    QByteArray m_writeBuffer; // WriteBufferSize, allocated once
+    qsizetype m_writeBuffered;
+    QElapsedTimer m_sinceFlush;
+    QTimer *m_flushTimer;     // Flushes a partly filled buffer when data stalls
+    DownloadWriterStats m_stats;
+};
+
+#endif // DOWNLOADWRITER_H
@@ -0,0 +1,91 @@
+#include "MessageSession.h"
+#include "CryptoManager.h"
+#include <QDebug>
+#include <QtEndian>
+#include <openssl/rand.h>
+
+MessageSession::MessageSession()
+    : m_cipher(AeadCipher::Aes256Gcm)
+    , m_stream(0)
+    , m_nextCounter(1)
+    , m_lastAccepted(0)
+{
+}
+
+MessageSession::~MessageSession() = default;
+
+QByteArray MessageSession::generateSalt()
+{
+    QByteArray salt(SaltSize, Qt::Uninitialized);
+    if (RAND_bytes(reinterpret_cast<unsigned char*>(salt.data()), salt.size()) != 1) {
+        qWarning() << "Failed to generate session salt";
+        return QByteArray();
+    }
+    return salt;
+}
+
+bool MessageSession::start(const QByteArray &salt, quint32 stream, AeadCipher cipher,
+                           AeadContext::Direction direction)
+{
+    reset();
+    if (salt.size() != SaltSize) {
+        qWarning() << "Session salt must be" << SaltSize << "bytes";
+        return false;
+    }
+
+    // Separate keys per cipher so one key never serves two algorithms
+    QByteArray info("chatapp message stream ");
+    info.append(CryptoManager::cipherName(cipher).toLatin1());
+    info.append(' ');
+    info.append(QByteArray::number(stream));
+
+    QByteArray key;
+    if (!CryptoManager::deriveKey(CryptoManager::generateAES256Key(), salt, info, key)) {
+        qWarning() << "Failed to derive session key";
+        return false;
+    }
+
+    // Owned rather than per-thread: a shard serves many sessions and would
+    // otherwise re-expand a key schedule on every switch
+    auto context = std::make_unique<AeadContext>(direction, cipher);
+    if (!context->setKey(key)) {
+        return false;
+    }
+    m_context = std::move(context);
+    m_cipher = cipher;
+    m_stream = stream;
+    return true;
+}
+
+void MessageSession::reset()
+{
+    m_context.reset();
+    m_nextCounter = 1;
+    m_lastAccepted = 0;
+}
+
+bool MessageSession::nextNonce(quint64 &counter, unsigned char *nonce)
+{
+    if (!isActive() || m_nextCounter == 0) {
+        return false;   // Not started, or 2^64 frames later
+    }
+    counter = m_nextCounter++;
+    nonceFor(counter, nonce);
+    return true;
+}
+
+void MessageSession::nonceFor(quint64 counter, unsigned char *nonce) const
+{
+    qToBigEndian<quint32>(m_stream, nonce);
+    qToBigEndian<quint64>(counter, nonce + 4);
+}
+
+bool MessageSession::isFresh(quint64 counter) const
+{
+    return counter > m_lastAccepted;
+}
+
+void MessageSession::accept(quint64 counter)
+{
+    m_lastAccepted = counter;
+}
@@ -0,0 +1,59 @@
+#ifndef MESSAGESESSION_H
+#define MESSAGESESSION_H
+
+#include <QByteArray>
+#include <memory>
+#include "AeadContext.h"
+
+// One direction of a connection that negotiated counter nonces. The sender
+// picks a random salt at session start and announces it; both ends derive a
+// stream key from the shared secret and that salt (HKDF-SHA256), and each
+// frame's nonce is the stream id followed by a 64-bit counter. No RNG call
+// per message, and only the counter travels in the envelope.
+//
+// A receiving session accepts each counter once and only in increasing
+// order, which rejects replayed and reordered frames. Gaps are fine: queued
+// frames may be shed before they are written.
+//
+// Not thread-safe; owned by whatever thread runs the connection.
+class MessageSession
+{
+public:
+    static constexpr int SaltSize = 16;
+
+    MessageSession();
+    ~MessageSession();
+
+    MessageSession(const MessageSession&) = delete;
+    MessageSession& operator=(const MessageSession&) = delete;
+
+    static QByteArray generateSalt();
+
+    // Derives the stream key; the counter restarts. Encrypt for the sending
+    // end, Decrypt for the receiving one.
+    bool start(const QByteArray &salt, quint32 stream, AeadCipher cipher,
+               AeadContext::Direction direction);
+    void reset();
+
+    bool isActive() const { return m_context != nullptr; }
+    AeadCipher cipher() const { return m_cipher; }
+
+    // Sender: reserves the next counter and writes its nonce
+    bool nextNonce(quint64 &counter, unsigned char *nonce);
+    // Receiver: writes the nonce for a counter read from an envelope; call
+    // accept() only once the frame has authenticated
+    void nonceFor(quint64 counter, unsigned char *nonce) const;
+    bool isFresh(quint64 counter) const;
+    void accept(quint64 counter);
+
+    AeadContext &context() { return *m_context; }
+
+private:
+    std::unique_ptr<AeadContext> m_context;
+    AeadCipher m_cipher;
+    quint32 m_stream;
+    quint64 m_nextCounter;   // Sender
+    quint64 m_lastAccepted;  // Receiver; counters start at 1
+};
+
+#endif // MESSAGESESSION_H
@@ -0,0 +1,116 @@
+#include "NetworkIdentity.h"
+#include <QDebug>
+#include <QHostAddress>
+#include <QMutexLocker>
+#include <QNetworkInterface>
+#include <QTimer>
+#include <QtGlobal>
+#if QT_VERSION >= QT_VERSION_CHECK(6, 1, 0)
+#include <QNetworkInformation>
+#endif
+
+NetworkIdentity& NetworkIdentity::instance()
+{
+    static NetworkIdentity _instance;
+    return _instance;
+}
+
+NetworkIdentity::NetworkIdentity(QObject *parent)
+    : QObject(parent)
+    , m_detected(detectHost())
+    , m_recheckTimer(new QTimer(this))
+{
+    watchForChanges();
+}
+
+QString NetworkIdentity::advertisedHost() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_override.isEmpty() ? m_detected : m_override;
+}
+
+QString NetworkIdentity::tusEndpoint() const
+{
+    return QStringLiteral("http://%1:1080/files/").arg(advertisedHost());
+}
+
+void NetworkIdentity::setOverride(const QString &host)
+{
+    QString detected;
+    {
+        QMutexLocker locker(&m_mutex);
+        detected = m_detected;
+    }
+    update(detected, host.trimmed());
+}
+
+QString NetworkIdentity::overrideHost() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_override;
+}
+
+void NetworkIdentity::refresh()
+{
+    QString overrideHost;
+    {
+        QMutexLocker locker(&m_mutex);
+        overrideHost = m_override;
+    }
+    update(detectHost(), overrideHost);
+}
+
+QString NetworkIdentity::detectHost()
+{
+    const QList<QHostAddress> addresses = QNetworkInterface::allAddresses();
+    for (const QHostAddress &address : addresses) {
+        if (address.protocol() == QAbstractSocket::IPv4Protocol && !address.isLoopback()) {
+            return address.toString();
+        }
+    }
+    return QStringLiteral("localhost");
+}
+
+void NetworkIdentity::watchForChanges()
+{
+    // Catches what no notification reports; one interface enumeration a
+    // minute is cheap
+    m_recheckTimer->setInterval(RECHECK_INTERVAL_MS);
+    connect(m_recheckTimer, &QTimer::timeout, this, &NetworkIdentity::refresh);
+    m_recheckTimer->start();
+
+#if QT_VERSION >= QT_VERSION_CHECK(6, 1, 0)
+    // Not every platform has a backend; without one the cache changes only
+    // on the timer, through refresh() or an override
+    if (!QNetworkInformation::load(QNetworkInformation::Feature::Reachability)) {
+        qWarning() << "NetworkIdentity: no network information backend, relying on the periodic re-check";
+        return;
+    }
+    QNetworkInformation *info = QNetworkInformation::instance();
+    connect(info, &QNetworkInformation::reachabilityChanged,
+            this, &NetworkIdentity::refresh);
+#if QT_VERSION >= QT_VERSION_CHECK(6, 3, 0)
+    // Wi-Fi to Ethernet and the like usually brings a new address
+    if (info->supports(QNetworkInformation::Feature::TransportMedium)) {
+        connect(info, &QNetworkInformation::transportMediumChanged,
+                this, &NetworkIdentity::refresh);
+    }
+#endif
+#endif
+}
+
+void NetworkIdentity::update(const QString &detected, const QString &overrideHost)
+{
+    QString before;
+    QString after;
+    {
+        QMutexLocker locker(&m_mutex);
+        before = m_override.isEmpty() ? m_detected : m_override;
+        m_detected = detected;
+        m_override = overrideHost;
+        after = m_override.isEmpty() ? m_detected : m_override;
+    }
+    if (after != before) {
+        emit advertisedHostChanged(after);
+    }
+}
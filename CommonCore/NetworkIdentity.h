@@ -0,0 +1,60 @@
+#ifndef NETWORKIDENTITY_H
+#define NETWORKIDENTITY_H
+
+#include <QObject>
+#include <QMutex>
+#include <QString>
+
+class QTimer;
+
+// The host name peers should use to reach this machine (file links, TUS
+// endpoints). Interfaces are enumerated once and the result is cached; it is
+// re-resolved when Qt reports a reachability or transport medium change, when
+// refresh() is called, and otherwise once a minute. Qt reports no address
+// changes as such, so a DHCP renew or VPN that keeps the same medium can
+// leave the cache stale for up to RECHECK_INTERVAL_MS. An explicit override
+// (e.g. --advertise-host) always wins.
+class NetworkIdentity : public QObject
+{
+    Q_OBJECT
+
+public:
+    // Singleton access. Create it on the main thread so change notifications
+    // are delivered there.
+    static NetworkIdentity& instance();
+
+    // Cached value: the override if set, otherwise the first non-loopback
+    // IPv4 address, otherwise "localhost"
+    QString advertisedHost() const;
+    QString tusEndpoint() const;
+
+    // Empty clears the override and goes back to the detected address
+    void setOverride(const QString &host);
+    QString overrideHost() const;
+
+public slots:
+    // Re-enumerate interfaces now
+    void refresh();
+
+signals:
+    void advertisedHostChanged(const QString &host);
+
+private:
+    explicit NetworkIdentity(QObject *parent = nullptr);
+
+    NetworkIdentity(const NetworkIdentity&) = delete;
+    NetworkIdentity& operator=(const NetworkIdentity&) = delete;
+
+    static QString detectHost();
+    void watchForChanges();
+    void update(const QString &detected, const QString &overrideHost);
+
+    mutable QMutex m_mutex;
+    QString m_detected;
+    QString m_override;
+    QTimer *m_recheckTimer;
+
+    static const int RECHECK_INTERVAL_MS = 60000;
+};
+
+#endif // NETWORKIDENTITY_H
@@ -0,0 +1,338 @@
+#include "TransferScheduler.h"
+#include "TusDownloader.h"
+#include "TusUploader.h"
+#include <QCoreApplication>
+#include <QFileInfo>
+#include <QNetworkAccessManager>
+#include <QStringList>
+#include <QTimer>
+#include <algorithm>
+
+namespace {
+
+bool isTerminal(TransferJob::State state)
+{
+    return state == TransferJob::State::Finished || state == TransferJob::State::Failed
+        || state == TransferJob::State::Cancelled;
+}
+
+}
+
+TransferJob::TransferJob(Kind kind, TransferPriority priority, TransferScheduler *scheduler)
+    : QObject(scheduler),
+    m_kind(kind),
+    m_priority(priority),
+    m_state(State::Queued),
+    m_sequence(0),
+    m_scheduler(scheduler),
+    m_uploader(nullptr),
+    m_downloader(nullptr)
+{
+}
+
+void TransferJob::pause()
+{
+    if (m_state != State::Queued && m_state != State::Running) {
+        return;
+    }
+    if (m_state == State::Running) {
+        pauseTransfer();
+    }
+    setState(State::Paused);
+    m_scheduler->jobChanged(this);
+}
+
+void TransferJob::resume()
+{
+    if (m_state != State::Paused) {
+        return;
+    }
+    setState(State::Queued);
+    m_scheduler->jobChanged(this);
+}
+
+void TransferJob::cancel()
+{
+    if (isTerminal(m_state)) {
+        return;
+    }
+    if (m_uploader) {
+        m_uploader->cancelUpload();
+    }
+    if (m_downloader) {
+        m_downloader->cancelDownload();
+    }
+    setState(State::Cancelled);
+    m_scheduler->jobChanged(this);
+}
+
+void TransferJob::run(QNetworkAccessManager *manager)
+{
+    // Set first: a transfer that cannot start reports failure right away
+    setState(State::Running);
+    m_runningFor.start();
+
+    if (m_kind == Kind::Upload) {
+        if (m_uploader) {
+            m_uploader->resumeUpload();
+            return;
+        }
+        m_uploader = new TusUploader(this, manager);
+        connect(m_uploader, &TusUploader::uploadProgress, this, &TransferJob::progress);
+        connect(m_uploader, &TusUploader::finished, this, &TransferJob::onFinished);
+        connect(m_uploader, &TusUploader::error, this, &TransferJob::onError);
+        m_uploader->startUpload(m_filePath, m_url);
+        return;
+    }
+
+    if (m_downloader) {
+        m_downloader->resumeDownload();
+        return;
+    }
+    m_downloader = new TusDownloader(this, manager);
+    connect(m_downloader, &TusDownloader::downloadProgress, this, &TransferJob::progress);
+    connect(m_downloader, &TusDownloader::finished, this, [this](const QString &filePath) {
+        onFinished(filePath, QFileInfo(filePath).size(), QByteArray());
+    });
+    connect(m_downloader, &TusDownloader::error, this, &TransferJob::onError);
+    m_downloader->startDownload(m_url, m_filePath);
+}
+
+void TransferJob::suspend()
+{
+    if (m_state != State::Running) {
+        return;
+    }
+    pauseTransfer();
+    setState(State::Queued);
+}
+
+void TransferJob::pauseTransfer()
+{
+    if (m_uploader) {
+        m_uploader->pauseUpload();
+    }
+    if (m_downloader) {
+        m_downloader->pauseDownload();
+    }
+}
+
+void TransferJob::setState(State state)
+{
+    if (m_state == state) {
+        return;
+    }
+    m_state = state;
+    emit stateChanged(state);
+}
+
+void TransferJob::onFinished(const QString &result, qint64 fileSize, const QByteArray &encryptionHeader)
+{
+    setState(State::Finished);
+    emit finished(result, fileSize, encryptionHeader);
+    m_scheduler->jobChanged(this);
+}
+
+void TransferJob::onError(const QString &errorMessage)
+{
+    setState(State::Failed);
+    emit error(errorMessage);
+    m_scheduler->jobChanged(this);
+}
+
+TransferScheduler& TransferScheduler::instance()
+{
+    // Owned by the application, so the shared manager and any transfers
+    // still running go before Qt shuts down
+    static TransferScheduler *_instance = new TransferScheduler(QCoreApplication::instance());
+    return *_instance;
+}
+
+TransferScheduler::TransferScheduler(QObject *parent)
+    : QObject(parent),
+    m_nextSequence(0),
+    m_maxActive(DEFAULT_MAX_ACTIVE),
+    m_scheduling(false),
+    m_rescheduled(false)
+{
+    m_manager = new QNetworkAccessManager(this);
+
+    m_rotateTimer = new QTimer(this);
+    m_rotateTimer->setInterval(ROTATE_INTERVAL_MS);
+    connect(m_rotateTimer, &QTimer::timeout, this, &TransferScheduler::rotate);
+}
+
+TransferJob *TransferScheduler::submitUpload(const QString &filePath, const QUrl &endpoint,
+                                             TransferPriority priority)
+{
+    TransferJob *job = new TransferJob(TransferJob::Kind::Upload, priority, this);
+    job->m_filePath = filePath;
+    job->m_url = endpoint;
+    return enqueue(job);
+}
+
+TransferJob *TransferScheduler::submitDownload(const QUrl &url, const QString &savePath,
+                                               TransferPriority priority)
+{
+    TransferJob *job = new TransferJob(TransferJob::Kind::Download, priority, this);
+    job->m_filePath = savePath;
+    job->m_url = url;
+    return enqueue(job);
+}
+
+TransferPriority TransferScheduler::priorityFor(const QString &fileName)
+{
+    static const QStringList imageSuffixes = {
+        "png", "jpg", "jpeg", "gif", "bmp", "webp", "heic", "svg"
+    };
+    const QString suffix = QFileInfo(fileName).suffix().toLower();
+    return imageSuffixes.contains(suffix) ? TransferPriority::Image : TransferPriority::Bulk;
+}
+
+void TransferScheduler::setMaxActive(int count)
+{
+    m_maxActive = qMax(1, count);
+    schedule();
+}
+
+TransferJob *TransferScheduler::enqueue(TransferJob *job)
+{
+    job->m_sequence = m_nextSequence++;
+    m_jobs.append(job);
+    // Queued so the caller can connect to the job before it starts
+    QMetaObject::invokeMethod(this, &TransferScheduler::schedule, Qt::QueuedConnection);
+    return job;
+}
+
+void TransferScheduler::jobChanged(TransferJob *job)
+{
+    if (isTerminal(job->state())) {
+        m_jobs.removeOne(job);
+        job->deleteLater();
+    }
+    schedule();
+}
+
+void TransferScheduler::schedule()
+{
+    if (m_scheduling) {
+        m_rescheduled = true;
+        return;
+    }
+    m_scheduling = true;
+    do {
+        m_rescheduled = false;
+        fillSlots();
+    } while (m_rescheduled);
+    m_scheduling = false;
+
+    shareConnections();
+    if (m_jobs.isEmpty()) {
+        m_rotateTimer->stop();
+    } else if (!m_rotateTimer->isActive()) {
+        m_rotateTimer->start();
+    }
+}
+
+void TransferScheduler::fillSlots()
+{
+    // Class first, then place in the class
+    const auto before = [](const TransferJob *a, const TransferJob *b) {
+        if (a->priority() != b->priority()) {
+            return a->priority() < b->priority();
+        }
+        return a->m_sequence < b->m_sequence;
+    };
+
+    QList<TransferJob*> running;
+    QList<TransferJob*> waiting;
+    for (TransferJob *job : std::as_const(m_jobs)) {
+        if (job->state() == TransferJob::State::Running) {
+            running.append(job);
+        } else if (job->state() == TransferJob::State::Queued) {
+            waiting.append(job);
+        }
+    }
+    std::sort(running.begin(), running.end(), before);
+    std::sort(waiting.begin(), waiting.end(), before);
+
+    // setMaxActive() may have lowered the limit
+    while (running.size() > m_maxActive) {
+        running.takeLast()->suspend();
+    }
+
+    for (TransferJob *job : std::as_const(waiting)) {
+        if (job->state() != TransferJob::State::Queued) {
+            // Handlers of a job that failed on start may have changed others
+            continue;
+        }
+        if (running.size() >= m_maxActive) {
+            // Only a lower class gives up its slot; the last running job is
+            // the lowest and, within its class, the latest
+            if (running.last()->priority() <= job->priority()) {
+                break;
+            }
+            running.takeLast()->suspend();
+        }
+        job->run(m_manager);
+        if (job->state() == TransferJob::State::Running) {
+            running.insert(std::upper_bound(running.begin(), running.end(), job, before), job);
+        }
+    }
+}
+
+void TransferScheduler::rotate()
+{
+    // Per class, how many jobs wait for a slot
+    QList<int> waiting(int(TransferPriority::Bulk) + 1, 0);
+    for (const TransferJob *job : std::as_const(m_jobs)) {
+        if (job->state() == TransferJob::State::Queued) {
+            waiting[int(job->priority())]++;
+        }
+    }
+
+    // A job that had its turn goes to the back of its class, so a large
+    // file cannot hold a slot while others of its class wait
+    bool rotated = false;
+    for (TransferJob *job : std::as_const(m_jobs)) {
+        int &others = waiting[int(job->priority())];
+        if (job->state() != TransferJob::State::Running || others == 0
+            || job->m_runningFor.elapsed() < ROTATE_INTERVAL_MS) {
+            continue;
+        }
+        job->suspend();
+        job->m_sequence = m_nextSequence++;
+        others--;
+        rotated = true;
+    }
+
+    if (rotated) {
+        schedule();
+    }
+}
+
+void TransferScheduler::shareConnections()
+{
+    // Every transfer goes to the same tus server
+    QList<TransferJob*> uploads;
+    int others = 0;
+    for (TransferJob *job : std::as_const(m_jobs)) {
+        if (job->state() != TransferJob::State::Running) {
+            continue;
+        }
+        if (job->m_uploader) {
+            uploads.append(job);
+        } else {
+            others++;
+        }
+    }
+    if (uploads.isEmpty()) {
+        return;
+    }
+
+    const int spare = qMax(1, HOST_CONNECTIONS - 1 - others);
+    const int share = qMax(1, spare / int(uploads.size()));
+    for (TransferJob *job : std::as_const(uploads)) {
+        job->m_uploader->setMaxConnections(share);
+    }
+}
@@ -0,0 +1,135 @@
+#ifndef TRANSFERSCHEDULER_H
+#define TRANSFERSCHEDULER_H
+
+#include <QObject>
+#include <QString>
+#include <QUrl>
+#include <QList>
+#include <QByteArray>
+#include <QElapsedTimer>
+
+class QNetworkAccessManager;
+class QTimer;
+class TusUploader;
+class TusDownloader;
+class TransferScheduler;
+
+// Lower values run first
+enum class TransferPriority {
+    Voice = 0,
+    Image = 1,
+    Bulk = 2
+};
+
+// One upload or download handed to TransferScheduler. The scheduler decides
+// when it runs; pause(), resume() and cancel() are the user's. The scheduler
+// deletes the job once it finished, failed or was cancelled, so keep it in a
+// QPointer.
+class TransferJob : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum class Kind { Upload, Download };
+    enum class State { Queued, Running, Paused, Finished, Failed, Cancelled };
+
+    Kind kind() const { return m_kind; }
+    TransferPriority priority() const { return m_priority; }
+    State state() const { return m_state; }
+
+    // A paused job keeps what it has transferred and gives up its slot
+    void pause();
+    void resume();
+    void cancel();
+
+signals:
+    void progress(qint64 bytesDone, qint64 bytesTotal);
+    // Uploads: upload path, file size and encryption header, as
+    // TusUploader::finished. Downloads: the saved file's path.
+    void finished(const QString &result, qint64 fileSize, const QByteArray &encryptionHeader);
+    void error(const QString &errorMessage);
+    void stateChanged(TransferJob::State state);
+
+private:
+    friend class TransferScheduler;
+
+    TransferJob(Kind kind, TransferPriority priority, TransferScheduler *scheduler);
+
+    // Scheduler side: start or continue the transfer, or park it in the
+    // queue again
+    void run(QNetworkAccessManager *manager);
+    void suspend();
+    void pauseTransfer();
+    void setState(State state);
+    void onFinished(const QString &result, qint64 fileSize, const QByteArray &encryptionHeader);
+    void onError(const QString &errorMessage);
+
+    Kind m_kind;
+    TransferPriority m_priority;
+    State m_state;
+    quint64 m_sequence;        // Order within the priority class
+    QElapsedTimer m_runningFor;
+    TransferScheduler *m_scheduler;
+
+    QString m_filePath;        // Upload source or download destination
+    QUrl m_url;                // Upload endpoint or download URL
+    TusUploader *m_uploader;   // Created on the first run
+    TusDownloader *m_downloader;
+};
+
+// Process-wide queue for every tus upload and download. Transfers share one
+// QNetworkAccessManager, at most maxActive() run at once, and a waiting job
+// of a higher class pauses the lowest running one: a voice note never waits
+// behind a large file. Jobs of one class take turns every
+// ROTATE_INTERVAL_MS when more of them wait than there are slots. GUI
+// thread only.
+class TransferScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    static TransferScheduler& instance();
+
+    TransferJob *submitUpload(const QString &filePath, const QUrl &endpoint, TransferPriority priority);
+    TransferJob *submitDownload(const QUrl &url, const QString &savePath, TransferPriority priority);
+
+    // Images by extension, everything else bulk; voice notes are known to
+    // the caller
+    static TransferPriority priorityFor(const QString &fileName);
+
+    int maxActive() const { return m_maxActive; }
+    void setMaxActive(int count);
+
+private:
+    friend class TransferJob;
+
+    explicit TransferScheduler(QObject *parent = nullptr);
+
+    TransferScheduler(const TransferScheduler&) = delete;
+    TransferScheduler& operator=(const TransferScheduler&) = delete;
+
+    TransferJob *enqueue(TransferJob *job);
+    // A job finished, failed, or was paused, resumed or cancelled by the user
+    void jobChanged(TransferJob *job);
+    void schedule();
+    void fillSlots();
+    void rotate();
+    void shareConnections();
+
+    QNetworkAccessManager *m_manager;
+    QList<TransferJob*> m_jobs; // Queued, running or paused
+    QTimer *m_rotateTimer;
+    quint64 m_nextSequence;
+    int m_maxActive;
+    bool m_scheduling;  // Jobs that fail on start report back mid-schedule
+    bool m_rescheduled;
+
+    static const int DEFAULT_MAX_ACTIVE = 3;
+    static const int ROTATE_INTERVAL_MS = 15000;
+    // Qt's per-host limit for HTTP/1.1. Uploads split what the other running
+    // transfers leave, minus one kept free so a job that just started does
+    // not queue behind PATCH requests.
+    static const int HOST_CONNECTIONS = 6;
+};
+
+#endif // TRANSFERSCHEDULER_H
@@ -1,27 +1,30 @@
 #include "TusDownloader.h"
-#include <QDir>
-#include <QStandardPaths>
+#include "DownloadWriter.h"
+#include <QThread>
 
-TusDownloader::TusDownloader(QObject *parent)
+TusDownloader::TusDownloader(QObject *parent, QNetworkAccessManager *manager)
     : QObject(parent),
-    m_file(nullptr),
+    m_manager(manager),
     m_reply(nullptr),
+    m_rangeStart(0),
+    m_skipBytes(0),
+    m_rangeChecked(false),
+    m_paused(false),
+    m_writer(nullptr),
+    m_queuedBytes(0),
     m_decryptionEnabled(false),
-    m_currentChunkIndex(0),
     m_bytesDownloaded(0)
 {
-    m_manager = new QNetworkAccessManager(this);
+    if (!m_manager) {
+        m_manager = new QNetworkAccessManager(this);
+    }
 }
 
 TusDownloader::~TusDownloader()
 {
-    if (m_file) {
-        m_file->close();
-        delete m_file;
-    }
-    if (m_reply) {
-        m_reply->deleteLater();
-    }
+    releaseWriter();
+    // The manager may be shared and outlive this object
+    dropReply();
 }
 
 void TusDownloader::setDecryptionKey(const QByteArray &key)
@@ -33,50 +36,52 @@ void TusDownloader::setDecryptionKey(const QByteArray &key)
 }
 
 void TusDownloader::startDownload(const QUrl &fileUrl, const QString &savePath, 
-                                  bool decrypt, const QByteArray &encryptionMetadata)
+                                  bool decrypt, const QByteArray &encryptionHeader)
 {
+    dropReply();
+    m_paused = false;
+    m_url = fileUrl;
     m_savePath = savePath;
     m_decryptionEnabled = decrypt;
-    m_currentChunkIndex = 0;
     m_bytesDownloaded = 0;
-    m_chunkBuffer.clear();
 
-    // Load encryption metadata if decryption is enabled
-    if (m_decryptionEnabled) {
-        if (encryptionMetadata.isEmpty()) {
-            emit error("Decryption requested but no encryption metadata provided");
-            return;
-        }
-        m_chunkMetadata = CryptoManager::deserializeMetadata(encryptionMetadata);
-        if (m_chunkMetadata.isEmpty()) {
-            emit error("Failed to deserialize encryption metadata");
-            return;
-        }
-        if (m_decryptionKey.size() != 32) {
-            emit error("Decryption key not set or invalid");
-            return;
-        }
-    } else {
+    if (m_decryptionEnabled && m_decryptionKey.size() != 32) {
+        emit error("Decryption key not set or invalid");
+        return;
     }
 
-    // Create directory if it doesn't exist
-    QDir dir = QFileInfo(savePath).absoluteDir();
-    if (!dir.exists()) {
-        dir.mkpath(".");
-    }
+    // The writer creates the file and checks the header on its own thread;
+    // problems come back through failed()
+    releaseWriter();
+    m_queuedBytes = 0;
+    m_writer = new DownloadWriter;
+    m_writer->moveToThread(DownloadWriter::ioThread());
+    connect(m_writer, &DownloadWriter::consumed, this, &TusDownloader::onWriterConsumed);
+    connect(m_writer, &DownloadWriter::finished, this, &TusDownloader::onWriterFinished);
+    connect(m_writer, &DownloadWriter::failed, this, &TusDownloader::onWriterFailed);
+    DownloadWriter *writer = m_writer;
+    const QByteArray key = m_decryptionKey;
+    QMetaObject::invokeMethod(writer, [writer, savePath, decrypt, key, encryptionHeader]() {
+        writer->open(savePath, decrypt, key, encryptionHeader);
+    }, Qt::QueuedConnection);
 
-    m_file = new QFile(savePath);
-    if (!m_file->open(QIODevice::WriteOnly)) {
-        emit error("Failed to create file: " + m_file->errorString());
-        return;
-    }
+    sendRequest();
+}
 
-    QNetworkRequest request(fileUrl);
+void TusDownloader::sendRequest()
+{
+    QNetworkRequest request(m_url);
     // Set tus headers for resumable downloads (if supported)
     request.setRawHeader("Tus-Resumable", "1.0.0");
-    
+    m_rangeStart = m_bytesDownloaded;
+    m_skipBytes = 0;
+    m_rangeChecked = false;
+    if (m_rangeStart > 0) {
+        request.setRawHeader("Range", "bytes=" + QByteArray::number(m_rangeStart) + "-");
+    }
 
     m_reply = m_manager->get(request);
+    m_reply->setReadBufferSize(MAX_QUEUED_BYTES);
 
     // --- FIX: Add readyRead to write incrementally ---
     connect(m_reply, &QNetworkReply::readyRead, this, &TusDownloader::onDataReady);
@@ -86,69 +91,107 @@ void TusDownloader::startDownload(const QUrl &fileUrl, const QString &savePath,
             this, &TusDownloader::onDownloadError);
 }
 
-void TusDownloader::onDownloadProgress(qint64 bytesReceived, qint64 bytesTotal)
+void TusDownloader::pauseDownload()
 {
-    emit downloadProgress(bytesReceived, bytesTotal);
+    if (!m_reply || !m_writer) {
+        return;
+    }
+    // What the reply already holds is kept, so the next request starts
+    // exactly where the file ends
+    onDataReady();
+    if (m_skipBytes == 0) {
+        queueToWriter(m_reply->readAll());
+    }
+    dropReply();
+    m_paused = true;
 }
 
-void TusDownloader::onDataReady()
+void TusDownloader::resumeDownload()
 {
-    // --- FIX: Write data incrementally as it arrives ---
-    if (m_file && m_file->isOpen() && m_reply) {
-        QByteArray data = m_reply->readAll();
-        if (!data.isEmpty()) {
-            if (m_decryptionEnabled) {
-                // Add to buffer for chunk-based decryption
-                m_chunkBuffer.append(data);
-                processDownloadedChunks();
-            } else {
-                // No encryption - write directly
-                m_file->write(data);
-                m_file->flush(); // Ensure data is written to disk
-            }
-        }
+    if (!m_paused || !m_writer) {
+        return;
     }
+    m_paused = false;
+    sendRequest();
 }
 
-void TusDownloader::processDownloadedChunks()
+void TusDownloader::cancelDownload()
 {
-    // Process complete chunks from buffer
-    while (m_currentChunkIndex < m_chunkMetadata.size()) {
-        const ChunkMetadata &metadata = m_chunkMetadata[m_currentChunkIndex];
-        
-        // Check if we have enough data for this chunk
-        if (m_chunkBuffer.size() < metadata.encryptedSize) {
-            // Wait for more data
-            break;
-        }
+    dropReply();
+    if (m_writer) {
+        // The writer removes the incomplete file
+        DownloadWriter *writer = m_writer;
+        QMetaObject::invokeMethod(writer, [writer]() { writer->abort(); }, Qt::QueuedConnection);
+        releaseWriter();
+    }
+}
 
-        // Extract this chunk's encrypted data
-        QByteArray encryptedChunk = m_chunkBuffer.left(metadata.encryptedSize);
-        m_chunkBuffer.remove(0, metadata.encryptedSize);
-
-        // Decrypt the chunk
-        QByteArray decryptedChunk;
-        if (!CryptoManager::decryptChunk(encryptedChunk, m_decryptionKey, metadata, decryptedChunk)) {
-            emit error(QString("Failed to decrypt chunk %1").arg(m_currentChunkIndex));
-            if (m_reply) {
-                m_reply->abort();
-            }
-            return;
-        }
+void TusDownloader::dropReply()
+{
+    if (!m_reply) {
+        return;
+    }
+    m_reply->disconnect(this);
+    m_reply->abort();
+    m_reply->deleteLater();
+    m_reply = nullptr;
+}
 
-        // Write decrypted data to file
-        if (m_file->write(decryptedChunk) == -1) {
-            emit error("Failed to write decrypted data to file");
-            if (m_reply) {
-                m_reply->abort();
-            }
-            return;
+void TusDownloader::onDownloadProgress(qint64 bytesReceived, qint64 bytesTotal)
+{
+    // Progress of the whole file, not of this request
+    const bool ranged = m_reply
+        && m_reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() == 206;
+    const qint64 base = ranged ? m_rangeStart : 0;
+    emit downloadProgress(base + bytesReceived, bytesTotal < 0 ? bytesTotal : base + bytesTotal);
+}
+
+void TusDownloader::onDataReady()
+{
+    if (m_reply && !m_rangeChecked && m_rangeStart > 0) {
+        m_rangeChecked = true;
+        if (m_reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() == 200) {
+            // The server ignored the Range and sends the whole file again
+            m_skipBytes = m_rangeStart;
         }
-        m_file->flush();
+    }
+    while (m_reply && m_skipBytes > 0 && m_reply->bytesAvailable() > 0) {
+        const qint64 skipped = m_reply->skip(m_skipBytes);
+        if (skipped <= 0) {
+            break;
+        }
+        m_skipBytes -= skipped;
+    }
+    if (m_skipBytes > 0) {
+        return;
+    }
 
+    // Bounded hand-off: once the writer is MAX_QUEUED_BYTES behind, the rest
+    // stays in the reply until onWriterConsumed() makes room
+    while (m_reply && m_writer && m_queuedBytes < MAX_QUEUED_BYTES && m_reply->bytesAvailable() > 0) {
+        queueToWriter(m_reply->read(MAX_QUEUED_BYTES - m_queuedBytes));
+    }
+}
 
-        m_currentChunkIndex++;
+void TusDownloader::queueToWriter(QByteArray data)
+{
+    if (data.isEmpty()) {
+        return;
     }
+    m_queuedBytes += data.size();
+    m_bytesDownloaded += data.size();
+    // Moved all the way, so the writer holds the only reference and can
+    // decrypt inside the received bytes without a copy
+    DownloadWriter *writer = m_writer;
+    QMetaObject::invokeMethod(writer, [writer, data = std::move(data)]() mutable {
+        writer->append(std::move(data));
+    }, Qt::QueuedConnection);
+}
+
+void TusDownloader::onWriterConsumed(qint64 bytes)
+{
+    m_queuedBytes -= bytes;
+    onDataReady();
 }
 
 void TusDownloader::onDownloadFinished()
@@ -157,50 +200,51 @@ void TusDownloader::onDownloadFinished()
         return; // Error handled in onDownloadError
     }
 
-    // --- FIX: Write any remaining data (though onDataReady should have handled most) ---
-    if (m_file && m_file->isOpen()) {
-        QByteArray remaining = m_reply->readAll();
-        if (!remaining.isEmpty()) {
-            if (m_decryptionEnabled) {
-                m_chunkBuffer.append(remaining);
-                processDownloadedChunks();
-            } else {
-                m_file->write(remaining);
-            }
-        }
-
-        // Verify all chunks were processed if decryption was enabled
-        if (m_decryptionEnabled) {
-            if (m_currentChunkIndex != m_chunkMetadata.size()) {
-                // Removed qWarning
-            }
-            if (!m_chunkBuffer.isEmpty()) {
-                // Removed qWarning
-            }
-        }
-
-        m_file->flush();
-        m_file->close();
+    // The reply is done, so whatever it still holds goes to the writer
+    // regardless of the queue limit
+    onDataReady();
+    if (m_skipBytes > 0) {
+        cancelDownload();
+        emit error("Download failed: the file changed on the server");
+        return;
+    }
+    if (m_writer) {
+        queueToWriter(m_reply->readAll());
+        DownloadWriter *writer = m_writer;
+        QMetaObject::invokeMethod(writer, [writer]() { writer->finish(); }, Qt::QueuedConnection);
     }
-
-    QString completionMsg = m_decryptionEnabled 
-        ? QString("Download and decryption completed successfully (%1 chunks)").arg(m_currentChunkIndex)
-        : "Download completed successfully";
-    
-    emit finished(m_savePath);
 
     m_reply->deleteLater();
     m_reply = nullptr;
 }
 
+void TusDownloader::onWriterFinished()
+{
+    releaseWriter();
+    emit finished(m_savePath);
+}
+
+void TusDownloader::onWriterFailed(const QString &message)
+{
+    releaseWriter();
+    if (m_reply) {
+        m_reply->disconnect(this);
+        m_reply->abort();
+        m_reply->deleteLater();
+        m_reply = nullptr;
+    }
+    emit error(message);
+}
+
 void TusDownloader::onDownloadError(QNetworkReply::NetworkError code)
 {
     QString errorMsg = "Download failed: " + m_reply->errorString();
 
-    if (m_file && m_file->isOpen()) {
-        m_file->close();
-        // Remove incomplete file
-        m_file->remove();
+    // The writer removes the incomplete file
+    if (m_writer) {
+        DownloadWriter *writer = m_writer;
+        QMetaObject::invokeMethod(writer, [writer]() { writer->abort(); }, Qt::QueuedConnection);
+        releaseWriter();
     }
 
     emit error(errorMsg);
@@ -209,4 +253,15 @@ void TusDownloader::onDownloadError(QNetworkReply::NetworkError code)
         m_reply->deleteLater();
         m_reply = nullptr;
     }
-}
\ No newline at end of file
+}
+
+void TusDownloader::releaseWriter()
+{
+    if (!m_writer) {
+        return;
+    }
+    // Queued after anything already sent to it, so pending writes finish
+    m_writer->disconnect(this);
+    m_writer->deleteLater();
+    m_writer = nullptr;
+}
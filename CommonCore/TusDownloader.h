@@ -10,17 +10,29 @@
 #include <QVector>
 #include "CryptoManager.h"
 
+class DownloadWriter;
+
 class TusDownloader : public QObject
 {
     Q_OBJECT
 
 public:
-    explicit TusDownloader(QObject *parent = nullptr);
+    // Downloads share manager's connections when one is given
+    explicit TusDownloader(QObject *parent = nullptr, QNetworkAccessManager *manager = nullptr);
     ~TusDownloader();
 
-    // Call this to start the download (with optional decryption)
+    // Call this to start the download (with optional decryption). The
+    // encryption header is optional: the stream starts with its own copy,
+    // which must match when both are present.
     void startDownload(const QUrl &fileUrl, const QString &savePath, 
-                      bool decrypt = false, const QByteArray &encryptionMetadata = QByteArray());
+                      bool decrypt = false, const QByteArray &encryptionHeader = QByteArray());
+
+    // Pausing drops the connection but keeps the partial file and the
+    // writer's state; resuming asks for the rest with a Range request
+    void pauseDownload();
+    void resumeDownload();
+    // Stops for good and removes the partial file
+    void cancelDownload();
 
     // Set decryption key (must be 32 bytes for AES-256)
     void setDecryptionKey(const QByteArray &key);
@@ -35,25 +47,36 @@ private slots:
     void onDownloadProgress(qint64 bytesReceived, qint64 bytesTotal);
     void onDownloadFinished();
     void onDownloadError(QNetworkReply::NetworkError code);
+    void onWriterConsumed(qint64 bytes);
+    void onWriterFinished();
+    void onWriterFailed(const QString &message);
 
 private:
     QNetworkAccessManager *m_manager;
-    QFile *m_file;
     QNetworkReply *m_reply;
+    QUrl m_url;
     QString m_savePath;
+    qint64 m_rangeStart; // Where the current request starts in the file
+    qint64 m_skipBytes;  // Already written, to drop when Range was ignored
+    bool m_rangeChecked;
+    bool m_paused;
 
-    // Decryption support
+    // Decryption and disk writes happen on the writer's I/O thread; this
+    // object only moves data from the reply to it
+    DownloadWriter *m_writer;
+    qint64 m_queuedBytes; // Handed to the writer, not yet processed
     bool m_decryptionEnabled;
     QByteArray m_decryptionKey;
-    QVector<ChunkMetadata> m_chunkMetadata;
-    qint64 m_currentChunkIndex;
-    QByteArray m_chunkBuffer; // Buffer for assembling chunks
     qint64 m_bytesDownloaded;
 
-    // Chunk size must match uploader (5MB)
-    static const int CHUNK_SIZE = 5 * 1024 * 1024;
+    // Past this the data waits in the reply, whose read buffer is capped at
+    // the same size, so the socket stops being read
+    static const qint64 MAX_QUEUED_BYTES = 16 * 1024 * 1024;
 
-    void processDownloadedChunks();
+    void sendRequest();
+    void dropReply();
+    void queueToWriter(QByteArray data);
+    void releaseWriter();
 };
 
 #endif // TUSDOWNLOADER_H
\ No newline at end of file
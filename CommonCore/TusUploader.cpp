@@ -1,23 +1,115 @@
 #include "TusUploader.h"
+#include <QCryptographicHash>
+#include <QHash>
+#include <QRandomGenerator>
+#include <QThread>
+#include <QTimer>
+#include <cstring>
+
+namespace {
+
+// Runs on the upload pool: reads chunks [first, first + count) straight into
+// a pooled body sized for them and seals each in place. The body starting the
+// stream also carries its header.
+bool sealRequestBody(const QString &path, const ChunkedStream &stream, qint64 first, qint64 count,
+                     qint64 fileSize, QByteArray &body, QString &problem)
+{
+    const int chunkSize = stream.chunkSize();
+    const qint64 offset = first * chunkSize;
+    const int headerSize = first == 0 ? ChunkedStream::HeaderSize : 0;
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly) || !file.seek(offset)) {
+        problem = "Failed to read file: " + file.errorString();
+        return false;
+    }
+
+    if (headerSize > 0) {
+        memcpy(body.data(), stream.header().constData(), headerSize);
+    }
+    char *out = body.data() + headerSize;
+    for (qint64 i = 0; i < count; ++i) {
+        const qint64 chunkOffset = offset + i * chunkSize;
+        const qint64 length = qBound<qint64>(0, fileSize - chunkOffset, chunkSize);
+        if (file.read(out, length) != length) {
+            problem = "Failed to read file: " + file.errorString();
+            return false;
+        }
+        if (!stream.sealChunk(quint32(first + i), chunkOffset + length >= fileSize, out, length)) {
+            problem = "Failed to encrypt chunk";
+            return false;
+        }
+        out += length + AeadContext::TagSize;
+    }
+    return true;
+}
+
+// Endpoint -> whether it advertised the concatenation extension, so the
+// OPTIONS round trip is paid once per server
+QHash<QString, bool> &concatenationSupport()
+{
+    static QHash<QString, bool> support;
+    return support;
+}
+
+// Worth retrying: the connection dropped, the server is overloaded or busy,
+// or our offset was stale (a HEAD sorts that out). Anything else will fail
+// the same way again.
+bool isTransient(QNetworkReply::NetworkError code, int statusCode)
+{
+    if (statusCode == 409 || statusCode == 423 || statusCode == 429 || statusCode >= 500) {
+        return true;
+    }
+    if (statusCode != 0) {
+        return false;
+    }
+    return code > QNetworkReply::NoError && code < QNetworkReply::ProxyConnectionRefusedError
+        && code != QNetworkReply::OperationCanceledError
+        && code != QNetworkReply::SslHandshakeFailedError;
+}
 
-TusUploader::TusUploader(QObject *parent)
+}
+
+TusUploader::TusUploader(QObject *parent, QNetworkAccessManager *manager)
     : QObject(parent),
-    m_file(nullptr),
+    m_manager(manager),
     m_fileSize(0),
-    m_bytesUploaded(0),
-    m_reply(nullptr),
+    m_uploadLength(0),
+    m_controlReply(nullptr),
+    m_partChunks(0),
+    m_activeParts(0),
+    m_connectionLimit(1),
+    m_maxConnections(MAX_CONNECTIONS),
+    m_parallelEnabled(true),
+    m_concatenate(false),
+    m_sampleBytes(0),
+    m_bestThroughput(0),
+    m_journaled(false),
+    m_paused(false),
+    m_retryCount(0),
+    m_requestChunks(INITIAL_REQUEST_CHUNKS),
+    m_rate(0),
+    m_roundTripMs(-1),
+    m_buffers(std::make_shared<UploadBufferPool>()),
     m_encryptionEnabled(false),
-    m_currentChunkIndex(0)
+    m_chunkCount(0),
+    m_generation(0)
 {
-    m_manager = new QNetworkAccessManager(this);
+    if (!m_manager) {
+        m_manager = new QNetworkAccessManager(this);
+    }
+    m_pool.setMaxThreadCount(qBound(1, QThread::idealThreadCount(), MAX_PREPARE_THREADS));
+
+    m_retryTimer = new QTimer(this);
+    m_retryTimer->setSingleShot(true);
+    connect(m_retryTimer, &QTimer::timeout, this, &TusUploader::resume);
 }
 
 TusUploader::~TusUploader()
 {
-    if (m_file) {
-        m_file->close();
-        delete m_file;
-    }
+    // Jobs use m_stream and post back to this object
+    stopPipeline();
+    abortRequests();
 }
 
 void TusUploader::setEncryptionKey(const QByteArray &key)
@@ -28,202 +120,809 @@ void TusUploader::setEncryptionKey(const QByteArray &key)
     m_encryptionKey = key;
 }
 
+void TusUploader::setParallelUploads(bool enabled)
+{
+    m_parallelEnabled = enabled;
+}
+
+void TusUploader::setMaxConnections(int connections)
+{
+    m_maxConnections = qBound(1, connections, MAX_CONNECTIONS);
+    m_connectionLimit = qMin(m_connectionLimit, m_maxConnections);
+}
+
 void TusUploader::startUpload(const QString &filePath, const QUrl &tusEndpoint, bool encrypt)
 {
+    stopPipeline();
+    abortRequests();
+    m_paused = false;
     m_encryptionEnabled = encrypt;
-    m_currentChunkIndex = 0;
-    m_chunkMetadata.clear();
+    m_parts.clear();
+    m_chunkCount = 0;
+    m_retryCount = 0;
+    m_requestChunks = INITIAL_REQUEST_CHUNKS;
+    m_rate = 0;
+    m_roundTripMs = -1;
+    m_stream.reset();
+
+    m_filePath = filePath;
+    m_endpoint = tusEndpoint; // This is the main endpoint, e.g., http://192.168.1.10:1080/files/
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        emit error("Failed to open file: " + file.errorString());
+        return;
+    }
+    m_fileSize = file.size();
+    m_modified = QFileInfo(file).lastModified();
+
+    UploadJournalEntry entry;
+    if (UploadJournal::find(m_filePath, m_endpoint, entry)) {
+        if (restore(entry)) {
+            resume();
+            return;
+        }
+        // The file changed or the upload was set up differently
+        UploadJournal::remove(m_filePath, m_endpoint);
+    }
 
     if (m_encryptionEnabled && m_encryptionKey.size() != 32) {
         // Generate a key if encryption is enabled but no key is set
         m_encryptionKey = CryptoManager::generateAES256Key();
     }
 
-    m_file = new QFile(filePath);
-    if (!m_file->open(QIODevice::ReadOnly)) {
-        emit error("Failed to open file: " + m_file->errorString());
+    m_uploadLength = m_fileSize;
+    m_chunkCount = qMax<qint64>(1, (m_fileSize + CHUNK_SIZE - 1) / CHUNK_SIZE);
+    if (m_encryptionEnabled) {
+        if (!m_stream.create(m_encryptionKey, CryptoManager::preferredCipher(), CHUNK_SIZE)) {
+            emit error("Failed to set up encryption");
+            return;
+        }
+        m_uploadLength = m_stream.encryptedSize(m_fileSize);
+        m_chunkCount = m_stream.chunkCount(m_fileSize);
+    }
+    m_journaled = m_chunkCount > 1;
+
+    if (!m_parallelEnabled || m_chunkCount < MIN_PARALLEL_CHUNKS) {
+        planParts(false);
         return;
     }
 
-    m_fileSize = m_file->size();
-    m_uploadUrl = tusEndpoint; // This is the main endpoint, e.g., http://192.168.1.10:1080/files/
+    auto known = concatenationSupport().constFind(m_endpoint.toString());
+    if (known != concatenationSupport().constEnd()) {
+        planParts(known.value());
+    } else {
+        probeConcatenation();
+    }
+}
+
+bool TusUploader::restore(const UploadJournalEntry &entry)
+{
+    if (entry.fileSize != m_fileSize || entry.modified != m_modified || entry.chunkSize != CHUNK_SIZE
+        || entry.encrypted != m_encryptionEnabled || entry.partChunks <= 0) {
+        return false;
+    }
+
+    m_uploadLength = m_fileSize;
+    m_chunkCount = qMax<qint64>(1, (m_fileSize + CHUNK_SIZE - 1) / CHUNK_SIZE);
+    if (m_encryptionEnabled) {
+        // Same key and salt, so chunks seal to the very bytes the server
+        // already has and a part can continue mid-chunk. The journal only
+        // has the key's hash: without setEncryptionKey() the upload restarts.
+        if (m_encryptionKey.size() != 32
+            || QCryptographicHash::hash(m_encryptionKey, QCryptographicHash::Sha256) != entry.keyHash
+            || !m_stream.open(m_encryptionKey, entry.header)) {
+            return false;
+        }
+        m_uploadLength = m_stream.encryptedSize(m_fileSize);
+        m_chunkCount = m_stream.chunkCount(m_fileSize);
+    }
 
+    m_concatenate = entry.concatenate;
+    layoutParts(entry.partChunks);
+    if (entry.partUrls.size() != m_parts.size()) {
+        m_parts.clear();
+        m_stream.reset();
+        return false;
+    }
+    for (int i = 0; i < m_parts.size(); ++i) {
+        m_parts[i].url = entry.partUrls.at(i);
+        m_parts[i].confirmed = entry.partOffsets.value(i);
+    }
 
-    // Step 1: Create the upload resource on the server
-    createUpload();
+    m_journaled = true;
+    m_connectionLimit = m_concatenate ? qMin(2, m_maxConnections) : 1;
+    m_bestThroughput = 0;
+    return true;
 }
 
 void TusUploader::cancelUpload()
 {
-    
+    stopPipeline();
+
     // Disconnect all signals to prevent segfault
-    if (m_reply) {
-        m_reply->disconnect();
-        m_reply->abort();
-        m_reply->deleteLater();
-        m_reply = nullptr;
-    }
-    
-    // Close file
-    if (m_file) {
-        m_file->close();
-        delete m_file;
-        m_file = nullptr;
-    }
-    
-    // Disconnect from manager
+    abortRequests();
+    UploadJournal::remove(m_filePath, m_endpoint);
+
+    // Disconnect from manager, which may be shared
     if (m_manager) {
-        m_manager->disconnect();
+        m_manager->disconnect(this);
     }
-    
+
 }
 
-void TusUploader::createUpload()
+void TusUploader::pauseUpload()
 {
-    QNetworkRequest request(m_uploadUrl);
+    if (m_paused) {
+        return;
+    }
+    m_paused = true;
+    stopPipeline();
+    abortRequests();
+    saveJournal();
+}
 
-    // Set tus headers for creation
+void TusUploader::resumeUpload()
+{
+    if (!m_paused) {
+        return;
+    }
+    m_paused = false;
+    if (m_parts.isEmpty()) {
+        // Paused before the parts were planned
+        startUpload(m_filePath, m_endpoint, m_encryptionEnabled);
+    } else {
+        resume();
+    }
+}
+
+void TusUploader::probeConcatenation()
+{
+    QNetworkRequest request(m_endpoint);
     request.setRawHeader("Tus-Resumable", "1.0.0");
-    request.setRawHeader("Upload-Length", QByteArray::number(m_fileSize));
 
-    QFileInfo fileInfo(*m_file);
-    QString metadata = "filename " + QByteArray(fileInfo.fileName().toUtf8()).toBase64();
-    request.setRawHeader("Upload-Metadata", metadata.toLocal8Bit());
+    m_controlReply = m_manager->sendCustomRequest(request, "OPTIONS");
+    connect(m_controlReply, &QNetworkReply::finished, this, [this]() {
+        QNetworkReply *reply = m_controlReply;
+        m_controlReply = nullptr;
+        reply->deleteLater();
+
+        // A server that does not answer OPTIONS still takes plain uploads
+        bool supported = false;
+        if (reply->error() == QNetworkReply::NoError) {
+            const QList<QByteArray> extensions = reply->rawHeader("Tus-Extension").split(',');
+            for (const QByteArray &extension : extensions) {
+                supported = supported || extension.trimmed() == "concatenation";
+            }
+            concatenationSupport().insert(m_endpoint.toString(), supported);
+        }
+        planParts(supported);
+    });
+}
+
+void TusUploader::planParts(bool concatenate)
+{
+    m_concatenate = concatenate;
+    // Enough parts that the connection count has room to grow, few enough
+    // that the final concat header stays small
+    const qint64 partChunks = concatenate
+        ? qMax<qint64>(MIN_PART_CHUNKS, (m_chunkCount + MAX_PARTS - 1) / MAX_PARTS)
+        : m_chunkCount;
+
+    layoutParts(partChunks);
+
+    m_activeParts = 0;
+    // Two connections to start with; adaptConnections() takes it from there
+    m_connectionLimit = concatenate ? qMin(2, m_maxConnections) : 1;
+    m_sampleBytes = 0;
+    m_bestThroughput = 0;
+    m_sampleClock.start();
+
+    saveJournal();
+    startParts();
+}
 
+void TusUploader::layoutParts(qint64 partChunks)
+{
+    m_partChunks = partChunks;
+    m_parts.clear();
+    for (qint64 first = 0; first < m_chunkCount; first += partChunks) {
+        Part part;
+        part.firstChunk = first;
+        part.endChunk = qMin(first + partChunks, m_chunkCount);
+        part.length = bodyOffset(part.endChunk) - bodyOffset(part.firstChunk);
+        part.nextChunk = first;
+        part.nextToPrepare = first;
+        m_parts.append(part);
+    }
+}
 
-    m_reply = m_manager->post(request, QByteArray()); // Send empty POST
+void TusUploader::resume()
+{
+    m_activeParts = 0;
+    for (int i = 0; i < m_parts.size(); ++i) {
+        Part &part = m_parts[i];
+        part.sending = 0;
+        part.waitingForChunk = false;
+        if (part.done) {
+            continue;
+        }
+        if (part.url.isEmpty()) {
+            // Never created, or the create got lost
+            part.started = false;
+            seekPart(part, 0);
+            continue;
+        }
+        part.started = true;
+        m_activeParts++;
+        checkOffset(i);
+    }
+
+    m_sampleBytes = confirmedBytes();
+    m_sampleClock.start();
+    advance();
+}
+
+void TusUploader::startParts()
+{
+    int partIndex;
+    while (m_activeParts < m_connectionLimit && (partIndex = nextUnstartedPart()) >= 0) {
+        m_parts[partIndex].started = true;
+        m_activeParts++;
+        createPart(partIndex);
+    }
+    // The first chunks get read while the create requests are out
+    prepareRequests();
+}
+
+int TusUploader::nextUnstartedPart() const
+{
+    for (int i = 0; i < m_parts.size(); ++i) {
+        if (!m_parts[i].started) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void TusUploader::checkOffset(int partIndex)
+{
+    Part &part = m_parts[partIndex];
+    part.checking = true;
+
+    QNetworkRequest request(part.url);
+    request.setRawHeader("Tus-Resumable", "1.0.0");
 
-    connect(m_reply, &QNetworkReply::finished, this, &TusUploader::onUploadCreated);
-    connect(m_reply, &QNetworkReply::errorOccurred, this, &TusUploader::onUploadError);
+    // Errors are sorted out in onOffsetChecked(): a gone part is created again
+    part.sentAt.start();
+    part.reply = m_manager->head(request);
+    connect(part.reply, &QNetworkReply::finished, this, [this, partIndex]() { onOffsetChecked(partIndex); });
 }
 
-void TusUploader::onUploadCreated()
+void TusUploader::onOffsetChecked(int partIndex)
 {
-    if (m_reply->error() != QNetworkReply::NoError) {
+    Part &part = m_parts[partIndex];
+    QNetworkReply *reply = part.reply;
+    part.reply = nullptr;
+    part.checking = false;
+    reply->deleteLater();
+
+    int statusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (statusCode == 404 || statusCode == 410) {
+        // Expired or deleted on the server: this part starts over
+        part.url.clear();
+        seekPart(part, 0);
+        createPart(partIndex);
+        prepareRequests();
+        return;
+    }
+    if (reply->error() != QNetworkReply::NoError) {
+        handleFailure(reply);
+        return;
+    }
+
+    bool ok = false;
+    const qint64 offset = reply->rawHeader("Upload-Offset").toLongLong(&ok);
+    if (!ok || offset < 0 || offset > part.length) {
+        fail("Tus: Resume failed. Server returned no usable Upload-Offset.");
+        return;
+    }
+
+    m_retryCount = 0;
+    sampleRoundTrip(part.sentAt.elapsed());
+    seekPart(part, offset);
+    saveJournal();
+    emitProgress();
+    if (part.confirmed == part.length) {
+        part.done = true;
+        m_activeParts--;
+        advance();
+        return;
+    }
+    prepareRequests();
+    uploadRequest(partIndex);
+}
+
+void TusUploader::seekPart(Part &part, qint64 confirmed)
+{
+    part.confirmed = confirmed;
+    const qint64 offset = bodyOffset(part.firstChunk) + confirmed;
+    qint64 chunk;
+    if (m_encryptionEnabled) {
+        chunk = offset < m_stream.chunkOffset(1) ? 0 : (offset - ChunkedStream::HeaderSize) / m_stream.sealedChunkSize();
+    } else {
+        chunk = offset / CHUNK_SIZE;
+    }
+    part.nextChunk = qBound(part.firstChunk, chunk, part.endChunk - 1);
+    part.nextToPrepare = part.nextChunk;
+    part.skip = offset - bodyOffset(part.nextChunk);
+}
+
+void TusUploader::createPart(int partIndex)
+{
+    Part &part = m_parts[partIndex];
+    QNetworkRequest request(m_endpoint);
+
+    // Set tus headers for creation
+    request.setRawHeader("Tus-Resumable", "1.0.0");
+    request.setRawHeader("Upload-Length", QByteArray::number(part.length));
+
+    if (m_concatenate) {
+        request.setRawHeader("Upload-Concat", "partial");
+    } else {
+        QString metadata = "filename " + QByteArray(QFileInfo(m_filePath).fileName().toUtf8()).toBase64();
+        request.setRawHeader("Upload-Metadata", metadata.toLocal8Bit());
+    }
+
+    part.sentAt.start();
+    part.reply = m_manager->post(request, QByteArray()); // Send empty POST
+
+    connect(part.reply, &QNetworkReply::finished, this, [this, partIndex]() { onPartCreated(partIndex); });
+    connect(part.reply, &QNetworkReply::errorOccurred, this, &TusUploader::onUploadError);
+}
+
+void TusUploader::onPartCreated(int partIndex)
+{
+    Part &part = m_parts[partIndex];
+    QNetworkReply *reply = part.reply;
+    part.reply = nullptr;
+    reply->deleteLater();
+    if (reply->error() != QNetworkReply::NoError) {
         // Error is handled by onUploadError
         return;
     }
 
     // Server MUST return 201 Created and a Location header
-    int statusCode = m_reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    int statusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
     if (statusCode != 201) {
-        emit error(QString("Tus: Create failed. Server responded with %1").arg(statusCode));
-        m_reply->deleteLater();
+        fail(QString("Tus: Create failed. Server responded with %1").arg(statusCode));
         return;
     }
 
-    if (!m_reply->hasRawHeader("Location")) {
-        emit error("Tus: Create failed. Server did not provide a Location header.");
-        m_reply->deleteLater();
+    if (!reply->hasRawHeader("Location")) {
+        fail("Tus: Create failed. Server did not provide a Location header.");
         return;
     }
 
     // --- FIX: Store the relative path, not the full resolved URL ---
     // Get the new unique URL for this upload
-    // m_uploadUrl = m_reply->url().resolved(QUrl(QString::fromUtf8(m_reply->rawHeader("Location"))));
-    m_uploadUrl = QUrl(QString::fromUtf8(m_reply->rawHeader("Location")));
+    part.url = QUrl(QString::fromUtf8(reply->rawHeader("Location")));
     // --- END FIX ---
-    
-    m_reply->deleteLater();
-
+    sampleRoundTrip(part.sentAt.elapsed());
+    saveJournal();
 
     // Step 2: Start uploading chunks
-    m_bytesUploaded = 0;
-    uploadChunk();
+    uploadRequest(partIndex);
 }
 
-void TusUploader::uploadChunk()
+void TusUploader::uploadRequest(int partIndex)
 {
-    QByteArray chunk = m_file->read(CHUNK_SIZE);
-    if (chunk.isEmpty() && m_bytesUploaded != m_fileSize) {
-        // This can happen if read() fails but not at end
-        return;
-    }
-
-    QByteArray dataToUpload = chunk;
-
-    // Encrypt chunk if encryption is enabled
-    if (m_encryptionEnabled && !chunk.isEmpty()) {
-        ChunkMetadata metadata;
-        metadata.chunkIndex = m_currentChunkIndex++;
-        QByteArray encryptedChunk;
-        if (!CryptoManager::encryptChunk(chunk, m_encryptionKey, encryptedChunk, metadata)) {
-            emit error("Failed to encrypt chunk");
+    Part &part = m_parts[partIndex];
+
+    // Neither kind of body is copied on the way to the socket
+    QIODevice *body;
+    if (m_encryptionEnabled) {
+        // Sealed ahead on the pool; if the network outran it, the request
+        // goes out from onRequestPrepared() instead
+        auto it = m_preparedRequests.find(part.nextChunk);
+        if (it == m_preparedRequests.end()) {
+            part.waitingForChunk = true;
             return;
         }
-        m_chunkMetadata.append(metadata);
-        dataToUpload = encryptedChunk;
+        part.waitingForChunk = false;
+        QByteArray sealed = std::move(it->body);
+        part.nextChunk = it->endChunk;
+        part.queued--;
+        m_preparedRequests.erase(it);
+        if (part.skip > 0) {
+            // Resumed mid-request; moves within the buffer
+            sealed.remove(0, part.skip);
+        }
+        body = new PooledBody(std::move(sealed), m_buffers);
+        prepareRequests();
+    } else {
+        // Plain bytes stream from the file as Qt sends them
+        const qint64 endChunk = qMin<qint64>(part.nextChunk + m_requestChunks, part.endChunk);
+        const qint64 start = bodyOffset(part.nextChunk) + part.skip;
+        body = new FileWindow(m_filePath, start, bodyOffset(endChunk) - start);
+        part.nextChunk = endChunk;
+    }
+    part.skip = 0;
+
+    if (!body->open(QIODevice::ReadOnly)) {
+        delete body;
+        fail("Failed to read file: " + m_filePath);
+        return;
     }
 
-    QNetworkRequest request(m_uploadUrl);
+    QNetworkRequest request(part.url);
     request.setRawHeader("Tus-Resumable", "1.0.0");
-    request.setRawHeader("Upload-Offset", QByteArray::number(m_bytesUploaded));
+    request.setRawHeader("Upload-Offset", QByteArray::number(part.confirmed));
     request.setHeader(QNetworkRequest::ContentTypeHeader, "application/offset+octet-stream");
+    request.setHeader(QNetworkRequest::ContentLengthHeader, body->size());
 
 
-    m_reply = m_manager->sendCustomRequest(request, "PATCH", dataToUpload); // Send chunk with PATCH
+    part.sentAt.start();
+    part.sentBytes = body->size();
+    part.reply = m_manager->sendCustomRequest(request, "PATCH", body); // Send chunks with PATCH
+    // Must outlive the request; a pooled buffer goes back with the reply
+    body->setParent(part.reply);
 
-    connect(m_reply, &QNetworkReply::finished, this, &TusUploader::onChunkUploaded);
-    connect(m_reply, &QNetworkReply::uploadProgress, this, [=](qint64 sent, qint64 total){
+    connect(part.reply, &QNetworkReply::finished, this, [this, partIndex]() { onRequestUploaded(partIndex); });
+    connect(part.reply, &QNetworkReply::uploadProgress, this, [this, partIndex](qint64 sent, qint64 total) {
         if (total > 0) {
-            emit uploadProgress(m_bytesUploaded + sent, m_fileSize);
+            m_parts[partIndex].sending = sent;
+            emitProgress();
         }
     });
-    connect(m_reply, &QNetworkReply::errorOccurred, this, &TusUploader::onUploadError);
+    connect(part.reply, &QNetworkReply::errorOccurred, this, &TusUploader::onUploadError);
+}
+
+void TusUploader::prepareRequests()
+{
+    if (!m_encryptionEnabled) {
+        return;
+    }
+    for (Part &part : m_parts) {
+        if (!part.started || part.done || part.checking) {
+            continue;
+        }
+        while (part.queued < 2 && part.nextToPrepare < part.endChunk) {
+            // Sized now, so a new size applies from the next body prepared
+            const qint64 first = part.nextToPrepare;
+            const qint64 count = qMin<qint64>(m_requestChunks, part.endChunk - first);
+            part.nextToPrepare += count;
+            part.queued++;
+
+            QByteArray body = m_buffers->acquire(bodyOffset(first + count) - bodyOffset(first));
+            const quint64 generation = m_generation;
+            const QString path = m_filePath;
+            const qint64 fileSize = m_fileSize;
+            const ChunkedStream *stream = &m_stream;
+            m_pool.start([this, stream, path, first, count, fileSize, generation, body = std::move(body)]() mutable {
+                QString problem;
+                sealRequestBody(path, *stream, first, count, fileSize, body, problem);
+                QMetaObject::invokeMethod(this, [this, generation, first, count, body = std::move(body), problem]() mutable {
+                    onRequestPrepared(generation, first, first + count, std::move(body), problem);
+                }, Qt::QueuedConnection);
+            });
+        }
+    }
+}
+
+void TusUploader::onRequestPrepared(quint64 generation, qint64 firstChunk, qint64 endChunk,
+                                    QByteArray body, const QString &problem)
+{
+    if (generation != m_generation) {
+        m_buffers->release(std::move(body));
+        return;
+    }
+    if (!problem.isEmpty()) {
+        m_buffers->release(std::move(body));
+        fail(problem);
+        return;
+    }
+
+    m_preparedRequests.insert(firstChunk, PreparedRequest{endChunk, std::move(body)});
+    for (int i = 0; i < m_parts.size(); ++i) {
+        if (m_parts[i].waitingForChunk && m_parts[i].nextChunk == firstChunk) {
+            uploadRequest(i);
+            break;
+        }
+    }
+}
+
+void TusUploader::stopPipeline()
+{
+    ++m_generation;
+    m_pool.clear();
+    m_pool.waitForDone();
+    for (PreparedRequest &prepared : m_preparedRequests) {
+        m_buffers->release(std::move(prepared.body));
+    }
+    m_preparedRequests.clear();
+    for (Part &part : m_parts) {
+        part.waitingForChunk = false;
+        part.queued = 0;
+        part.nextToPrepare = part.nextChunk;
+    }
+}
+
+void TusUploader::abortRequests()
+{
+    m_retryTimer->stop();
+
+    QList<QNetworkReply*> replies;
+    for (Part &part : m_parts) {
+        replies.append(part.reply);
+        part.reply = nullptr;
+    }
+    replies.append(m_controlReply);
+    m_controlReply = nullptr;
+
+    for (QNetworkReply *reply : std::as_const(replies)) {
+        if (reply) {
+            reply->disconnect();
+            reply->abort();
+            reply->deleteLater();
+        }
+    }
+}
+
+void TusUploader::handleFailure(QNetworkReply *reply)
+{
+    const int statusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (isTransient(reply->error(), statusCode)) {
+        scheduleRetry(reply->errorString());
+    } else {
+        fail(reply->errorString());
+    }
+}
+
+void TusUploader::scheduleRetry(const QString &message)
+{
+    stopPipeline();
+    abortRequests();
+    if (m_retryCount >= MAX_RETRIES) {
+        fail(message);
+        return;
+    }
+
+    // A flaky link gets smaller requests, so the next failure costs less
+    m_requestChunks = qMax(1, m_requestChunks / 2);
+    const int delay = qMin(MAX_BACKOFF_MS, INITIAL_BACKOFF_MS << m_retryCount);
+    m_retryCount++;
+    // Jitter keeps parallel uploads from retrying in lockstep
+    const int jittered = delay / 2 + int(QRandomGenerator::global()->bounded(delay / 2 + 1));
+    qWarning() << "Upload interrupted, retry" << m_retryCount << "in" << jittered << "ms:" << message;
+    saveJournal();
+    m_retryTimer->start(jittered);
+}
+
+void TusUploader::fail(const QString &message)
+{
+    // The journal stays: sending the same file again resumes it
+    stopPipeline();
+    abortRequests();
+    saveJournal();
+    emit error(message);
+}
+
+void TusUploader::saveJournal()
+{
+    if (!m_journaled || m_parts.isEmpty()) {
+        return;
+    }
+
+    UploadJournalEntry entry;
+    entry.filePath = m_filePath;
+    entry.endpoint = m_endpoint;
+    entry.fileSize = m_fileSize;
+    entry.modified = m_modified;
+    entry.chunkSize = CHUNK_SIZE;
+    entry.concatenate = m_concatenate;
+    entry.partChunks = m_partChunks;
+    entry.encrypted = m_encryptionEnabled;
+    if (m_encryptionEnabled) {
+        entry.keyHash = QCryptographicHash::hash(m_encryptionKey, QCryptographicHash::Sha256);
+        entry.header = m_stream.header();
+    }
+    for (const Part &part : std::as_const(m_parts)) {
+        entry.partUrls.append(part.url);
+        entry.partOffsets.append(part.confirmed);
+    }
+    UploadJournal::save(entry);
 }
 
-void TusUploader::onChunkUploaded()
+void TusUploader::onRequestUploaded(int partIndex)
 {
-    if (m_reply->error() != QNetworkReply::NoError) {
+    Part &part = m_parts[partIndex];
+    QNetworkReply *reply = part.reply;
+    part.reply = nullptr;
+    part.sending = 0;
+    reply->deleteLater();
+    if (reply->error() != QNetworkReply::NoError) {
         // Error is handled by onUploadError (it could be resumed here)
         return;
     }
 
     // Server MUST return 204 No Content
-    int statusCode = m_reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    int statusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
     if (statusCode != 204) {
-        emit error(QString("Tus: Chunk upload failed. Server responded with %1").arg(statusCode));
-        m_reply->deleteLater();
+        fail(QString("Tus: Chunk upload failed. Server responded with %1").arg(statusCode));
         return;
     }
 
-    if (!m_reply->hasRawHeader("Upload-Offset")) {
-        emit error("Tus: Chunk upload failed. Server did not return Upload-Offset.");
-        m_reply->deleteLater();
+    if (!reply->hasRawHeader("Upload-Offset")) {
+        fail("Tus: Chunk upload failed. Server did not return Upload-Offset.");
         return;
     }
 
-    m_bytesUploaded = m_reply->rawHeader("Upload-Offset").toLongLong();
-    m_reply->deleteLater();
+    part.confirmed = reply->rawHeader("Upload-Offset").toLongLong();
+    m_retryCount = 0;
+    saveJournal();
+    emitProgress();
+    resizeRequests(part.sentBytes, part.sentAt.elapsed());
+    adaptConnections();
 
+    if (part.confirmed < part.length) {
+        // Send the next chunks
+        uploadRequest(partIndex);
+    } else {
+        part.done = true;
+        m_activeParts--;
+    }
+    advance();
+}
 
-    if (m_bytesUploaded == m_fileSize) {
+void TusUploader::advance()
+{
+    if (nextUnstartedPart() >= 0) {
+        // A part finished or the limit went up
+        startParts();
+    } else if (m_activeParts == 0) {
         // We are done!
-        m_file->close();
-        emit uploadProgress(m_fileSize, m_fileSize);
-        // Serialize encryption metadata if encryption was used
-        QByteArray metadata;
-        if (m_encryptionEnabled) {
-            metadata = CryptoManager::serializeMetadata(m_chunkMetadata);
-        }
+        completeUpload();
+    }
+}
+
+void TusUploader::completeUpload()
+{
+    if (m_concatenate) {
+        concatenateParts();
+    } else {
         // --- FIX: Emit the *path* only, not the full URL ---
-        emit finished(m_uploadUrl.path(), m_fileSize, metadata);
+        finishUpload(m_parts.first().url.path());
         // --- END FIX ---
-    } else {
-        // Send the next chunk
-        uploadChunk();
     }
 }
 
-void TusUploader::onUploadError(QNetworkReply::NetworkError code)
+void TusUploader::finishUpload(const QString &uploadPath)
+{
+    UploadJournal::remove(m_filePath, m_endpoint);
+    emit uploadProgress(m_uploadLength, m_uploadLength);
+    emit finished(uploadPath, m_fileSize, m_encryptionEnabled ? m_stream.header() : QByteArray());
+}
+
+void TusUploader::concatenateParts()
+{
+    QByteArray concat("final;");
+    for (int i = 0; i < m_parts.size(); ++i) {
+        if (i > 0) {
+            concat += ' ';
+        }
+        concat += m_parts[i].url.path().toUtf8();
+    }
+
+    QNetworkRequest request(m_endpoint);
+    request.setRawHeader("Tus-Resumable", "1.0.0");
+    request.setRawHeader("Upload-Concat", concat);
+    QString metadata = "filename " + QByteArray(QFileInfo(m_filePath).fileName().toUtf8()).toBase64();
+    request.setRawHeader("Upload-Metadata", metadata.toLocal8Bit());
+
+    m_controlReply = m_manager->post(request, QByteArray());
+    connect(m_controlReply, &QNetworkReply::finished, this, &TusUploader::onConcatenated);
+    connect(m_controlReply, &QNetworkReply::errorOccurred, this, &TusUploader::onUploadError);
+}
+
+void TusUploader::onConcatenated()
+{
+    QNetworkReply *reply = m_controlReply;
+    m_controlReply = nullptr;
+    reply->deleteLater();
+    if (reply->error() != QNetworkReply::NoError) {
+        return;
+    }
+
+    int statusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (statusCode != 201 || !reply->hasRawHeader("Location")) {
+        fail(QString("Tus: Concatenation failed. Server responded with %1").arg(statusCode));
+        return;
+    }
+
+    const QUrl uploadUrl(QString::fromUtf8(reply->rawHeader("Location")));
+    finishUpload(uploadUrl.path());
+}
+
+void TusUploader::adaptConnections()
+{
+    const qint64 elapsed = m_sampleClock.elapsed();
+    if (!m_concatenate || elapsed < SAMPLE_INTERVAL_MS) {
+        return;
+    }
+    const qint64 confirmed = confirmedBytes();
+    const double throughput = double(confirmed - m_sampleBytes) / double(elapsed);
+    m_sampleBytes = confirmed;
+    m_sampleClock.restart();
+
+    if (throughput > m_bestThroughput * 1.1) {
+        // The last connection added paid off, so try one more
+        m_bestThroughput = throughput;
+        m_connectionLimit = qMin(m_connectionLimit + 1, m_maxConnections);
+    } else if (throughput < m_bestThroughput * 0.8 && m_connectionLimit > 1) {
+        // Past the point where the link is full: parts in flight finish,
+        // but fewer get started
+        m_connectionLimit--;
+    }
+}
+
+void TusUploader::resizeRequests(qint64 bytes, qint64 elapsedMs)
+{
+    const double rate = double(bytes) / double(qMax<qint64>(1, elapsedMs));
+    m_rate = m_rate > 0 ? 0.7 * m_rate + 0.3 * rate : rate;
+
+    const double targetMs = qMax<double>(TARGET_REQUEST_MS, ROUND_TRIPS_PER_REQUEST * qMax(0.0, m_roundTripMs));
+    const int wanted = int(qBound(1.0, m_rate * targetMs / CHUNK_SIZE, double(MAX_REQUEST_CHUNKS)));
+    // Every active part holds up to two bodies besides the one in flight
+    const int budget = qMax(1, BUFFER_BUDGET_CHUNKS / (3 * qMax(1, m_activeParts)));
+    // At most double or halve per step; one slow request is not a trend
+    m_requestChunks = qBound(1, qBound(m_requestChunks / 2, wanted, m_requestChunks * 2), budget);
+}
+
+void TusUploader::sampleRoundTrip(qint64 elapsedMs)
+{
+    // The fastest empty request is the closest to the path's own latency
+    if (m_roundTripMs < 0 || elapsedMs < m_roundTripMs) {
+        m_roundTripMs = double(elapsedMs);
+    }
+}
+
+qint64 TusUploader::confirmedBytes() const
+{
+    qint64 confirmed = 0;
+    for (const Part &part : m_parts) {
+        confirmed += part.confirmed;
+    }
+    return confirmed;
+}
+
+void TusUploader::emitProgress()
 {
-    QString errorMsg = m_reply->errorString();
-    emit error(errorMsg);
+    qint64 sent = 0;
+    for (const Part &part : m_parts) {
+        sent += part.confirmed + part.sending;
+    }
+    emit uploadProgress(qMin(sent, m_uploadLength), m_uploadLength);
+}
 
-    if (m_reply) {
-        m_reply->deleteLater();
+qint64 TusUploader::bodyOffset(qint64 index) const
+{
+    if (index <= 0) {
+        return 0;
     }
-    if (m_file && m_file->isOpen()) {
-        m_file->close();
+    if (index >= m_chunkCount) {
+        return m_uploadLength;
     }
-}
\ No newline at end of file
+    return m_encryptionEnabled ? m_stream.chunkOffset(index) : index * qint64(CHUNK_SIZE);
+}
+
+void TusUploader::onUploadError(QNetworkReply::NetworkError code)
+{
+    Q_UNUSED(code);
+    QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
+    if (!reply) {
+        fail("Tus: Upload failed");
+        return;
+    }
+    // Every part stops; a retry picks them all up again
+    handleFailure(reply);
+}
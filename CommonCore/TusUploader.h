@@ -8,56 +8,202 @@
 #include <QNetworkAccessManager>
 #include <QNetworkReply>
 #include <QFileInfo>
-#include <QVector>
+#include <QMap>
+#include <QThreadPool>
+#include <QList>
+#include <QElapsedTimer>
 #include "CryptoManager.h"
+#include "ChunkedStream.h"
+#include "UploadBody.h"
+#include "UploadJournal.h"
+#include <memory>
+
+class QTimer;
 
 class TusUploader : public QObject
 {
     Q_OBJECT
 
 public:
-    explicit TusUploader(QObject *parent = nullptr);
+    // Uploads share manager's connections when one is given
+    explicit TusUploader(QObject *parent = nullptr, QNetworkAccessManager *manager = nullptr);
     ~TusUploader();
 
-    // Call this to start the upload (with optional encryption)
+    // Call this to start the upload (with optional encryption). An upload of
+    // the same unchanged file to the same endpoint that was cut off earlier,
+    // in this run or a previous one, continues from the server's offset.
     void startUpload(const QString &filePath, const QUrl &tusEndpoint, bool encrypt = false);
     
-    // Call this to cancel the upload safely
+    // Call this to cancel the upload safely; it will not be resumed
     void cancelUpload();
 
+    // Pausing drops the connections and keeps the journal; resuming asks
+    // the server where each part stands and carries on from there
+    void pauseUpload();
+    void resumeUpload();
+
     // Set encryption key (must be 32 bytes for AES-256)
     void setEncryptionKey(const QByteArray &key);
 
+    // Large files go up as several partial uploads over parallel connections
+    // when the server supports the tus concatenation extension (default on)
+    void setParallelUploads(bool enabled);
+    // Upper bound for the parallel connections, for sharing the link with
+    // other transfers. Parts in flight finish when it goes down.
+    void setMaxConnections(int connections);
+
 signals:
-    void finished(const QString &uploadUrl, qint64 fileSize, const QByteArray &encryptionMetadata);
+    // encryptionHeader is the fixed-size ChunkedStream header (empty when not
+    // encrypting). The uploaded stream starts with it too; handing it over
+    // separately lets a downloader start at any chunk.
+    void finished(const QString &uploadUrl, qint64 fileSize, const QByteArray &encryptionHeader);
     void error(const QString &errorMessage);
+    // Summed over all parts
     void uploadProgress(qint64 bytesSent, qint64 bytesTotal);
 
 private slots:
-    // Slots for the state machine
-    void onUploadCreated();
-    void onChunkUploaded();
     void onUploadError(QNetworkReply::NetworkError code);
 
 private:
-    void createUpload();
-    void uploadChunk();
+    // A run of whole chunks sent over one connection. Without concatenation
+    // the only part is the upload itself; with it, each part is a partial
+    // upload and the final concat request joins them in order.
+    struct Part {
+        qint64 firstChunk = 0;  // Chunks [firstChunk, endChunk)
+        qint64 endChunk = 0;
+        qint64 length = 0;      // Bytes of the upload stream
+        QUrl url;               // Location given by the server
+        qint64 confirmed = 0;   // Upload-Offset acknowledged by the server
+        qint64 sending = 0;     // Sent so far of the PATCH in flight
+        qint64 nextChunk = 0;   // First chunk of the next request
+        qint64 nextToPrepare = 0;
+        qint64 skip = 0;        // Bytes of the next request the server already has
+        int queued = 0;         // Request bodies prepared or being prepared
+        QNetworkReply *reply = nullptr;
+        QElapsedTimer sentAt;
+        qint64 sentBytes = 0;
+        bool started = false;
+        bool done = false;
+        bool checking = false;  // HEAD in flight, nextChunk unknown
+        bool waitingForChunk = false;
+    };
+
+    struct PreparedRequest {
+        qint64 endChunk = 0;
+        QByteArray body;
+    };
+
+    void probeConcatenation();
+    void planParts(bool concatenate);
+    void layoutParts(qint64 partChunks);
+    // Picks up a journaled upload if it matches the file and settings
+    bool restore(const UploadJournalEntry &entry);
+    // (Re)starts every unfinished part: HEAD for those the server knows,
+    // creation for the rest
+    void resume();
+    void startParts();
+    int nextUnstartedPart() const;
+    void checkOffset(int partIndex);
+    void onOffsetChecked(int partIndex);
+    void seekPart(Part &part, qint64 confirmed);
+    void createPart(int partIndex);
+    void onPartCreated(int partIndex);
+    void uploadRequest(int partIndex);
+    void onRequestUploaded(int partIndex);
+    void advance();
+    void completeUpload();
+    void concatenateParts();
+    void onConcatenated();
+    void finishUpload(const QString &uploadPath);
+    // Hill-climbs m_connectionLimit on the throughput measured between acks
+    void adaptConnections();
+    // Sizes requests from the measured per-connection rate and round trip
+    void resizeRequests(qint64 bytes, qint64 elapsedMs);
+    void sampleRoundTrip(qint64 elapsedMs);
+    void emitProgress();
+    qint64 confirmedBytes() const;
+    // Offset of a chunk's PATCH body in the upload stream; chunk 0 carries
+    // the header when encrypting
+    qint64 bodyOffset(qint64 index) const;
+
+    // Encrypted uploads: keeps the pool sealing the next two request bodies
+    // of every active part, so one is ready when the PATCH in flight returns.
+    // Plain uploads stream each request from a FileWindow instead.
+    void prepareRequests();
+    void onRequestPrepared(quint64 generation, qint64 firstChunk, qint64 endChunk,
+                           QByteArray body, const QString &problem);
+    void stopPipeline();
+    void abortRequests();
+    // Transient failures retry with exponential backoff, the rest fail
+    void handleFailure(QNetworkReply *reply);
+    void scheduleRetry(const QString &message);
+    void fail(const QString &message);
+    void saveJournal();
 
     QNetworkAccessManager *m_manager;
-    QFile *m_file;
+    QString m_filePath;
     qint64 m_fileSize;
-    qint64 m_bytesUploaded;
-    QUrl m_uploadUrl; // The unique URL for this file, given by the tus server
-    QNetworkReply *m_reply;
+    QDateTime m_modified;
+    qint64 m_uploadLength; // Bytes on the server: m_fileSize plus header and tags when encrypting
+    QUrl m_endpoint;
+    QNetworkReply *m_controlReply; // Capability probe or final concat
+
+    QList<Part> m_parts;
+    qint64 m_partChunks;
+    int m_activeParts;
+    int m_connectionLimit;
+    int m_maxConnections;
+    bool m_parallelEnabled;
+    bool m_concatenate;
+    QElapsedTimer m_sampleClock;
+    qint64 m_sampleBytes;
+    double m_bestThroughput; // Bytes per ms at the best limit tried so far
+    bool m_journaled;        // Single-chunk uploads gain nothing from it
+    bool m_paused;
+    int m_retryCount;        // Failures since the last acknowledged request
+    QTimer *m_retryTimer;
+    int m_requestChunks;     // Chunks per PATCH, adapted as the upload goes
+    double m_rate;           // Bytes per ms of one PATCH, smoothed
+    double m_roundTripMs;    // Fastest bodiless request seen, -1 before any
+    // Shared with the bodies in flight, which may outlive this uploader
+    std::shared_ptr<UploadBufferPool> m_buffers;
 
     // Encryption support
     bool m_encryptionEnabled;
     QByteArray m_encryptionKey;
-    QVector<ChunkMetadata> m_chunkMetadata;
-    qint64 m_currentChunkIndex;
+    ChunkedStream m_stream;
+    qint64 m_chunkCount;
+    QMap<qint64, PreparedRequest> m_preparedRequests; // PATCH bodies by first chunk
+    quint64 m_generation; // Drops results of jobs started before a cancel or restart
+    QThreadPool m_pool;
 
-    // You can adjust this, e.g., 5MB chunks
-    static const int CHUNK_SIZE = 5 * 1024 * 1024;
+    // Unit of reading, sealing and resuming. The stream header records it,
+    // so downloads never depend on this value; PATCH requests carry a run of
+    // whole chunks.
+    static const int CHUNK_SIZE = 1024 * 1024;
+    static const int MAX_PREPARE_THREADS = 4;
+    // Request sizing: long enough that the round trip costs under a tenth of
+    // each request and at least TARGET_REQUEST_MS of sending, short enough
+    // that a failure resends little. Prepared and in-flight bodies of all
+    // parts stay within BUFFER_BUDGET_CHUNKS.
+    static const int INITIAL_REQUEST_CHUNKS = 4;
+    static const int MAX_REQUEST_CHUNKS = 32;
+    static const int BUFFER_BUDGET_CHUNKS = 96;
+    static const int TARGET_REQUEST_MS = 500;
+    static const int ROUND_TRIPS_PER_REQUEST = 10;
+    // Parallel mode: files of at least MIN_PARALLEL_CHUNKS chunks, split into
+    // at most MAX_PARTS partial uploads over up to MAX_CONNECTIONS connections
+    // (Qt's per-host limit for HTTP/1.1)
+    static const int MIN_PARALLEL_CHUNKS = 16;
+    static const int MIN_PART_CHUNKS = 8;
+    static const int MAX_PARTS = 32;
+    static const int MAX_CONNECTIONS = 6;
+    static const int SAMPLE_INTERVAL_MS = 1000;
+    // Backoff doubles from INITIAL_BACKOFF_MS up to MAX_BACKOFF_MS; a few
+    // minutes in all before the upload gives up
+    static const int MAX_RETRIES = 8;
+    static const int INITIAL_BACKOFF_MS = 1000;
+    static const int MAX_BACKOFF_MS = 60000;
 };
 
 #endif // TUSUPLOADER_H
@@ -0,0 +1,102 @@
+#include "UploadBody.h"
+#include <algorithm>
+#include <utility>
+
+FileWindow::FileWindow(const QString &path, qint64 offset, qint64 length, QObject *parent)
+    : QIODevice(parent)
+    , m_file(path)
+    , m_offset(offset)
+    , m_length(length)
+{
+}
+
+bool FileWindow::open(OpenMode mode)
+{
+    if ((mode & WriteOnly) || !m_file.open(QIODevice::ReadOnly) || !m_file.seek(m_offset)) {
+        return false;
+    }
+    // QIODevice's own buffer would only add a copy
+    return QIODevice::open(mode | Unbuffered);
+}
+
+void FileWindow::close()
+{
+    QIODevice::close();
+    m_file.close();
+}
+
+bool FileWindow::seek(qint64 pos)
+{
+    if (pos < 0 || pos > m_length || !QIODevice::seek(pos)) {
+        return false;
+    }
+    return m_file.seek(m_offset + pos);
+}
+
+qint64 FileWindow::readData(char *data, qint64 maxSize)
+{
+    const qint64 remaining = m_offset + m_length - m_file.pos();
+    if (remaining <= 0) {
+        return 0;
+    }
+    return m_file.read(data, qMin(maxSize, remaining));
+}
+
+qint64 FileWindow::writeData(const char *data, qint64 maxSize)
+{
+    Q_UNUSED(data);
+    Q_UNUSED(maxSize);
+    return -1;
+}
+
+QByteArray UploadBufferPool::acquire(qsizetype size)
+{
+    // Smallest free buffer that fits, so big ones stay for big requests
+    int best = -1;
+    for (int i = 0; i < m_free.size(); ++i) {
+        const qsizetype capacity = m_free.at(i).capacity();
+        if (capacity >= size && (best < 0 || capacity < m_free.at(best).capacity())) {
+            best = i;
+        }
+    }
+    if (best < 0) {
+        return QByteArray(size, Qt::Uninitialized);
+    }
+
+    QByteArray buffer = m_free.takeAt(best);
+    // Within capacity and unshared: no reallocation
+    buffer.resize(size);
+    return buffer;
+}
+
+void UploadBufferPool::release(QByteArray buffer)
+{
+    // A buffer Qt still holds a reference to would be copied on first write
+    if (buffer.isNull() || !buffer.isDetached()) {
+        return;
+    }
+    if (m_free.size() >= MaxFree) {
+        // Drop the smallest; requests only grow back from there
+        auto smallest = std::min_element(m_free.begin(), m_free.end(), [](const QByteArray &a, const QByteArray &b) {
+            return a.capacity() < b.capacity();
+        });
+        if (smallest->capacity() >= buffer.capacity()) {
+            return;
+        }
+        m_free.erase(smallest);
+    }
+    m_free.append(std::move(buffer));
+}
+
+PooledBody::PooledBody(QByteArray body, std::shared_ptr<UploadBufferPool> pool, QObject *parent)
+    : QBuffer(parent)
+    , m_pool(std::move(pool))
+{
+    buffer() = std::move(body);
+}
+
+PooledBody::~PooledBody()
+{
+    close();
+    m_pool->release(std::exchange(buffer(), QByteArray()));
+}
@@ -0,0 +1,69 @@
+#ifndef UPLOADBODY_H
+#define UPLOADBODY_H
+
+#include <QBuffer>
+#include <QByteArray>
+#include <QFile>
+#include <QIODevice>
+#include <QList>
+#include <memory>
+
+// PATCH bodies for TusUploader that QNetworkAccessManager reads in place.
+
+// Read-only view of [offset, offset + length) of a file. A plain upload
+// streams each request from disk through one of these instead of reading it
+// into memory first.
+class FileWindow : public QIODevice
+{
+    Q_OBJECT
+
+public:
+    FileWindow(const QString &path, qint64 offset, qint64 length, QObject *parent = nullptr);
+
+    bool open(OpenMode mode) override;
+    void close() override;
+    bool isSequential() const override { return false; }
+    qint64 size() const override { return m_length; }
+    bool seek(qint64 pos) override;
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override;
+    qint64 writeData(const char *data, qint64 maxSize) override;
+
+private:
+    QFile m_file;
+    qint64 m_offset;
+    qint64 m_length;
+};
+
+// Free list of body buffers for encrypted uploads. GUI thread only; the pool
+// jobs fill buffers they were handed. A steady upload cycles through the
+// same few buffers instead of allocating one per request.
+class UploadBufferPool
+{
+public:
+    static constexpr int MaxFree = 16;
+
+    // A buffer of exactly size bytes, reused when a free one has the capacity
+    QByteArray acquire(qsizetype size);
+    void release(QByteArray buffer);
+
+private:
+    QList<QByteArray> m_free;
+};
+
+// Body of one encrypted request. QNetworkAccessManager reads QBuffers
+// without copying; the buffer goes back to the pool with the reply.
+class PooledBody : public QBuffer
+{
+    Q_OBJECT
+
+public:
+    PooledBody(QByteArray body, std::shared_ptr<UploadBufferPool> pool, QObject *parent = nullptr);
+    ~PooledBody() override;
+
+private:
+    std::shared_ptr<UploadBufferPool> m_pool;
+};
+
+#endif // UPLOADBODY_H
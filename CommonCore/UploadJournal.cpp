@@ -0,0 +1,146 @@
+#include "UploadJournal.h"
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+namespace {
+
+QJsonObject toJson(const UploadJournalEntry &entry)
+{
+    QJsonObject obj;
+    obj["file"] = entry.filePath;
+    obj["endpoint"] = entry.endpoint.toString();
+    obj["size"] = entry.fileSize;
+    obj["modified"] = entry.modified.toMSecsSinceEpoch();
+    obj["chunkSize"] = entry.chunkSize;
+    obj["concatenate"] = entry.concatenate;
+    obj["partChunks"] = entry.partChunks;
+    obj["encrypted"] = entry.encrypted;
+    if (entry.encrypted) {
+        obj["keyHash"] = QString::fromLatin1(entry.keyHash.toBase64());
+        obj["header"] = QString::fromLatin1(entry.header.toBase64());
+    }
+
+    QJsonArray parts;
+    for (int i = 0; i < entry.partUrls.size(); ++i) {
+        QJsonObject part;
+        part["url"] = entry.partUrls.at(i).toString();
+        part["offset"] = entry.partOffsets.value(i);
+        parts.append(part);
+    }
+    obj["parts"] = parts;
+    obj["updated"] = entry.updated.toMSecsSinceEpoch();
+    return obj;
+}
+
+UploadJournalEntry fromJson(const QJsonObject &obj)
+{
+    UploadJournalEntry entry;
+    entry.filePath = obj["file"].toString();
+    entry.endpoint = QUrl(obj["endpoint"].toString());
+    entry.fileSize = obj["size"].toInteger();
+    entry.modified = QDateTime::fromMSecsSinceEpoch(obj["modified"].toInteger());
+    entry.chunkSize = obj["chunkSize"].toInt();
+    entry.concatenate = obj["concatenate"].toBool();
+    entry.partChunks = obj["partChunks"].toInteger();
+    entry.encrypted = obj["encrypted"].toBool();
+    entry.keyHash = QByteArray::fromBase64(obj["keyHash"].toString().toLatin1());
+    entry.header = QByteArray::fromBase64(obj["header"].toString().toLatin1());
+
+    const QJsonArray parts = obj["parts"].toArray();
+    for (const QJsonValue &value : parts) {
+        const QJsonObject part = value.toObject();
+        entry.partUrls.append(QUrl(part["url"].toString()));
+        entry.partOffsets.append(part["offset"].toInteger());
+    }
+    entry.updated = QDateTime::fromMSecsSinceEpoch(obj["updated"].toInteger());
+    return entry;
+}
+
+bool sameUpload(const UploadJournalEntry &entry, const QString &filePath, const QUrl &endpoint)
+{
+    return entry.filePath == filePath && entry.endpoint == endpoint;
+}
+
+}
+
+QString UploadJournal::journalPath()
+{
+    const QString dir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+    QDir().mkpath(dir);
+    return QDir(dir).filePath("uploads.json");
+}
+
+QList<UploadJournalEntry> UploadJournal::entries()
+{
+    QList<UploadJournalEntry> result;
+    QFile file(journalPath());
+    if (!file.open(QIODevice::ReadOnly)) {
+        return result;
+    }
+
+    const QDateTime oldest = QDateTime::currentDateTimeUtc().addDays(-MaxAgeDays);
+    const QJsonArray array = QJsonDocument::fromJson(file.readAll()).array();
+    for (const QJsonValue &value : array) {
+        UploadJournalEntry entry = fromJson(value.toObject());
+        if (!entry.filePath.isEmpty() && entry.updated >= oldest) {
+            result.append(entry);
+        }
+    }
+    return result;
+}
+
+bool UploadJournal::find(const QString &filePath, const QUrl &endpoint, UploadJournalEntry &entry)
+{
+    const QList<UploadJournalEntry> all = entries();
+    for (const UploadJournalEntry &candidate : all) {
+        if (sameUpload(candidate, filePath, endpoint)) {
+            entry = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+void UploadJournal::save(const UploadJournalEntry &entry)
+{
+    QList<UploadJournalEntry> all = entries();
+    all.removeIf([&entry](const UploadJournalEntry &candidate) {
+        return sameUpload(candidate, entry.filePath, entry.endpoint);
+    });
+    UploadJournalEntry updated = entry;
+    updated.updated = QDateTime::currentDateTimeUtc();
+    all.append(updated);
+    write(all);
+}
+
+void UploadJournal::remove(const QString &filePath, const QUrl &endpoint)
+{
+    QList<UploadJournalEntry> all = entries();
+    if (all.removeIf([&](const UploadJournalEntry &candidate) {
+            return sameUpload(candidate, filePath, endpoint);
+        }) > 0) {
+        write(all);
+    }
+}
+
+void UploadJournal::write(const QList<UploadJournalEntry> &entries)
+{
+    QJsonArray array;
+    for (const UploadJournalEntry &entry : entries) {
+        array.append(toJson(entry));
+    }
+
+    // A crash mid-write leaves the previous journal, never half of one
+    QSaveFile file(journalPath());
+    if (!file.open(QIODevice::WriteOnly)
+        || file.write(QJsonDocument(array).toJson(QJsonDocument::Compact)) < 0
+        || !file.commit()) {
+        qWarning() << "Failed to write upload journal:" << file.errorString();
+    }
+}
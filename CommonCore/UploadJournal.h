@@ -0,0 +1,49 @@
+#ifndef UPLOADJOURNAL_H
+#define UPLOADJOURNAL_H
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QList>
+#include <QString>
+#include <QUrl>
+
+// One unfinished upload as TusUploader last saw it. The server's offsets are
+// authoritative; the saved ones only say how far the upload had got.
+struct UploadJournalEntry {
+    QString filePath;
+    QUrl endpoint;
+    qint64 fileSize = 0;
+    QDateTime modified;       // The file's mtime when the upload started
+    int chunkSize = 0;
+    bool concatenate = false; // Partial uploads joined by a final concat
+    qint64 partChunks = 0;    // Chunks per part
+    bool encrypted = false;
+    QByteArray keyHash;       // SHA-256 of the stream key; the key is never written
+    QByteArray header;        // Stream header, to re-seal identical chunks
+    QList<QUrl> partUrls;     // Empty until the part was created
+    QList<qint64> partOffsets;
+    QDateTime updated;
+};
+
+// Small JSON file in the app data directory listing unfinished uploads, one
+// per (file, endpoint). Read and rewritten whole on every change; it holds a
+// handful of entries. GUI thread only.
+class UploadJournal
+{
+public:
+    // Entries untouched for longer are dropped; the server has likely
+    // expired the upload by then
+    static constexpr int MaxAgeDays = 7;
+
+    static QList<UploadJournalEntry> entries();
+    static bool find(const QString &filePath, const QUrl &endpoint, UploadJournalEntry &entry);
+    // Replaces the entry for the same file and endpoint
+    static void save(const UploadJournalEntry &entry);
+    static void remove(const QString &filePath, const QUrl &endpoint);
+
+private:
+    static QString journalPath();
+    static void write(const QList<UploadJournalEntry> &entries);
+};
+
+#endif // UPLOADJOURNAL_H
@@ -0,0 +1,100 @@
+#ifndef WIREPROTOCOL_H
+#define WIREPROTOCOL_H
+
+#include <QLatin1String>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QStringList>
+
+// Control messages exchanged between WebSocketClient and the server's
+// connection shards. They are consumed by the transport and never reach the
+// controllers.
+//
+// Negotiation: after connecting, a client sends a "hello" listing the
+// capabilities it understands over the legacy text path. The server answers
+// with a "welcome" carrying the subset it agreed to. Peers that never send a
+// hello (older clients) stay on base64 text frames forever.
+//
+// Until the welcome, and for good with peers that never negotiate, both
+// sides send the legacy IV|tag|ciphertext envelope: AES-GCM, uncompressed.
+// The "envelope" capability offers the versioned envelope (see
+// CryptoManager); everything below builds on it and is ignored without it.
+//
+// The hello may also carry "ciphers", the AEAD suites the client supports in
+// its order of preference; the welcome answers with the chosen "cipher".
+// Both hello and welcome list the "codecs" their sender can inflate, and each
+// side compresses only with a codec the other listed.
+//
+// A base64 "salt" in the hello offers counter-nonce envelopes (see
+// MessageSession). A server that agrees answers with a "salt" of its own,
+// fresh for this connection, and the "stream" id of its sending side; from
+// then on each side sends session
+// envelopes, and drops incoming ones that replay or reorder as well as any
+// other format. So the client holds its messages between hello and welcome,
+// and the server queues the welcome behind frames still in the old format.
+namespace WireProtocol {
+
+inline constexpr QLatin1String TypeHello("hello");
+inline constexpr QLatin1String TypeWelcome("welcome");
+// Latency probe: the server answers a ping with a pong echoing "seq" and
+// "sent" through the connection's normal outbound queue, so the round trip
+// includes any queueing and batching delay. The pong also reports the
+// connection's server-side "queued" frames and "dropped" count. Pongs are
+// ephemeral: a newer one replaces one still queued.
+inline constexpr QLatin1String TypePing("ping");
+inline constexpr QLatin1String TypePong("pong");
+
+// Raw IV|tag|ciphertext in binary WebSocket frames instead of base64 text
+inline constexpr QLatin1String CapBinary("binary");
+// A frame's plaintext may be a JSON array of messages sent in the same tick
+inline constexpr QLatin1String CapBatch("batch");
+// version|flags envelopes carrying the cipher and codec
+inline constexpr QLatin1String CapEnvelope("envelope");
+
+inline QJsonObject makeControlMessage(QLatin1String type, const QStringList &capabilities)
+{
+    QJsonObject obj;
+    obj["type"] = QString(type);
+    obj["capabilities"] = QJsonArray::fromStringList(capabilities);
+    return obj;
+}
+
+inline QStringList capabilitiesOf(const QJsonObject &controlMessage)
+{
+    QStringList capabilities;
+    const QJsonArray array = controlMessage["capabilities"].toArray();
+    for (const QJsonValue &value : array) {
+        capabilities.append(value.toString());
+    }
+    return capabilities;
+}
+
+inline QStringList ciphersOf(const QJsonObject &hello)
+{
+    QStringList ciphers;
+    const QJsonArray array = hello["ciphers"].toArray();
+    for (const QJsonValue &value : array) {
+        ciphers.append(value.toString());
+    }
+    return ciphers;
+}
+
+inline QStringList codecsOf(const QJsonObject &controlMessage)
+{
+    QStringList codecs;
+    const QJsonArray array = controlMessage["codecs"].toArray();
+    for (const QJsonValue &value : array) {
+        codecs.append(value.toString());
+    }
+    return codecs;
+}
+
+inline bool isControlType(const QString &type)
+{
+    return type == TypeHello || type == TypeWelcome
+        || type == TypePing || type == TypePong;
+}
+
+} // namespace WireProtocol
+
+#endif // WIREPROTOCOL_H
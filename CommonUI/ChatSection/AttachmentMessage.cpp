@@ -1,5 +1,5 @@
 #include "AttachmentMessage.h"
-#include "TusDownloader.h"
+#include "TransferScheduler.h"
 
 #include <QCoreApplication>
 #include <QDesktopServices>
@@ -18,7 +18,6 @@ AttachmentMessage::AttachmentMessage(const QString &fileName,
                                      const QString &serverHost,
                                      QWidget *parent)
     : MessageComponent(senderInfo, direction, parent)
-    , m_tusDownloader(new TusDownloader(this))
     , m_fileUrl(fileUrl)
     , m_fileName(fileName)
     , m_fileSize(fileSize)
@@ -26,20 +25,48 @@ AttachmentMessage::AttachmentMessage(const QString &fileName,
     , m_serverHost(serverHost)
     , m_isDownloaded(false)
 {
-    connect(m_tusDownloader, &TusDownloader::finished, this, &AttachmentMessage::onDownloadFinished);
-    connect(m_tusDownloader, &TusDownloader::error, this, &AttachmentMessage::onDownloadError);
 }
 
-AttachmentMessage::~AttachmentMessage() = default;
+AttachmentMessage::~AttachmentMessage()
+{
+    // Nobody is left to show a download; uploads belong to the chat window
+    if (m_transfer && m_transfer->kind() == TransferJob::Kind::Download) {
+        m_transfer->cancel();
+    }
+}
 
 void AttachmentMessage::setFileUrl(const QString &fileUrl)
 {
     m_fileUrl = fileUrl;
 }
 
+void AttachmentMessage::setTransfer(TransferJob *job)
+{
+    m_transfer = job;
+}
+
+bool AttachmentMessage::toggleTransfer()
+{
+    if (!m_transfer) {
+        return false;
+    }
+    if (m_transfer->state() == TransferJob::State::Paused) {
+        m_transfer->resume();
+    } else {
+        m_transfer->pause();
+    }
+    return true;
+}
+
+TransferPriority AttachmentMessage::transferPriority() const
+{
+    return TransferScheduler::priorityFor(m_fileName);
+}
+
 void AttachmentMessage::startDownload()
 {
-    if (m_fileUrl.isEmpty()) {
+    // Already queued or running
+    if (m_fileUrl.isEmpty() || m_transfer) {
         return;
     }
 
@@ -73,7 +100,14 @@ void AttachmentMessage::startDownload()
 
     setInProgressState(0, m_fileSize);
 
-    m_tusDownloader->startDownload(QUrl(downloadUrlString), m_localFilePath);
+    TransferJob *job = TransferScheduler::instance().submitDownload(QUrl(downloadUrlString), m_localFilePath,
+                                                                    transferPriority());
+    connect(job, &TransferJob::progress, this, &AttachmentMessage::setInProgressState);
+    connect(job, &TransferJob::finished, this, [this](const QString &filePath) {
+        onDownloadFinished(filePath);
+    });
+    connect(job, &TransferJob::error, this, &AttachmentMessage::onDownloadError);
+    m_transfer = job;
 }
 
 void AttachmentMessage::onDownloadFinished(const QString &filePath)
@@ -3,10 +3,12 @@
 
 #include "MessageComponent.h"
 #include <QPixmap>
+#include <QPointer>
 #include <QFileIconProvider>
 
 // Forward declaration to avoid heavy includes
-class TusDownloader;
+class TransferJob;
+enum class TransferPriority;
 
 class AttachmentMessage : public MessageComponent
 {
@@ -20,6 +22,10 @@ public:
     // Public method to set/update file URL after upload completes
     void setFileUrl(const QString &fileUrl);
 
+    // The upload of this message's file, so clicking the card pauses and
+    // resumes it
+    void setTransfer(TransferJob *job);
+
 protected:
     // Pure virtual methods - children must implement their own UI
     virtual void setupUI() = 0;
@@ -29,6 +35,8 @@ protected:
     virtual void setInProgressState(qint64 bytes, qint64 total) = 0; // e.g., show ProgressBar
     virtual void setCompletedState() = 0;  // e.g., show "Open" button
     virtual void onClicked() = 0;
+    // Class the file's download is queued in
+    virtual TransferPriority transferPriority() const;
 
 protected slots:
     virtual void onDownloadFinished(const QString &filePath);
@@ -39,10 +47,12 @@ protected:
     QString formatSize(qint64 bytes);
     QPixmap getFileIconPixmap(const QString &fileName);
     void startDownload();
+    // Pauses or resumes the transfer in progress; false when there is none
+    bool toggleTransfer();
     void openFile(const QString& customPath = ""); // Custom path for voice files
 
     // Common members
-    TusDownloader *m_tusDownloader;
+    QPointer<TransferJob> m_transfer; // Queued with TransferScheduler, which owns it
     QString m_fileUrl;
     QString m_fileName;
     qint64 m_fileSize;
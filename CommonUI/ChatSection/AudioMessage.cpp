@@ -1,6 +1,6 @@
 #include "AudioMessage.h"
 #include "AudioWaveform.h"
-#include "TusDownloader.h"
+#include "TransferScheduler.h"
 
 #include <QHBoxLayout>
 #include <QUrl>
@@ -57,13 +57,18 @@ AudioMessage::AudioMessage(const QString &fileName,
 #endif
 
     connect(m_waveformGenerator, &AudioWaveform::waveformReady, this, &AudioMessage::onWaveformReady);
-    connect(m_tusDownloader, &TusDownloader::downloadProgress, this, &AudioMessage::setInProgressState);
 
     setupUI();
 }
 
 AudioMessage::~AudioMessage() = default;
 
+TransferPriority AudioMessage::transferPriority() const
+{
+    // Voice notes go ahead of every file
+    return TransferPriority::Voice;
+}
+
 void AudioMessage::setupUI()
 {
     delete layout();
@@ -177,6 +182,9 @@ void AudioMessage::markAsSent()
 
 void AudioMessage::onClicked()
 {
+    if (toggleTransfer()) {
+        return;
+    }
     if (m_isDownloaded) {
         onPlayPauseClicked();
     } else {
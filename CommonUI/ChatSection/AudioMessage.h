@@ -50,6 +50,7 @@ protected:
     void setupUI() override;
     void setIdleState() override;
     void onClicked() override;
+    TransferPriority transferPriority() const override;
 #if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
     void enterEvent(QEnterEvent *event) override;
 #else
@@ -1,5 +1,4 @@
 #include "FileMessage.h"
-#include "TusDownloader.h"
 
 #include <QDateTime>
 #include <QHBoxLayout>
@@ -31,7 +30,6 @@ FileMessage::FileMessage(const QString &fileName,
     m_timestamp = timestamp;
     setAttribute(Qt::WA_Hover);
     setMouseTracking(true);
-    connect(m_tusDownloader, &TusDownloader::downloadProgress, this, &FileMessage::setInProgressState);
     setupUI();
 }
 
@@ -156,6 +154,9 @@ void FileMessage::setCompletedState()
 
 void FileMessage::onClicked()
 {
+    if (toggleTransfer()) {
+        return;
+    }
     if (m_isDownloaded) {
         openFile();
     } else {
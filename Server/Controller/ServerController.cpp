@@ -2,10 +2,12 @@
 #include "View/ServerChatWindow.h"
 #include "Model/Network/WebSocketServer.h"
 #include "Model/Core/DatabaseManager.h"
+#include "Model/Core/ChatRouter.h"
 #include "MessageAliases.h"
 #include "MessageComponent.h"
 #include "MessageData.h"
-#include "../../CommonCore/NotificationManager.h"
+#include "NotificationManager.h"
+#include "NetworkIdentity.h"
 
 #include <QDateTime>
 #include <QJsonDocument>
@@ -19,8 +21,6 @@
 #include <QRegularExpression>
 
 namespace {
-constexpr int kMaxMessageLength = 1800;
-
 // Helper function to convert between MessageType and MessageDirection
 inline MessageDirection messageTypeToDirection(BaseChatWindow::MessageType type) {
     return (type == BaseChatWindow::MessageType::Sent) 
@@ -29,12 +29,14 @@ inline MessageDirection messageTypeToDirection(BaseChatWindow::MessageType type)
 }
 }
 
-ServerController::ServerController(ServerChatWindow *view, WebSocketServer *server, DatabaseManager *db, QObject *parent)
+ServerController::ServerController(ServerChatWindow *view, ChatRouter *router, QObject *parent)
     : QObject(parent)
     , m_serverView(view)
-    , m_server(server)
-    , m_db(db)
+    , m_router(router)
+    , m_server(router ? router->server() : nullptr)
+    , m_db(router ? router->database() : nullptr)
     , m_isBroadcastMode(true)
+    , m_presenceVersion(0)
 {
     if (m_serverView) {
         // FIX: Use sendMessageRequested instead of messageSent
@@ -46,10 +48,18 @@ ServerController::ServerController(ServerChatWindow *view, WebSocketServer *serv
     } else {
     }
 
+    if (m_router) {
+        connect(m_router, &ChatRouter::messageStored, this, &ServerController::onClientMessageStored);
+        connect(m_router, &ChatRouter::messageEdited, this, &ServerController::onClientMessageEdited);
+        connect(m_router, &ChatRouter::messageDeleted, this, &ServerController::onClientMessageDeleted);
+    }
+
     if (m_server) {
-        connect(m_server, &WebSocketServer::messageReceived, this, &ServerController::onServerMessageReceived);
-        connect(m_server, &WebSocketServer::userListChanged, this, &ServerController::onUserListChanged);
+        connect(m_server, &WebSocketServer::userJoined, this, &ServerController::onUserJoined);
+        connect(m_server, &WebSocketServer::userLeft, this, &ServerController::onUserLeft);
+        connect(m_server, &WebSocketServer::userUpdated, this, &ServerController::onUserUpdated);
         connect(m_server, &WebSocketServer::userCountChanged, this, &ServerController::onUserCountChanged);
+        syncPresence();
     } else {
     }
 
@@ -75,7 +85,7 @@ void ServerController::updateUserCard(const QString &userId, const QString &prev
 
 QWidget* ServerController::createWidgetFromData(const MessageData &msgData)
 {
-    QString serverHost = m_server ? m_server->getServerIpAddress() : "localhost";
+    const QString serverHost = NetworkIdentity::instance().advertisedHost();
 
     auto messageType = (msgData.senderType == MessageData::User_Me)
                            ? BaseChatWindow::MessageType::Sent
@@ -187,41 +197,19 @@ void ServerController::displayNewMessages(const QString &message)
     msgData.timestamp = QDateTime::currentDateTime().toString("hh:mm");
     msgData.isFileMessage = false;
 
-    QStringList chunks = splitMessageIntoChunks(message);
-    QString isoTimestamp = QDateTime::currentDateTime().toString(Qt::ISODate);
-    
-    for (const QString &chunk : chunks) {
+    const QString target = currentTarget();
+    const QStringList chunks = ChatRouter::splitMessageIntoChunks(message);
+    const QList<int> ids = m_router ? m_router->sendText(target, message) : QList<int>();
+
+    for (int i = 0; i < chunks.size(); ++i) {
         MessageData chunkData = msgData;
-        chunkData.text = chunk;
+        chunkData.text = chunks.at(i);
         chunkData.isEdited = false;
-        chunkData.databaseId = -1;
-        
-        QString jsonMessage = QString(R"({"type":"text","content":"%1","sender":"Server","timestamp":"%2"})")
-                                  .arg(chunk)
-                                  .arg(isoTimestamp);
-    
-        if (m_isBroadcastMode || m_currentPrivateTargetUser.isEmpty()) {
-            if (m_server) {
-                m_server->broadcastToAll(jsonMessage);
-            }
-            
-            if (m_db) {
-                chunkData.databaseId = m_db->saveMessage("Server", "ALL", chunk, QDateTime::currentDateTime(), false);
-            }
-    
-        } else {
-            QString cleanUserId = m_currentPrivateTargetUser.split(" - ").first().trimmed();
-            
-            if (m_server) {
-                m_server->sendMessageToClient(cleanUserId, jsonMessage);
-            }
-            
-            if (m_db) {
-                chunkData.databaseId = m_db->saveMessage("Server", cleanUserId, chunk, QDateTime::currentDateTime(), false);
-            }
-            
-            QString preview = "You: " + chunk;
-            updateUserCard(cleanUserId, preview, msgData.timestamp, 0);
+        chunkData.databaseId = ids.value(i, -1);
+
+        if (target != ChatRouter::broadcastTarget()) {
+            QString preview = "You: " + chunkData.text;
+            updateUserCard(target, preview, msgData.timestamp, 0);
         }
         
         QWidget* itemWidget = createWidgetFromData(chunkData);
@@ -244,7 +232,7 @@ void ServerController::displayFileMessage(const QString &fileName, qint64 fileSi
     auto direction = messageTypeToDirection(type);
     
     if (m_serverView) {
-        QString serverHost = m_server ? m_server->getServerIpAddress() : "localhost";
+        const QString serverHost = NetworkIdentity::instance().advertisedHost();
         FileMessageItem *fileItem = new FileMessageItem(
             fileName,
             fileSize,
@@ -259,25 +247,86 @@ void ServerController::displayFileMessage(const QString &fileName, qint64 fileSi
     }
 }
 
-void ServerController::onUserListChanged(const QStringList &users)
+void ServerController::onUserJoined(const PresenceEntry &user, quint64 version)
 {
-    if (m_serverView) {
-        m_serverView->updateUserList(users);
-        
-        // Restore state for each user
-        for (const QString &user : users) {
-            // Extract clean user ID (e.g. "User #1" from "User #1 - 127.0.0.1")
-            QString cleanUser = user.split(" - ").first().trimmed();
-            
-            QString preview = m_lastMessages.value(cleanUser, "Click to open chat");
-            QString time = m_lastTimestamps.value(cleanUser, "");
-            int unread = m_unreadCounts.value(cleanUser, 0);
-            
-            // If we have stored data, update the card
-            if (m_lastMessages.contains(cleanUser) || m_unreadCounts.contains(cleanUser)) {
-                 m_serverView->updateUserCardInfo(user, preview, time, unread);
-            }
+    if (!acceptPresenceVersion(version) || !m_serverView) {
+        return;
+    }
+
+    m_serverView->addUser(user.displayName());
+    restoreUserCard(user.displayName());
+}
+
+void ServerController::onUserLeft(const QString &userId, quint64 version)
+{
+    if (!acceptPresenceVersion(version) || !m_serverView) {
+        return;
+    }
+
+    m_serverView->removeUser(userId);
+}
+
+void ServerController::onUserUpdated(const PresenceEntry &user, quint64 version)
+{
+    if (!acceptPresenceVersion(version) || !m_serverView) {
+        return;
+    }
+
+    m_serverView->updateUser(user.userId, user.displayName(), !user.congested);
+}
+
+bool ServerController::acceptPresenceVersion(quint64 version)
+{
+    if (version <= m_presenceVersion) {
+        return false; // Already part of the snapshot we hold
+    }
+    if (version != m_presenceVersion + 1) {
+        syncPresence();
+        return false;
+    }
+    m_presenceVersion = version;
+    return true;
+}
+
+void ServerController::syncPresence()
+{
+    if (!m_server) {
+        return;
+    }
+
+    const PresenceSnapshot snapshot = m_server->presenceSnapshot();
+    m_presenceVersion = snapshot.version;
+
+    if (!m_serverView) {
+        return;
+    }
+
+    QStringList users;
+    users.reserve(snapshot.users.size());
+    for (const PresenceEntry &user : snapshot.users) {
+        users.append(user.displayName());
+    }
+    m_serverView->updateUserList(users);
+
+    for (const PresenceEntry &user : snapshot.users) {
+        if (user.congested) {
+            m_serverView->updateUser(user.userId, user.displayName(), false);
         }
+        restoreUserCard(user.displayName());
+    }
+}
+
+void ServerController::restoreUserCard(const QString &user)
+{
+    // Extract clean user ID (e.g. "User #1" from "User #1 - 127.0.0.1")
+    QString cleanUser = user.split(" - ").first().trimmed();
+
+    // If we have stored data, update the card
+    if (m_lastMessages.contains(cleanUser) || m_unreadCounts.contains(cleanUser)) {
+        QString preview = m_lastMessages.value(cleanUser, "Click to open chat");
+        QString time = m_lastTimestamps.value(cleanUser, "");
+        int unread = m_unreadCounts.value(cleanUser, 0);
+        m_serverView->updateUserCardInfo(user, preview, time, unread);
     }
 }
 
@@ -322,17 +371,31 @@ void ServerController::onUserSelected(const QString &userId)
     }
 }
 
-void ServerController::onServerMessageReceived(const QString &message, const QString &senderId)
+void ServerController::onClientMessageDeleted(int messageId, const QString &senderId)
 {
-    // 1. Parse JSON
-    QJsonDocument doc = QJsonDocument::fromJson(message.toUtf8());
-    if (!doc.isObject()) {
-        return;
+    if (m_serverView) {
+        // First try to find by database ID
+        m_serverView->removeMessageByDatabaseId(messageId);
+
+        // If not found by ID, try to remove last message from sender
+        m_serverView->removeLastMessageFromSender(senderId);
     }
-    
-    QJsonObject obj = doc.object();
-    
-    // 2. Create MessageData object (Model)
+}
+
+void ServerController::onClientMessageEdited(int messageId, const QString &newText, const QString &senderId)
+{
+    if (m_serverView) {
+        // First try to find by database ID
+        m_serverView->updateMessageByDatabaseId(messageId, newText);
+
+        // If not found by ID, try to update last message from sender
+        m_serverView->updateLastMessageFromSender(senderId, newText);
+    }
+}
+
+void ServerController::onClientMessageStored(const QJsonObject &obj, const QString &senderId, const QList<int> &databaseIds)
+{
+    // The router has already persisted the message; this only updates the view
     MessageData msgData;
     msgData.senderType = MessageData::User_Other; // Always from client
     msgData.senderName = senderId; // e.g., "User #1"
@@ -347,44 +410,6 @@ void ServerController::onServerMessageReceived(const QString &message, const QSt
     
     QString type = obj["type"].toString();
     
-    
-    // Handle delete message
-    if (type == "delete") {
-        int messageId = obj["messageId"].toInt();
-        QString sender = senderId;
-        
-        // First try to find by database ID
-        if (m_serverView) {
-            m_serverView->removeMessageByDatabaseId(messageId);
-            
-            // If not found by ID, try to remove last message from sender
-            m_serverView->removeLastMessageFromSender(sender);
-        }
-        if (m_db) {
-            m_db->deleteMessage(messageId);
-        }
-        return;
-    }
-    
-    // Handle edit message
-    if (type == "edit") {
-        int messageId = obj["messageId"].toInt();
-        QString newText = obj["newText"].toString();
-        QString sender = senderId;
-        
-        // First try to find by database ID
-        if (m_serverView) {
-            m_serverView->updateMessageByDatabaseId(messageId, newText);
-            
-            // If not found by ID, try to update last message from sender
-            m_serverView->updateLastMessageFromSender(sender, newText);
-        }
-        if (m_db) {
-            m_db->updateMessage(messageId, newText, true);
-        }
-        return;
-    }
-    
     QString previewText;
     if (type == "text") {
         msgData.isFileMessage = false;
@@ -448,63 +473,25 @@ void ServerController::onServerMessageReceived(const QString &message, const QSt
     
     QString cleanFilteredUser = m_currentFilteredUser.split(" - ").first().trimmed();
     bool shouldDisplay = m_isBroadcastMode || m_currentFilteredUser.isEmpty() || senderId == cleanFilteredUser;
+    if (!m_serverView || !shouldDisplay) {
+        return;
+    }
     
     if (!msgData.isFileMessage && !msgData.isVoiceMessage) {
-        QStringList chunks = splitMessageIntoChunks(msgData.text);
-        for (const QString &chunk : chunks) {
+        const QStringList chunks = ChatRouter::splitMessageIntoChunks(msgData.text);
+        for (int i = 0; i < chunks.size(); ++i) {
             MessageData chunkData = msgData;
-            chunkData.text = chunk;
+            chunkData.text = chunks.at(i);
             chunkData.isEdited = false;
-            
-            if (m_db) {
-                chunkData.databaseId = m_db->saveMessage(senderId, "Server", chunk, QDateTime::currentDateTime(), false);
-            } else {
-                chunkData.databaseId = -1;
-            }
-            
-            if (m_serverView && shouldDisplay) {
-                QWidget* itemWidget = createWidgetFromData(chunkData);
-                m_serverView->addMessageItem(itemWidget);
-            }
+            chunkData.databaseId = databaseIds.value(i, -1);
+            m_serverView->addMessageItem(createWidgetFromData(chunkData));
         }
         return;
     }
     
-    // 3. Save to database (with standard format) for file/voice
-    if (m_db) {
-        QString dbMessage;
-        if (msgData.isVoiceMessage) {
-            // Convert waveform to JSON array string for storage
-            QString waveformJson = "[";
-            for (int i = 0; i < msgData.voiceInfo.waveform.size(); ++i) {
-                if (i > 0) waveformJson += ",";
-                waveformJson += QString::number(msgData.voiceInfo.waveform[i], 'f', 4);
-            }
-            waveformJson += "]";
-            
-            dbMessage = QString("VOICE|%1|%2|%3|%4")
-                            .arg(msgData.fileInfo.fileName)
-                            .arg(msgData.voiceInfo.duration)
-                            .arg(msgData.voiceInfo.url)
-                            .arg(waveformJson);
-        } else if (msgData.isFileMessage) {
-            dbMessage = QString("FILE|%1|%2|%3")
-                            .arg(msgData.fileInfo.fileName)
-                            .arg(msgData.fileInfo.fileSize)
-                            .arg(msgData.fileInfo.fileUrl);
-        }
-        if (!dbMessage.isEmpty()) {
-            msgData.databaseId = m_db->saveMessage(senderId, "Server", dbMessage, QDateTime::currentDateTime(), false);
-        }
-    } else {
-        msgData.databaseId = -1;
-    }
-    
-    // 4. Display in server window (only if viewing this user or in broadcast mode)
-    if (m_serverView && shouldDisplay) {
-        QWidget* itemWidget = createWidgetFromData(msgData);
-        m_serverView->addMessageItem(itemWidget);
-    }
+    // Display in server window (only if viewing this user or in broadcast mode)
+    msgData.databaseId = databaseIds.value(0, -1);
+    m_serverView->addMessageItem(createWidgetFromData(msgData));
 }
 
 void ServerController::onFileUploaded(const QString &fileName, const QString &url, qint64 fileSize, const QString &serverHost, const QVector<qreal> &waveform)
@@ -522,9 +509,6 @@ void ServerController::onFileUploaded(const QString &fileName, const QString &ur
     msgData.senderType = MessageData::User_Me;
     msgData.timestamp = QDateTime::currentDateTime().toString("hh:mm");
     
-    QString jsonMessage;
-    QString dbMessage;
-    
     if (isVoice) {
         // Voice message WITH waveform data
         msgData.isVoiceMessage = true;
@@ -535,25 +519,6 @@ void ServerController::onFileUploaded(const QString &fileName, const QString &ur
         msgData.voiceInfo.url = url;
         msgData.voiceInfo.duration = 0;
         msgData.voiceInfo.waveform = waveform; // Store real waveform!
-        
-        // Convert waveform to JSON array string
-        QString waveformJson = "[";
-        for (int i = 0; i < waveform.size(); ++i) {
-            if (i > 0) waveformJson += ",";
-            waveformJson += QString::number(waveform[i], 'f', 4);
-        }
-        waveformJson += "]";
-        
-        jsonMessage = QString(R"({"type":"voice","fileName":"%1","fileSize":%2,"fileUrl":"%3","duration":0,"waveform":%4,"sender":"Server","timestamp":"%5"})")
-                          .arg(fileName)
-                          .arg(fileSize)
-                          .arg(url)
-                          .arg(waveformJson)
-                          .arg(QDateTime::currentDateTime().toString(Qt::ISODate));
-        
-        // Save waveform in database: VOICE|fileName|duration|url|waveformJson
-        dbMessage = QString("VOICE|%1|0|%2|%3").arg(fileName).arg(url).arg(waveformJson);
-        
     } else {
         // Regular file message
         msgData.isFileMessage = true;
@@ -561,41 +526,16 @@ void ServerController::onFileUploaded(const QString &fileName, const QString &ur
         msgData.fileInfo.fileName = fileName;
         msgData.fileInfo.fileSize = fileSize;
         msgData.fileInfo.fileUrl = url;
-        
-        jsonMessage = QString(R"({"type":"file","fileName":"%1","fileSize":%2,"fileUrl":"%3","sender":"Server","timestamp":"%4"})")
-                          .arg(fileName)
-                          .arg(fileSize)
-                          .arg(url)
-                          .arg(QDateTime::currentDateTime().toString(Qt::ISODate));
-        
-        dbMessage = QString("FILE|%1|%2|%3").arg(fileName).arg(fileSize).arg(url);
     }
     
-    if (m_isBroadcastMode || m_currentPrivateTargetUser.isEmpty()) {
-        // Broadcast to all
-        if (m_server) {
-            m_server->broadcastToAll(jsonMessage);
-        }
-        
-        // Save to database
-        if (m_db) {
-            m_db->saveMessage("Server", "ALL", dbMessage, QDateTime::currentDateTime(), false);
-        }
-    } else {
-        // Send to specific user
-        QString cleanUserId = m_currentPrivateTargetUser.split(" - ").first().trimmed();
-        
-        if (m_server) {
-            m_server->sendMessageToClient(cleanUserId, jsonMessage);
-        }
-        
-        // Save to database
-        if (m_db) {
-            m_db->saveMessage("Server", cleanUserId, dbMessage, QDateTime::currentDateTime(), false);
-        }
-        
+    const QString target = currentTarget();
+    if (m_router) {
+        m_router->sendAttachment(target, fileName, url, fileSize, isVoice, waveform);
+    }
+    
+    if (target != ChatRouter::broadcastTarget()) {
         QString preview = isVoice ? "🎤 Voice Message" : "📎 File: " + fileName;
-        updateUserCard(cleanUserId, preview, msgData.timestamp, 0);
+        updateUserCard(target, preview, msgData.timestamp, 0);
     }
     
     // **FIX: Widget قبلاً در View ساخته شده - نباید دوباره بسازیم!**
@@ -871,37 +811,11 @@ void ServerController::handleDeleteRequest(MessageComponent *item, DeleteRequest
     }
 
 
-    if (m_db && item->databaseId() >= 0) {
-        m_db->deleteMessage(item->databaseId());
+    if (m_router) {
+        m_router->deleteMessage(currentTarget(), item->databaseId(), deleteForBoth);
     }
 
     m_serverView->removeMessageItem(item);
-
-    if (deleteForBoth) {
-        QJsonObject deleteMsg;
-        deleteMsg["type"] = "delete";
-        deleteMsg["messageId"] = item->databaseId();
-        deleteMsg["timestamp"] = QDateTime::currentDateTime().toString(Qt::ISODate);
-        deleteMsg["sender"] = "Server";
-
-        QJsonDocument doc(deleteMsg);
-        QString jsonMessage = doc.toJson(QJsonDocument::Compact);
-
-
-        if (m_isBroadcastMode || m_currentPrivateTargetUser.isEmpty()) {
-            if (m_server) {
-                m_server->broadcastToAll(jsonMessage);
-            } else {
-            }
-        } else {
-            QString targetUser = m_currentPrivateTargetUser.split(" - ").first().trimmed();
-            if (m_server) {
-                m_server->sendMessageToClient(targetUser, jsonMessage);
-            } else {
-            }
-        }
-    } else {
-    }
 }
 
 void ServerController::onTextMessageEditConfirmed(TextMessageItem *item, const QString &newText)
@@ -919,15 +833,14 @@ void ServerController::onTextMessageEditConfirmed(TextMessageItem *item, const Q
         return;
     }
 
-    QStringList chunks = splitMessageIntoChunks(trimmed);
+    QStringList chunks = ChatRouter::splitMessageIntoChunks(trimmed);
     if (chunks.isEmpty()) {
         chunks << trimmed;
     }
 
-    // Update in database
-    if (m_db && item->databaseId() >= 0) {
-        m_db->updateMessage(item->databaseId(), chunks.first(), true);
-    }
+    // Stores the edit, tells the other side and stores any overflow chunks
+    const QList<int> extraIds = m_router ? m_router->editMessage(currentTarget(), item->databaseId(), trimmed)
+                                         : QList<int>();
 
     // Update UI locally
     item->updateMessageText(chunks.first());
@@ -935,35 +848,6 @@ void ServerController::onTextMessageEditConfirmed(TextMessageItem *item, const Q
     if (m_serverView) {
         m_serverView->refreshMessageItem(item);
     }
-    
-    // Always send edit to other side (no dialog)
-    QJsonObject editMsg;
-    editMsg["type"] = "edit";
-    editMsg["messageId"] = item->databaseId();
-    editMsg["newText"] = chunks.first();
-    editMsg["timestamp"] = QDateTime::currentDateTime().toString(Qt::ISODate);
-    editMsg["sender"] = "Server";
-    
-    QJsonDocument doc(editMsg);
-    QString jsonMessage = doc.toJson(QJsonDocument::Compact);
-    
-    
-    if (m_isBroadcastMode || m_currentPrivateTargetUser.isEmpty()) {
-        if (m_server) {
-            m_server->broadcastToAll(jsonMessage);
-        } else {
-        }
-    } else {
-        QString targetUser = m_currentPrivateTargetUser.split(" - ").first().trimmed();
-        if (m_server) {
-            m_server->sendMessageToClient(targetUser, jsonMessage);
-        } else {
-        }
-    }
-
-    QString targetReceiver = (m_isBroadcastMode || m_currentPrivateTargetUser.isEmpty())
-                                 ? QStringLiteral("ALL")
-                                 : m_currentPrivateTargetUser.split(" - ").first().trimmed();
 
     if (chunks.size() > 1 && m_serverView) {
         for (int i = 1; i < chunks.size(); ++i) {
@@ -975,7 +859,7 @@ void ServerController::onTextMessageEditConfirmed(TextMessageItem *item, const Q
             chunkData.isFileMessage = false;
             chunkData.isVoiceMessage = false;
             chunkData.isEdited = true;
-            chunkData.databaseId = m_db ? m_db->saveMessage("Server", targetReceiver, chunkData.text, QDateTime::currentDateTime(), true) : -1;
+            chunkData.databaseId = extraIds.value(i - 1, -1);
 
             QWidget *extraWidget = createWidgetFromData(chunkData);
             m_serverView->addMessageItem(extraWidget);
@@ -993,18 +877,10 @@ void ServerController::onTextMessageEditConfirmed(TextMessageItem *item, const Q
     }
 }
 
-QStringList ServerController::splitMessageIntoChunks(const QString &text) const
+QString ServerController::currentTarget() const
 {
-    QStringList chunks;
-    if (text.isEmpty()) {
-        chunks << QString();
-        return chunks;
-    }
-    
-    int start = 0;
-    while (start < text.length()) {
-        chunks << text.mid(start, kMaxMessageLength);
-        start += kMaxMessageLength;
+    if (m_isBroadcastMode || m_currentPrivateTargetUser.isEmpty()) {
+        return ChatRouter::broadcastTarget();
     }
-    return chunks;
+    return m_currentPrivateTargetUser.split(" - ").first().trimmed();
 }
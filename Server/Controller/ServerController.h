@@ -6,8 +6,11 @@
 #include <QStringList>
 #include <QWidget>
 #include <QMap>
+#include <QJsonObject>
+#include "Model/Network/Presence.h"
 
 class ServerChatWindow;
+class ChatRouter;
 class WebSocketServer;
 class DatabaseManager;
 class MessageData;
@@ -24,7 +27,9 @@ class ServerController : public QObject
     Q_OBJECT
 
 public:
-    explicit ServerController(ServerChatWindow *view, WebSocketServer *server, DatabaseManager *db, QObject *parent = nullptr);
+    // Attaches the GUI to a running router; all persistence and network
+    // delivery stays in the router
+    explicit ServerController(ServerChatWindow *view, ChatRouter *router, QObject *parent = nullptr);
     ~ServerController();
 
     void displayNewConnection();
@@ -34,10 +39,14 @@ public slots:
     void displayFileMessage(const QString &fileName, qint64 fileSize, const QString &fileUrl, const QString &sender = "");
 
 private slots:
-    void onUserListChanged(const QStringList &users);
+    void onUserJoined(const PresenceEntry &user, quint64 version);
+    void onUserLeft(const QString &userId, quint64 version);
+    void onUserUpdated(const PresenceEntry &user, quint64 version);
     void onUserCountChanged(int count);
     void onUserSelected(const QString &userId);
-    void onServerMessageReceived(const QString &message, const QString &senderId);
+    void onClientMessageStored(const QJsonObject &obj, const QString &senderId, const QList<int> &databaseIds);
+    void onClientMessageEdited(int messageId, const QString &newText, const QString &senderId);
+    void onClientMessageDeleted(int messageId, const QString &senderId);
     void onFileUploaded(const QString &fileName, const QString &url, qint64 fileSize, const QString &serverHost = "", const QVector<qreal> &waveform = QVector<qreal>());
     void onTextMessageCopyRequested(const QString &text);
     void onTextMessageEditRequested(TextMessageItem *item);
@@ -53,8 +62,15 @@ private:
     void setupTextMessageItem(TextMessageItem *item);
     void setupFileMessageItem(FileMessageItem *item);
     void setupVoiceMessageItem(VoiceMessageItem *item);
-    QStringList splitMessageIntoChunks(const QString &text) const;
+    // User id of the open private chat, or the router's broadcast target
+    QString currentTarget() const;
     
+    // Presence: deltas are applied in version order; a gap means we missed
+    // something and rebuild from the server's snapshot
+    bool acceptPresenceVersion(quint64 version);
+    void syncPresence();
+    void restoreUserCard(const QString &user);
+
     // Helper to update user card and state
     void updateUserCard(const QString &userId, const QString &preview, const QString &timestamp, int unreadCount);
 
@@ -69,6 +85,7 @@ private:
     ServerChatWindow *m_serverView;
 
     // Model
+    ChatRouter *m_router;
     WebSocketServer *m_server;
     DatabaseManager *m_db;
 
@@ -76,6 +93,7 @@ private:
     QString m_currentPrivateTargetUser;
     QString m_currentFilteredUser;
     bool m_isBroadcastMode;
+    quint64 m_presenceVersion;
     QMap<QString, int> m_unreadCounts; // Track unread messages per user
     QMap<QString, QString> m_lastMessages; // Track last message preview per user
     QMap<QString, QString> m_lastTimestamps; // Track last message timestamp per user
@@ -0,0 +1,44 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDebug>
+#include "Model/Network/WebSocketServer.h"
+#include "Model/Core/DatabaseManager.h"
+#include "Model/Core/ChatRouter.h"
+#include "ServerOptions.h"
+
+// Server without any widget code: WebSocket shards, the TUS upload server
+// (owned by WebSocketServer), the database and message routing under
+// QCoreApplication. Runs on machines without a display.
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("ServerHeadless");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Headless chat server");
+    parser.addHelpOption();
+    ServerOptions::addTo(parser);
+    parser.process(app);
+    const ServerOptions options = ServerOptions::fromParser(parser);
+
+    DatabaseManager db(options.databasePath);
+    if (!db.initDatabase()) {
+        qCritical() << "Failed to initialize database at" << options.databasePath;
+        return 1;
+    }
+
+    WebSocketServer server(8080, options.shards);
+    server.setOutboundQueuePolicy(options.queue);
+    if (options.batchWindowMs >= 0) {
+        server.setBatchingEnabled(true, options.batchWindowMs);
+    }
+
+    ChatRouter router(&server, &db);
+
+    QObject::connect(&server, &WebSocketServer::userCountChanged, [](int count) {
+        qInfo() << "Connected users:" << count;
+    });
+
+    qInfo() << "Server running on port 8080 with" << server.shardCount() << "worker shard(s)";
+    return app.exec();
+}
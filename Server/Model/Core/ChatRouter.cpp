@@ -0,0 +1,234 @@
+#include "Model/Core/ChatRouter.h"
+#include "Model/Core/DatabaseManager.h"
+#include "Model/Network/WebSocketServer.h"
+
+#include <QDateTime>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QUrl>
+
+namespace {
+constexpr int kMaxMessageLength = 1800;
+}
+
+ChatRouter::ChatRouter(WebSocketServer *server, DatabaseManager *db, QObject *parent)
+    : QObject(parent)
+    , m_server(server)
+    , m_db(db)
+{
+    if (m_server) {
+        connect(m_server, &WebSocketServer::messageReceived, this, &ChatRouter::onMessageReceived);
+    }
+}
+
+QStringList ChatRouter::splitMessageIntoChunks(const QString &text)
+{
+    QStringList chunks;
+    if (text.isEmpty()) {
+        chunks << QString();
+        return chunks;
+    }
+
+    int start = 0;
+    while (start < text.length()) {
+        chunks << text.mid(start, kMaxMessageLength);
+        start += kMaxMessageLength;
+    }
+    return chunks;
+}
+
+void ChatRouter::onMessageReceived(const QJsonObject &obj, const QString &senderId)
+{
+    const QString type = obj["type"].toString();
+
+    if (type == "delete") {
+        const int messageId = obj["messageId"].toInt();
+        if (m_db) {
+            m_db->deleteMessage(messageId);
+        }
+        emit messageDeleted(messageId, senderId);
+        return;
+    }
+
+    if (type == "edit") {
+        const int messageId = obj["messageId"].toInt();
+        const QString newText = obj["newText"].toString();
+        if (m_db) {
+            m_db->updateMessage(messageId, newText, true);
+        }
+        emit messageEdited(messageId, newText, senderId);
+        return;
+    }
+
+    if (type == "text") {
+        QList<int> ids;
+        const QStringList chunks = splitMessageIntoChunks(obj["content"].toString());
+        for (const QString &chunk : chunks) {
+            ids.append(store(senderId, "Server", chunk));
+        }
+        emit messageStored(obj, senderId, ids);
+        return;
+    }
+
+    // File and voice messages are stored in the pipe-separated format the
+    // history loaders understand
+    QString dbMessage;
+    if (type == "voice") {
+        const QString url = obj["voiceUrl"].toString(obj["fileUrl"].toString());
+        QString fileName = obj["fileName"].toString();
+        if (fileName.isEmpty()) {
+            fileName = QUrl(url).fileName();
+        }
+
+        QVector<qreal> waveform;
+        const QJsonArray waveformArray = obj["waveform"].toArray();
+        waveform.reserve(waveformArray.size());
+        for (const QJsonValue &val : waveformArray) {
+            waveform.append(val.toDouble());
+        }
+
+        dbMessage = QString("VOICE|%1|%2|%3|%4")
+                        .arg(fileName)
+                        .arg(obj["duration"].toInt())
+                        .arg(url)
+                        .arg(waveformToJson(waveform));
+    } else if (type == "file") {
+        dbMessage = QString("FILE|%1|%2|%3")
+                        .arg(obj["fileName"].toString())
+                        .arg(obj["fileSize"].toInteger())
+                        .arg(obj["fileUrl"].toString());
+    } else {
+        return;
+    }
+
+    emit messageStored(obj, senderId, {store(senderId, "Server", dbMessage)});
+}
+
+QList<int> ChatRouter::sendText(const QString &target, const QString &text)
+{
+    QList<int> ids;
+    const QString isoTimestamp = QDateTime::currentDateTime().toString(Qt::ISODate);
+
+    const QStringList chunks = splitMessageIntoChunks(text);
+    for (const QString &chunk : chunks) {
+        QString jsonMessage = QString(R"({"type":"text","content":"%1","sender":"Server","timestamp":"%2"})")
+                                  .arg(chunk)
+                                  .arg(isoTimestamp);
+        deliver(target, jsonMessage);
+        ids.append(store("Server", target, chunk));
+    }
+    return ids;
+}
+
+int ChatRouter::sendAttachment(const QString &target, const QString &fileName, const QString &url,
+                               qint64 fileSize, bool isVoice, const QVector<qreal> &waveform)
+{
+    const QString isoTimestamp = QDateTime::currentDateTime().toString(Qt::ISODate);
+    QString jsonMessage;
+    QString dbMessage;
+
+    if (isVoice) {
+        const QString waveformJson = waveformToJson(waveform);
+        jsonMessage = QString(R"({"type":"voice","fileName":"%1","fileSize":%2,"fileUrl":"%3","duration":0,"waveform":%4,"sender":"Server","timestamp":"%5"})")
+                          .arg(fileName)
+                          .arg(fileSize)
+                          .arg(url)
+                          .arg(waveformJson)
+                          .arg(isoTimestamp);
+
+        // Save waveform in database: VOICE|fileName|duration|url|waveformJson
+        dbMessage = QString("VOICE|%1|0|%2|%3").arg(fileName).arg(url).arg(waveformJson);
+    } else {
+        jsonMessage = QString(R"({"type":"file","fileName":"%1","fileSize":%2,"fileUrl":"%3","sender":"Server","timestamp":"%4"})")
+                          .arg(fileName)
+                          .arg(fileSize)
+                          .arg(url)
+                          .arg(isoTimestamp);
+
+        dbMessage = QString("FILE|%1|%2|%3").arg(fileName).arg(fileSize).arg(url);
+    }
+
+    deliver(target, jsonMessage);
+    return store("Server", target, dbMessage);
+}
+
+QList<int> ChatRouter::editMessage(const QString &target, int messageId, const QString &newText)
+{
+    QStringList chunks = splitMessageIntoChunks(newText);
+    if (chunks.isEmpty()) {
+        chunks << newText;
+    }
+
+    if (m_db && messageId >= 0) {
+        m_db->updateMessage(messageId, chunks.first(), true);
+    }
+
+    QJsonObject editMsg;
+    editMsg["type"] = "edit";
+    editMsg["messageId"] = messageId;
+    editMsg["newText"] = chunks.first();
+    editMsg["timestamp"] = QDateTime::currentDateTime().toString(Qt::ISODate);
+    editMsg["sender"] = "Server";
+
+    // A newer edit of the same message supersedes one still queued for a slow client
+    deliver(target, QString::fromUtf8(QJsonDocument(editMsg).toJson(QJsonDocument::Compact)),
+            QStringLiteral("edit:%1").arg(messageId));
+
+    QList<int> extraIds;
+    for (int i = 1; i < chunks.size(); ++i) {
+        extraIds.append(store("Server", target, chunks.at(i), true));
+    }
+    return extraIds;
+}
+
+void ChatRouter::deleteMessage(const QString &target, int messageId, bool forBothSides)
+{
+    if (m_db && messageId >= 0) {
+        m_db->deleteMessage(messageId);
+    }
+
+    if (!forBothSides) {
+        return;
+    }
+
+    QJsonObject deleteMsg;
+    deleteMsg["type"] = "delete";
+    deleteMsg["messageId"] = messageId;
+    deleteMsg["timestamp"] = QDateTime::currentDateTime().toString(Qt::ISODate);
+    deleteMsg["sender"] = "Server";
+
+    deliver(target, QString::fromUtf8(QJsonDocument(deleteMsg).toJson(QJsonDocument::Compact)));
+}
+
+void ChatRouter::deliver(const QString &target, const QString &jsonMessage, const QString &coalesceKey)
+{
+    if (!m_server) {
+        return;
+    }
+
+    if (target.isEmpty() || target == broadcastTarget()) {
+        m_server->broadcastToAll(jsonMessage, DeliveryClass::Reliable, coalesceKey);
+    } else {
+        m_server->sendMessageToClient(target, jsonMessage, DeliveryClass::Reliable, coalesceKey);
+    }
+}
+
+int ChatRouter::store(const QString &sender, const QString &receiver, const QString &message, bool isEdited)
+{
+    if (!m_db) {
+        return -1;
+    }
+    const QString to = receiver.isEmpty() ? broadcastTarget() : receiver;
+    return m_db->saveMessage(sender, to, message, QDateTime::currentDateTime(), isEdited);
+}
+
+QString ChatRouter::waveformToJson(const QVector<qreal> &waveform)
+{
+    QString waveformJson = "[";
+    for (int i = 0; i < waveform.size(); ++i) {
+        if (i > 0) waveformJson += ",";
+        waveformJson += QString::number(waveform[i], 'f', 4);
+    }
+    waveformJson += "]";
+    return waveformJson;
+}
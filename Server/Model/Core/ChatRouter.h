@@ -0,0 +1,60 @@
+#ifndef CHATROUTER_H
+#define CHATROUTER_H
+
+#include <QObject>
+#include <QJsonObject>
+#include <QList>
+#include <QString>
+#include <QVector>
+
+class WebSocketServer;
+class DatabaseManager;
+
+// Server-side message routing without any widget code: persists what clients
+// send, applies their edits and deletes, and sends the server's own messages.
+// ServerController attaches to it as an optional front-end; the headless
+// server runs it on its own.
+class ChatRouter : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ChatRouter(WebSocketServer *server, DatabaseManager *db, QObject *parent = nullptr);
+
+    WebSocketServer *server() const { return m_server; }
+    DatabaseManager *database() const { return m_db; }
+
+    // Receiver name used for broadcasts, in the database as on the wire
+    static QString broadcastTarget() { return QStringLiteral("ALL"); }
+    static QStringList splitMessageIntoChunks(const QString &text);
+
+    // target is a user id or broadcastTarget(). Return the database ids of
+    // the stored chunks (-1 without a database).
+    QList<int> sendText(const QString &target, const QString &text);
+    int sendAttachment(const QString &target, const QString &fileName, const QString &url,
+                       qint64 fileSize, bool isVoice, const QVector<qreal> &waveform = QVector<qreal>());
+    // Returns ids of the extra chunks when the new text no longer fits in one
+    QList<int> editMessage(const QString &target, int messageId, const QString &newText);
+    void deleteMessage(const QString &target, int messageId, bool forBothSides);
+
+signals:
+    // A client message was stored. Text is stored in chunks, one id per
+    // splitMessageIntoChunks() entry; attachments have a single id.
+    void messageStored(const QJsonObject &message, const QString &senderId, const QList<int> &databaseIds);
+    void messageEdited(int messageId, const QString &newText, const QString &senderId);
+    void messageDeleted(int messageId, const QString &senderId);
+
+private slots:
+    void onMessageReceived(const QJsonObject &obj, const QString &senderId);
+
+private:
+    void deliver(const QString &target, const QString &jsonMessage,
+                 const QString &coalesceKey = QString());
+    int store(const QString &sender, const QString &receiver, const QString &message, bool isEdited = false);
+    static QString waveformToJson(const QVector<qreal> &waveform);
+
+    WebSocketServer *m_server;
+    DatabaseManager *m_db;
+};
+
+#endif // CHATROUTER_H
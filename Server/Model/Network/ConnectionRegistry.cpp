@@ -0,0 +1,64 @@
+#include "Model/Network/ConnectionRegistry.h"
+#include <algorithm>
+
+ConnectionRegistry::ConnectionRegistry()
+    : m_nextId(1)
+{
+}
+
+const ConnectionEntry &ConnectionRegistry::add(const QString &userId, const QString &peerAddress, ConnectionShard *shard)
+{
+    ConnectionEntry entry;
+    entry.id = m_nextId++;
+    entry.userId = userId;
+    entry.peerAddress = peerAddress;
+    entry.shard = shard;
+
+    m_idByUserId.insert(userId, entry.id);
+    return *m_byId.insert(entry.id, entry);
+}
+
+bool ConnectionRegistry::remove(quint64 id)
+{
+    auto it = m_byId.find(id);
+    if (it == m_byId.end()) {
+        return false;
+    }
+
+    m_idByUserId.remove(it->userId);
+    m_byId.erase(it);
+    return true;
+}
+
+void ConnectionRegistry::clear()
+{
+    m_byId.clear();
+    m_idByUserId.clear();
+}
+
+const ConnectionEntry *ConnectionRegistry::findById(quint64 id) const
+{
+    auto it = m_byId.constFind(id);
+    return it == m_byId.cend() ? nullptr : &it.value();
+}
+
+ConnectionEntry *ConnectionRegistry::findById(quint64 id)
+{
+    auto it = m_byId.find(id);
+    return it == m_byId.end() ? nullptr : &it.value();
+}
+
+const ConnectionEntry *ConnectionRegistry::findByUserId(const QString &userId) const
+{
+    auto it = m_idByUserId.constFind(userId);
+    return it == m_idByUserId.cend() ? nullptr : findById(it.value());
+}
+
+QList<ConnectionEntry> ConnectionRegistry::entries() const
+{
+    QList<ConnectionEntry> result = m_byId.values();
+    std::sort(result.begin(), result.end(), [](const ConnectionEntry &a, const ConnectionEntry &b) {
+        return a.id < b.id;
+    });
+    return result;
+}
@@ -0,0 +1,53 @@
+#ifndef CONNECTIONREGISTRY_H
+#define CONNECTIONREGISTRY_H
+
+#include <QHash>
+#include <QList>
+#include <QString>
+
+class ConnectionShard;
+
+// Last outbound queue depth a shard reported for a connection
+struct OutboundQueueStats {
+    int frames = 0;
+    qint64 bytes = 0;
+    quint64 dropped = 0;
+};
+
+// What the accepting thread knows about a live connection
+struct ConnectionEntry {
+    quint64 id = 0;              // Stable for the lifetime of the connection
+    QString userId;              // e.g. "User #12"
+    QString peerAddress;
+    ConnectionShard *shard = nullptr;
+    OutboundQueueStats queue;
+};
+
+// Hash-indexed table of connected clients, owned by WebSocketServer and only
+// touched from its thread. Lookups by connection id and by user id are O(1),
+// so directed sends do not scale with the number of connected clients.
+class ConnectionRegistry
+{
+public:
+    ConnectionRegistry();
+
+    quint64 nextId() const { return m_nextId; }
+    const ConnectionEntry &add(const QString &userId, const QString &peerAddress, ConnectionShard *shard);
+    bool remove(quint64 id);
+    void clear();
+
+    const ConnectionEntry *findById(quint64 id) const;
+    ConnectionEntry *findById(quint64 id);
+    const ConnectionEntry *findByUserId(const QString &userId) const;
+
+    int size() const { return m_byId.size(); }
+    // Entries in accept order
+    QList<ConnectionEntry> entries() const;
+
+private:
+    QHash<quint64, ConnectionEntry> m_byId;
+    QHash<QString, quint64> m_idByUserId;
+    quint64 m_nextId;
+};
+
+#endif // CONNECTIONREGISTRY_H
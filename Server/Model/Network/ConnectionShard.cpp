@@ -0,0 +1,528 @@
+#include "Model/Network/ConnectionShard.h"
+#include "CryptoManager.h"
+#include "WireProtocol.h"
+#include <QJsonDocument>
+#include <QTimer>
+#include <QJsonArray>
+#include <algorithm>
+#include <iterator>
+
+namespace {
+// Upper bound for one batch frame's plaintext; larger bursts are split
+constexpr int kMaxBatchBytes = 256 * 1024;
+}
+
+ConnectionShard::ConnectionShard(int index, QObject *parent)
+    : QObject(parent)
+    , m_index(index)
+    , m_congestionTimer(new QTimer(this))
+    , m_batchingEnabled(false)
+    , m_flushTimer(new QTimer(this))
+{
+    m_clock.start();
+
+    // Moves with the shard, so it always fires on the shard's thread
+    m_congestionTimer->setInterval(1000);
+    connect(m_congestionTimer, &QTimer::timeout, this, &ConnectionShard::checkCongestion);
+
+    m_flushTimer->setSingleShot(true);
+    m_flushTimer->setInterval(0);
+    connect(m_flushTimer, &QTimer::timeout, this, &ConnectionShard::flushPending);
+}
+
+ConnectionShard::~ConnectionShard()
+{
+    closeAll();
+}
+
+ClientConnection *ConnectionShard::bindSocket(QWebSocket *socket, quint64 connectionId, const QString &userId)
+{
+    ClientConnection *connection = new ClientConnection;
+    connection->id = connectionId;
+    connection->userId = userId;
+    connection->socket = socket;
+
+    connect(socket, &QWebSocket::textMessageReceived,
+            this, [this, connection](const QString &frame) {
+        // The decoded buffer is ours alone, so decrypt it where it lies
+        QByteArray envelope = QByteArray::fromBase64(frame.toLatin1());
+        QByteArrayView plaintext;
+        if (CryptoManager::decryptInPlace(envelope, plaintext, &connection->inbound)) {
+            processPlaintext(connection, QByteArray::fromRawData(plaintext.data(), plaintext.size()));
+        }
+    });
+    connect(socket, &QWebSocket::binaryMessageReceived,
+            this, [this, connection](const QByteArray &frame) {
+        processPlaintext(connection, CryptoManager::decryptPayload(frame, &connection->inbound));
+    });
+    connect(socket, &QWebSocket::bytesWritten,
+            this, [this, connection]() {
+        drainQueue(connection);
+    });
+    connect(socket, &QWebSocket::disconnected,
+            this, [this, connection]() {
+        removeConnection(connection);
+    });
+
+    return connection;
+}
+
+void ConnectionShard::adoptConnection(ClientConnection *connection)
+{
+    if (!connection) {
+        return;
+    }
+
+    connection->socket->setParent(this);
+    connection->adopted = true;
+
+    m_connections.insert(connection->id, connection);
+
+    // The peer may have gone away while the socket was in transit
+    if (connection->socket->state() != QAbstractSocket::ConnectedState) {
+        removeConnection(connection);
+    }
+}
+
+void ConnectionShard::processPlaintext(ClientConnection *connection, const QByteArray &plaintext)
+{
+    QJsonDocument doc = QJsonDocument::fromJson(plaintext);
+    if (doc.isObject()) {
+        processMessage(connection, doc.object());
+    } else if (doc.isArray()) {
+        // Batch frame: one decryption, many messages
+        const QJsonArray batch = doc.array();
+        for (const QJsonValue &value : batch) {
+            if (value.isObject()) {
+                processMessage(connection, value.toObject());
+            }
+        }
+    }
+}
+
+void ConnectionShard::processMessage(ClientConnection *connection, const QJsonObject &obj)
+{
+    const QString type = obj["type"].toString();
+    if (type == WireProtocol::TypeHello) {
+        handleHello(connection, obj);
+        return;
+    }
+    if (type == WireProtocol::TypePing) {
+        handlePing(connection, obj);
+        return;
+    }
+
+    emit messageReceived(obj, connection->userId);
+}
+
+void ConnectionShard::handleHello(ClientConnection *connection, const QJsonObject &hello)
+{
+    const QStringList offered = WireProtocol::capabilitiesOf(hello);
+
+    QStringList accepted;
+    if (offered.contains(WireProtocol::CapBinary)) {
+        accepted.append(WireProtocol::CapBinary);
+    }
+    // We can always unpack batches; whether we send them is our own setting
+    if (offered.contains(WireProtocol::CapBatch)) {
+        accepted.append(WireProtocol::CapBatch);
+    }
+    if (offered.contains(WireProtocol::CapEnvelope)) {
+        accepted.append(WireProtocol::CapEnvelope);
+    }
+
+    // The welcome already travels in the negotiated mode, which is what tells
+    // the client it may switch too
+    connection->binaryWire = accepted.contains(WireProtocol::CapBinary);
+    connection->batching = accepted.contains(WireProtocol::CapBatch);
+    connection->versionedEnvelope = accepted.contains(WireProtocol::CapEnvelope);
+
+    QJsonObject welcome = WireProtocol::makeControlMessage(WireProtocol::TypeWelcome, accepted);
+    if (connection->versionedEnvelope) {
+        // Ciphers, codecs and sessions need the envelope's version and flags
+        connection->cipher = CryptoManager::negotiateCipher(WireProtocol::ciphersOf(hello));
+        connection->codec = CryptoManager::negotiateCodec(WireProtocol::codecsOf(hello));
+        welcome["cipher"] = CryptoManager::cipherName(connection->cipher);
+        welcome["codecs"] = QJsonArray::fromStringList(CryptoManager::supportedCodecs());
+
+        // A salt in the hello means the client speaks counter-nonce envelopes.
+        // It holds its messages until our welcome, so everything from it
+        // after the hello is a session envelope.
+        const QByteArray clientSalt = QByteArray::fromBase64(hello["salt"].toString().toLatin1());
+        const QByteArray serverSalt = MessageSession::generateSalt();
+        if (!clientSalt.isEmpty() && !serverSalt.isEmpty()
+            && connection->inbound.start(clientSalt, 0, connection->cipher, AeadContext::Direction::Decrypt)
+            && connection->sending.start(serverSalt, 0, connection->cipher, AeadContext::Direction::Encrypt)) {
+            connection->sessionNonces = true;
+            welcome["salt"] = QString::fromLatin1(serverSalt.toBase64());
+            welcome["stream"] = 0;
+        } else {
+            connection->inbound.reset();
+        }
+    }
+
+    // The client starts its receiving session from the welcome, so the
+    // welcome itself must not be a session envelope. It also goes behind
+    // whatever is still queued in the old format; coalescing moves frames to
+    // the back, never ahead of it.
+    const QByteArray plaintext = QJsonDocument(welcome).toJson(QJsonDocument::Compact);
+    OutboundFrame frame;
+    frame.envelope = connection->versionedEnvelope
+        ? CryptoManager::encryptPayload(plaintext, connection->cipher, connection->codec)
+        : CryptoManager::encryptLegacyPayload(plaintext);
+    if (frame.envelope.isEmpty()) {
+        qWarning() << "Encryption failed, welcome not sent";
+        return;
+    }
+    enqueue(connection, frame);
+}
+
+void ConnectionShard::handlePing(ClientConnection *connection, const QJsonObject &ping)
+{
+    QJsonObject pong;
+    pong["type"] = QString(WireProtocol::TypePong);
+    pong["seq"] = ping["seq"];
+    pong["sent"] = ping["sent"];
+    pong["queued"] = connection->outbound.frameCount();
+    pong["dropped"] = qint64(connection->outbound.droppedCount());
+
+    // A pong stuck behind a backlog is stale; keep only the newest
+    sendToConnection(connection->id, QString::fromUtf8(QJsonDocument(pong).toJson(QJsonDocument::Compact)),
+                     DeliveryClass::Ephemeral, QString(WireProtocol::TypePong));
+}
+
+void ConnectionShard::sendEnvelope(ClientConnection *connection, const QByteArray &envelope)
+{
+    if (connection->binaryWire) {
+        connection->socket->sendBinaryMessage(envelope);
+    } else {
+        connection->socket->sendTextMessage(QString::fromLatin1(envelope.toBase64()));
+    }
+}
+
+void ConnectionShard::removeConnection(ClientConnection *connection)
+{
+    // Not adopted yet: adoptConnection() will notice the closed socket
+    if (!connection || !connection->adopted) {
+        return;
+    }
+
+    m_connections.remove(connection->id);
+    connection->socket->disconnect(this);
+    connection->socket->deleteLater();
+
+    const quint64 connectionId = connection->id;
+    delete connection;
+
+    emit connectionClosed(connectionId);
+}
+
+void ConnectionShard::sendToConnection(quint64 connectionId, const QString &message,
+                                       DeliveryClass delivery, const QString &coalesceKey)
+{
+    if (message.isEmpty()) {
+        qWarning() << "Cannot send empty message";
+        return;
+    }
+
+    m_pending.append({connectionId, message.toUtf8(), delivery, coalesceKey});
+    if (m_batchingEnabled) {
+        if (!m_flushTimer->isActive()) {
+            m_flushTimer->start();
+        }
+    } else {
+        flushPending();
+    }
+}
+
+void ConnectionShard::broadcast(const QString &message, DeliveryClass delivery, const QString &coalesceKey)
+{
+    m_pending.append({0, message.toUtf8(), delivery, coalesceKey});
+    if (m_batchingEnabled) {
+        if (!m_flushTimer->isActive()) {
+            m_flushTimer->start();
+        }
+    } else {
+        flushPending();
+    }
+}
+
+void ConnectionShard::setBatching(bool enabled, int windowMs)
+{
+    m_batchingEnabled = enabled;
+    m_flushTimer->setInterval(qMax(0, windowMs));
+    if (!enabled) {
+        flushPending();
+    }
+}
+
+void ConnectionShard::flushPending()
+{
+    if (m_pending.isEmpty()) {
+        return;
+    }
+    const QList<PendingMessage> pending = std::move(m_pending);
+    m_pending.clear();
+
+    QList<int> broadcastItems;
+    QHash<quint64, QList<int>> directItems;
+    for (int i = 0; i < pending.size(); ++i) {
+        if (pending[i].connectionId == 0) {
+            broadcastItems.append(i);
+        } else {
+            directItems[pending[i].connectionId].append(i);
+        }
+    }
+
+    // Per-connection sequence: the broadcasts interleaved with its own
+    // direct messages in the order they were sent
+    auto framesFor = [&](ClientConnection *connection, const QList<int> &direct) {
+        QList<int> items;
+        items.reserve(broadcastItems.size() + direct.size());
+        std::merge(broadcastItems.cbegin(), broadcastItems.cend(),
+                   direct.cbegin(), direct.cend(), std::back_inserter(items));
+        return buildFrames(pending, items, connection);
+    };
+
+    auto deliver = [this](ClientConnection *connection, const QList<OutboundFrame> &frames) {
+        for (const OutboundFrame &frame : frames) {
+            enqueue(connection, frame);
+        }
+    };
+
+    if (broadcastItems.isEmpty()) {
+        // Directed sends only: touch just the addressed connections
+        for (auto it = directItems.cbegin(); it != directItems.cend(); ++it) {
+            ClientConnection *connection = m_connections.value(it.key(), nullptr);
+            if (!connection) {
+                qWarning() << "✗ Connection" << it.key() << "not found on shard" << m_index;
+                continue;
+            }
+            if (connection->socket->state() != QAbstractSocket::ConnectedState) {
+                qWarning() << "✗ Socket not connected, state:" << connection->socket->state();
+                continue;
+            }
+            deliver(connection, framesFor(connection, it.value()));
+        }
+        return;
+    }
+
+    // Connections that only received broadcasts share one encryption per
+    // frame; built lazily for whichever wire format is actually needed
+    QHash<int, QList<OutboundFrame>> sharedFrames;
+
+    const QList<ClientConnection *> connections = m_connections.values();
+    for (ClientConnection *connection : connections) {
+        if (connection->socket->state() != QAbstractSocket::ConnectedState) {
+            continue;
+        }
+
+        auto direct = directItems.constFind(connection->id);
+        if (direct != directItems.cend()) {
+            deliver(connection, framesFor(connection, direct.value()));
+            continue;
+        }
+
+        if (connection->sessionNonces) {
+            // Sealed under this connection's own key and counter
+            deliver(connection, buildFrames(pending, broadcastItems, connection));
+            continue;
+        }
+
+        const int variant = frameVariant(connection);
+        auto shared = sharedFrames.constFind(variant);
+        if (shared == sharedFrames.cend()) {
+            shared = sharedFrames.insert(variant, buildFrames(pending, broadcastItems, connection));
+        }
+        deliver(connection, shared.value());
+    }
+}
+
+int ConnectionShard::frameVariant(const ClientConnection *connection)
+{
+    return (connection->batching ? 1 : 0)
+         | (connection->cipher == AeadCipher::ChaCha20Poly1305 ? 2 : 0)
+         | (connection->versionedEnvelope ? 4 : 0)
+         | (int(connection->codec) << 3);
+}
+
+QByteArray ConnectionShard::seal(ClientConnection *connection, const QByteArray &plaintext)
+{
+    if (!connection->versionedEnvelope) {
+        return CryptoManager::encryptLegacyPayload(plaintext);
+    }
+    if (connection->sessionNonces) {
+        return CryptoManager::encryptPayload(plaintext, connection->sending, connection->codec);
+    }
+    return CryptoManager::encryptPayload(plaintext, connection->cipher, connection->codec);
+}
+
+QList<OutboundFrame> ConnectionShard::buildFrames(const QList<PendingMessage> &pending,
+                                                  const QList<int> &items,
+                                                  ClientConnection *connection)
+{
+    QList<OutboundFrame> frames;
+    const bool batched = connection->batching;
+
+    auto addFrame = [&frames, connection](const QByteArray &plaintext, DeliveryClass delivery, const QString &coalesceKey) {
+        OutboundFrame frame;
+        frame.envelope = seal(connection, plaintext);
+        frame.delivery = delivery;
+        frame.coalesceKey = coalesceKey;
+        if (frame.envelope.isEmpty()) {
+            qWarning() << "Encryption failed, frame not sent";
+            return;
+        }
+        frames.append(frame);
+    };
+
+    if (!batched || items.size() == 1) {
+        for (int i : items) {
+            addFrame(pending[i].plaintext, pending[i].delivery, pending[i].coalesceKey);
+        }
+        return frames;
+    }
+
+    // Batch frame plaintext is a JSON array of the original message objects,
+    // so building it is plain concatenation
+    QByteArray batch;
+    DeliveryClass delivery = DeliveryClass::Ephemeral;
+    for (int i : items) {
+        const PendingMessage &message = pending[i];
+        if (!batch.isEmpty() && batch.size() + message.plaintext.size() + 1 > kMaxBatchBytes) {
+            batch.append(']');
+            addFrame(batch, delivery, QString());
+            batch.clear();
+            delivery = DeliveryClass::Ephemeral;
+        }
+        batch.append(batch.isEmpty() ? '[' : ',');
+        batch.append(message.plaintext);
+        if (message.delivery == DeliveryClass::Reliable) {
+            delivery = DeliveryClass::Reliable;
+        }
+    }
+    batch.append(']');
+    addFrame(batch, delivery, QString());
+
+    return frames;
+}
+
+void ConnectionShard::setQueuePolicy(const OutboundQueuePolicy &policy)
+{
+    m_policy = policy;
+}
+
+void ConnectionShard::enqueue(ClientConnection *connection, const OutboundFrame &frame)
+{
+    if (connection->evicted) {
+        return;
+    }
+
+    // Fast path: nothing backed up and the socket buffer has room
+    if (connection->outbound.isEmpty()
+        && connection->socket->bytesToWrite() < m_policy.highWatermark) {
+        sendEnvelope(connection, frame.envelope);
+        return;
+    }
+
+    switch (connection->outbound.push(frame, m_policy)) {
+    case OutboundQueue::PushResult::Overflow:
+        evict(connection, "outbound queue limit exceeded");
+        return;
+    case OutboundQueue::PushResult::Queued:
+    case OutboundQueue::PushResult::Coalesced:
+    case OutboundQueue::PushResult::Dropped:
+        break;
+    }
+
+    if (connection->congestedSince < 0) {
+        connection->congestedSince = m_clock.elapsed();
+        reportQueue(connection);
+        if (!m_congestionTimer->isActive()) {
+            m_congestionTimer->start();
+        }
+    }
+}
+
+void ConnectionShard::drainQueue(ClientConnection *connection)
+{
+    if (connection->evicted || connection->outbound.isEmpty()
+        || connection->socket->bytesToWrite() > m_policy.lowWatermark) {
+        return;
+    }
+
+    while (!connection->outbound.isEmpty()
+           && connection->socket->bytesToWrite() < m_policy.highWatermark) {
+        sendEnvelope(connection, connection->outbound.takeFirst().envelope);
+    }
+
+    if (connection->outbound.isEmpty()) {
+        connection->congestedSince = -1;
+        reportQueue(connection);
+    }
+}
+
+void ConnectionShard::checkCongestion()
+{
+    const qint64 now = m_clock.elapsed();
+    QList<ClientConnection *> victims;
+    bool anyCongested = false;
+
+    for (ClientConnection *connection : std::as_const(m_connections)) {
+        if (connection->congestedSince < 0 || connection->evicted) {
+            continue;
+        }
+        if (now - connection->congestedSince >= m_policy.evictAfterMs) {
+            victims.append(connection);
+        } else {
+            anyCongested = true;
+            reportQueue(connection);
+        }
+    }
+
+    for (ClientConnection *connection : std::as_const(victims)) {
+        evict(connection, "slow consumer");
+    }
+
+    if (!anyCongested) {
+        m_congestionTimer->stop();
+    }
+}
+
+void ConnectionShard::evict(ClientConnection *connection, const char *reason)
+{
+    qWarning() << "Disconnecting" << connection->userId << "-" << reason
+               << "(" << connection->outbound.frameCount() << "frames,"
+               << connection->outbound.byteCount() << "bytes queued)";
+
+    // abort() drops the socket buffer too and emits disconnected, which
+    // removes and frees the connection. Defer it so callers that are still
+    // iterating (broadcasts, batch delivery) keep a valid context.
+    connection->evicted = true;
+    connection->outbound.clear();
+    QWebSocket *socket = connection->socket;
+    QMetaObject::invokeMethod(socket, [socket]() {
+        socket->abort();
+    }, Qt::QueuedConnection);
+}
+
+void ConnectionShard::reportQueue(ClientConnection *connection)
+{
+    emit queueStatsChanged(connection->id,
+                           connection->outbound.frameCount(),
+                           connection->outbound.byteCount(),
+                           connection->outbound.droppedCount());
+}
+
+void ConnectionShard::closeAll()
+{
+    const QList<ClientConnection *> connections = m_connections.values();
+    m_connections.clear();
+
+    for (ClientConnection *connection : connections) {
+        connection->socket->disconnect(this);
+        connection->socket->close();
+        delete connection->socket;
+        delete connection;
+    }
+}
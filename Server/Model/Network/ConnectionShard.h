@@ -0,0 +1,119 @@
+#ifndef CONNECTIONSHARD_H
+#define CONNECTIONSHARD_H
+
+#include <QObject>
+#include <QWebSocket>
+#include <QJsonObject>
+#include <QHash>
+#include <QElapsedTimer>
+#include "Model/Network/OutboundQueue.h"
+#include "AeadContext.h"
+#include "CryptoManager.h"
+#include "MessageSession.h"
+
+class QTimer;
+
+// Per-connection context, created when the socket is accepted and bound into
+// the socket's signal handlers so frames never need a lookup to find their
+// sender. Owned by the shard once adopted; only touched on the shard thread.
+struct ClientConnection {
+    quint64 id = 0;
+    QString userId;
+    QWebSocket *socket = nullptr;
+    bool binaryWire = false; // Negotiated binary wire mode
+    bool batching = false;   // Peer understands batch frames
+    bool versionedEnvelope = false; // Legacy IV|tag|ciphertext until negotiated
+    AeadCipher cipher = AeadCipher::Aes256Gcm; // Negotiated in the hello
+    PayloadCodec codec = PayloadCodec::None;   // One the peer can inflate
+    bool sessionNonces = false; // Counter-nonce envelopes in both directions
+    MessageSession inbound;     // The client's stream, when sessionNonces
+    // Ours to this client, under a salt of its own: a frame captured on one
+    // connection never authenticates on another
+    MessageSession sending;
+    bool adopted = false;
+    bool evicted = false;    // Abort is pending; send nothing more
+    OutboundQueue outbound;
+    qint64 congestedSince = -1; // Shard clock ms, -1 while keeping up
+};
+
+// Owns a subset of the server's client sockets and runs their I/O, decryption
+// and JSON parsing on whatever thread the shard lives in. WebSocketServer
+// creates one shard per worker thread and only ever talks to it through
+// queued invocations, so none of these slots may be called directly from
+// another thread.
+class ConnectionShard : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ConnectionShard(int index, QObject *parent = nullptr);
+    ~ConnectionShard();
+
+    int index() const { return m_index; }
+
+    // Creates the connection context and wires the socket's signals to this
+    // shard. Only calls connect(), so it is safe from the accepting thread and
+    // must run before the socket is moved, otherwise frames arriving in
+    // between would have no receiver.
+    ClientConnection *bindSocket(QWebSocket *socket, quint64 connectionId, const QString &userId);
+
+public slots:
+    // Takes ownership of a connection whose socket has been moved to this thread
+    void adoptConnection(ClientConnection *connection);
+    void sendToConnection(quint64 connectionId, const QString &message,
+                          DeliveryClass delivery = DeliveryClass::Reliable,
+                          const QString &coalesceKey = QString());
+    // Encrypted once per shard, not once per connection
+    void broadcast(const QString &message,
+                   DeliveryClass delivery = DeliveryClass::Reliable,
+                   const QString &coalesceKey = QString());
+    void setQueuePolicy(const OutboundQueuePolicy &policy);
+    // windowMs == 0 collects for one event-loop iteration
+    void setBatching(bool enabled, int windowMs);
+    void closeAll();
+
+signals:
+    void messageReceived(const QJsonObject &message, const QString &senderId);
+    void connectionClosed(quint64 connectionId);
+    // Reported when a connection becomes congested, drains, and periodically in between
+    void queueStatsChanged(quint64 connectionId, int frames, qint64 bytes, quint64 dropped);
+
+private:
+    // A message accepted during the current batching window
+    struct PendingMessage {
+        quint64 connectionId; // 0: every connection on the shard
+        QByteArray plaintext;
+        DeliveryClass delivery;
+        QString coalesceKey;
+    };
+
+    void flushPending();
+    // Frames in the wire format negotiated by connection (framing, envelope,
+    // cipher, codec); reusable for any connection with the same
+    // frameVariant(), except session frames, which only fit their own
+    QList<OutboundFrame> buildFrames(const QList<PendingMessage> &pending,
+                                     const QList<int> &items, ClientConnection *connection);
+    static int frameVariant(const ClientConnection *connection);
+    static QByteArray seal(ClientConnection *connection, const QByteArray &plaintext);
+    void processPlaintext(ClientConnection *connection, const QByteArray &plaintext);
+    void processMessage(ClientConnection *connection, const QJsonObject &obj);
+    void handleHello(ClientConnection *connection, const QJsonObject &hello);
+    void handlePing(ClientConnection *connection, const QJsonObject &ping);
+    void sendEnvelope(ClientConnection *connection, const QByteArray &envelope);
+    void enqueue(ClientConnection *connection, const OutboundFrame &frame);
+    void drainQueue(ClientConnection *connection);
+    void checkCongestion();
+    void evict(ClientConnection *connection, const char *reason);
+    void reportQueue(ClientConnection *connection);
+    void removeConnection(ClientConnection *connection);
+
+    int m_index;
+    OutboundQueuePolicy m_policy;
+    QTimer *m_congestionTimer;
+    bool m_batchingEnabled;
+    QTimer *m_flushTimer;
+    QList<PendingMessage> m_pending;
+    QElapsedTimer m_clock;
+    QHash<quint64, ClientConnection *> m_connections;
+};
+
+#endif // CONNECTIONSHARD_H
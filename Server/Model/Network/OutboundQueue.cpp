@@ -0,0 +1,68 @@
+#include "Model/Network/OutboundQueue.h"
+
+OutboundQueue::PushResult OutboundQueue::push(const OutboundFrame &frame, const OutboundQueuePolicy &policy)
+{
+    // Only the latest state matters for coalescable frames (e.g. repeated
+    // edits). The replacement goes to the back rather than into the old
+    // slot: frames must leave in the order they were encrypted, or session
+    // counters would arrive out of order.
+    if (!frame.coalesceKey.isEmpty()) {
+        for (auto it = m_frames.begin(); it != m_frames.end(); ++it) {
+            if (it->coalesceKey == frame.coalesceKey) {
+                m_bytes += frame.envelope.size() - it->envelope.size();
+                m_frames.erase(it);
+                m_frames.append(frame);
+                return PushResult::Coalesced;
+            }
+        }
+    }
+
+    // Being asked to queue at all means the peer is behind. Keyed ephemeral
+    // frames are kept (at most one per key); the rest are not worth holding.
+    if (frame.delivery == DeliveryClass::Ephemeral && frame.coalesceKey.isEmpty()) {
+        ++m_dropped;
+        return PushResult::Dropped;
+    }
+
+    const qint64 overflow = m_bytes + frame.envelope.size() - policy.maxQueuedBytes;
+    if (overflow > 0 && shedEphemeral(overflow) < overflow) {
+        if (frame.delivery == DeliveryClass::Ephemeral) {
+            ++m_dropped;
+            return PushResult::Dropped;
+        }
+        return PushResult::Overflow;
+    }
+
+    m_frames.append(frame);
+    m_bytes += frame.envelope.size();
+    return PushResult::Queued;
+}
+
+OutboundFrame OutboundQueue::takeFirst()
+{
+    OutboundFrame frame = m_frames.takeFirst();
+    m_bytes -= frame.envelope.size();
+    return frame;
+}
+
+void OutboundQueue::clear()
+{
+    m_frames.clear();
+    m_bytes = 0;
+}
+
+qint64 OutboundQueue::shedEphemeral(qint64 bytesNeeded)
+{
+    qint64 freed = 0;
+    for (auto it = m_frames.begin(); it != m_frames.end() && freed < bytesNeeded;) {
+        if (it->delivery == DeliveryClass::Ephemeral) {
+            freed += it->envelope.size();
+            ++m_dropped;
+            it = m_frames.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    m_bytes -= freed;
+    return freed;
+}
@@ -0,0 +1,63 @@
+#ifndef OUTBOUNDQUEUE_H
+#define OUTBOUNDQUEUE_H
+
+#include <QByteArray>
+#include <QString>
+#include <QList>
+
+// How a frame may be treated when its connection cannot keep up
+enum class DeliveryClass {
+    Reliable,   // Queued until written or the client is evicted
+    Ephemeral   // Dropped while the connection is congested, unless it can be
+                // coalesced by key; shed first when the queue hits its limit
+};
+
+struct OutboundFrame {
+    QByteArray envelope;    // Raw encrypted payload, encoded per wire mode on write
+    DeliveryClass delivery = DeliveryClass::Reliable;
+    QString coalesceKey;    // A newer frame with the same key replaces a queued one
+                            // and moves to the back of the queue
+};
+
+// Thresholds shared by all connections of a server
+struct OutboundQueuePolicy {
+    // Stop handing frames to QWebSocket once bytesToWrite() reaches this...
+    qint64 highWatermark = 1 * 1024 * 1024;
+    // ...and resume once it has drained below this
+    qint64 lowWatermark = 256 * 1024;
+    // Bytes we are willing to hold per connection on top of the socket buffer
+    qint64 maxQueuedBytes = 8 * 1024 * 1024;
+    // A connection that stays congested this long is disconnected
+    int evictAfterMs = 30000;
+};
+
+// Per-connection backlog that sits in front of QWebSocket's own (unbounded)
+// write buffer. Not thread-safe; lives inside a ClientConnection.
+class OutboundQueue
+{
+public:
+    enum class PushResult {
+        Queued,
+        Coalesced,
+        Dropped,
+        Overflow    // Reliable data would exceed maxQueuedBytes
+    };
+
+    PushResult push(const OutboundFrame &frame, const OutboundQueuePolicy &policy);
+    OutboundFrame takeFirst();
+
+    bool isEmpty() const { return m_frames.isEmpty(); }
+    int frameCount() const { return m_frames.size(); }
+    qint64 byteCount() const { return m_bytes; }
+    quint64 droppedCount() const { return m_dropped; }
+    void clear();
+
+private:
+    qint64 shedEphemeral(qint64 bytesNeeded);
+
+    QList<OutboundFrame> m_frames;
+    qint64 m_bytes = 0;
+    quint64 m_dropped = 0;
+};
+
+#endif // OUTBOUNDQUEUE_H
@@ -0,0 +1,28 @@
+#ifndef PRESENCE_H
+#define PRESENCE_H
+
+#include <QList>
+#include <QMetaType>
+#include <QString>
+
+// One connected user as seen by presence consumers
+struct PresenceEntry {
+    QString userId;        // "User #1"
+    QString peerAddress;
+    bool congested = false; // Outbound queue is backed up
+
+    // The form shown in user lists, "User #1 - 127.0.0.1"
+    QString displayName() const { return QString("%1 - %2").arg(userId, peerAddress); }
+};
+
+// Full state at a given version. Every presence event carries the version it
+// produces, one higher than the previous event's; a consumer that sees a gap
+// (or starts late) resynchronises from a snapshot.
+struct PresenceSnapshot {
+    quint64 version = 0;
+    QList<PresenceEntry> users;
+};
+
+Q_DECLARE_METATYPE(PresenceEntry)
+
+#endif // PRESENCE_H
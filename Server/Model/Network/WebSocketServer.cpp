@@ -1,16 +1,28 @@
 #include "Model/Network/WebSocketServer.h"
 #include "Model/Network/TusServer.h"
-#include "CryptoManager.h"
+#include "Model/Network/ConnectionShard.h"
+#include <QThread>
+#include <QTimer>
 #include <QHostAddress>
-#include <QNetworkInterface>
+#include "NetworkIdentity.h"
 
-WebSocketServer::WebSocketServer(quint16 port, QObject *parent)
+WebSocketServer::WebSocketServer(quint16 port, int shardCount, QObject *parent)
     : QObject(parent)
     , m_pWebSocketServer(new QWebSocketServer(QStringLiteral("Echo Server"),
                                               QWebSocketServer::NonSecureMode,
                                               this))
+    , m_nextShard(0)
+    , m_presenceVersion(0)
+    , m_presenceTimer(new QTimer(this))
     , m_tusServer(new TusServer(this))
 {
+    qRegisterMetaType<PresenceEntry>();
+    m_presenceTimer->setSingleShot(true);
+    m_presenceTimer->setInterval(0);
+    connect(m_presenceTimer, &QTimer::timeout, this, &WebSocketServer::flushPresence);
+
+    startShards(shardCount);
+
     if (m_pWebSocketServer->listen(QHostAddress::Any, port)) {
         connect(m_pWebSocketServer, &QWebSocketServer::newConnection,
                 this, &WebSocketServer::onNewConnection);
@@ -31,16 +43,7 @@ WebSocketServer::~WebSocketServer()
     if (m_pWebSocketServer)
         m_pWebSocketServer->close();
 
-    foreach (QWebSocket* m_client, m_clients)
-    {
-        if(m_client)
-        {
-            m_client->close();
-            m_client->deleteLater();
-            m_client = nullptr;
-        }
-
-    }
+    stopShards();
 
     // Stop TUS server
     if (m_tusServer) {
@@ -48,172 +51,290 @@ WebSocketServer::~WebSocketServer()
     }
 }
 
+void WebSocketServer::startShards(int shardCount)
+{
+    if (shardCount < 0) {
+        shardCount = qMax(1, QThread::idealThreadCount());
+    }
+
+    if (shardCount == 0) {
+        // Inline mode: a single shard that shares this object's thread
+        ConnectionShard *shard = new ConnectionShard(0, this);
+        connect(shard, &ConnectionShard::messageReceived, this, &WebSocketServer::messageReceived);
+        connect(shard, &ConnectionShard::connectionClosed, this, &WebSocketServer::onConnectionClosed);
+        connect(shard, &ConnectionShard::queueStatsChanged, this, &WebSocketServer::onQueueStatsChanged);
+        m_shards.append(shard);
+        return;
+    }
+
+    for (int i = 0; i < shardCount; ++i) {
+        QThread *thread = new QThread(this);
+        thread->setObjectName(QStringLiteral("ws-shard-%1").arg(i));
+
+        // No parent: the shard must be movable and is deleted on its own thread
+        ConnectionShard *shard = new ConnectionShard(i);
+        shard->moveToThread(thread);
+        connect(thread, &QThread::finished, shard, &QObject::deleteLater);
+
+        // Cross-thread connections are queued, so these land on our thread
+        connect(shard, &ConnectionShard::messageReceived, this, &WebSocketServer::messageReceived);
+        connect(shard, &ConnectionShard::connectionClosed, this, &WebSocketServer::onConnectionClosed);
+        connect(shard, &ConnectionShard::queueStatsChanged, this, &WebSocketServer::onQueueStatsChanged);
+
+        thread->start();
+        m_shards.append(shard);
+        m_shardThreads.append(thread);
+    }
+}
+
+void WebSocketServer::stopShards()
+{
+    for (ConnectionShard *shard : std::as_const(m_shards)) {
+        if (shard->thread() == thread()) {
+            shard->closeAll();
+        } else {
+            QMetaObject::invokeMethod(shard, &ConnectionShard::closeAll, Qt::BlockingQueuedConnection);
+        }
+    }
+
+    for (QThread *thread : std::as_const(m_shardThreads)) {
+        thread->quit();
+        thread->wait();
+    }
+
+    m_shards.clear();
+    m_shardThreads.clear();
+    m_registry.clear();
+}
+
 void WebSocketServer::onNewConnection()
 {
-    QWebSocket *pSocket = m_pWebSocketServer->nextPendingConnection();
-    QString userId = generateUserId(pSocket);
-    
-    connect(pSocket, &QWebSocket::textMessageReceived,
-            this, &WebSocketServer::processMessage);
-    connect(pSocket, &QWebSocket::disconnected,
-            this, &WebSocketServer::socketDisconnected);
-
-    m_clients.append(pSocket);
-    m_clientIds.insert(pSocket, userId);
-    updateUserList();
-}
-
-void WebSocketServer::processMessage(QString message)
-{
-    QString decryptedMessage = CryptoManager::decryptMessage(message);
-    QWebSocket *pClient = qobject_cast<QWebSocket *>(sender());
-    QString senderId = m_clientIds.value(pClient, "Unknown");
-    
-    // Emit signal with sender ID so ChatController can display it on server
-    emit messageReceived(decryptedMessage, senderId);
-    
-    // NOTE: Do NOT broadcast to other clients automatically
-}
-
-void WebSocketServer::socketDisconnected()
-{
-    QWebSocket *pClient = qobject_cast<QWebSocket *>(sender());
-    if (pClient) {
-        QString userId = m_clientIds.value(pClient, "Unknown");
-        
-        m_clients.removeAll(pClient);
-        m_clientIds.remove(pClient);
-        pClient->deleteLater();
-        
-        updateUserList();
-    }
-}
-
-// void WebSocketServer::sendMessage(const QString &message){
-//     QString encryptedMessage = CryptoManager::encryptMessage(message);
-//     if (encryptedMessage.isEmpty()) {
-//         qWarning() << "Cannot send empty message";
-//         return;
-    
-//     // Send message to all connected clients
-//     bool sentToAny = false;
-//     for (QWebSocket *client : m_clients) {
-//         if (client && client->state() == QAbstractSocket::ConnectedState) {
-//             sentToAny = true;
-//         }
-//     }
-    
-//     if (!sentToAny) {
-//         qWarning() << "No connected clients to send message to.";
-//     }
-// }
-
-void WebSocketServer::updateUserList()
-{
-    QStringList users = getConnectedUsers();
-    int count = m_clients.size();
-    
-    emit userListChanged(users);
-    emit userCountChanged(count);
+    while (m_pWebSocketServer->hasPendingConnections()) {
+        QWebSocket *pSocket = m_pWebSocketServer->nextPendingConnection();
+        if (!pSocket) {
+            break;
+        }
+
+        ConnectionShard *shard = m_shards.at(m_nextShard);
+        m_nextShard = (m_nextShard + 1) % m_shards.size();
+
+        const ConnectionEntry &entry = m_registry.add(generateUserId(m_registry.nextId()),
+                                                      pSocket->peerAddress().toString(),
+                                                      shard);
+        notePresence(PresenceChange::Joined, entry);
+
+        // Bind the per-connection context and hand the socket over to the
+        // shard's thread before it sees any frames
+        ClientConnection *connection = shard->bindSocket(pSocket, entry.id, entry.userId);
+        pSocket->setParent(nullptr);
+        if (shard->thread() != thread()) {
+            pSocket->moveToThread(shard->thread());
+        }
+        QMetaObject::invokeMethod(shard, [shard, connection]() {
+            shard->adoptConnection(connection);
+        }, Qt::QueuedConnection);
+    }
+}
+
+void WebSocketServer::onConnectionClosed(quint64 connectionId)
+{
+    const ConnectionEntry *entry = m_registry.findById(connectionId);
+    if (!entry) {
+        return;
+    }
+
+    notePresence(PresenceChange::Left, *entry);
+    m_registry.remove(connectionId);
+}
+
+void WebSocketServer::onQueueStatsChanged(quint64 connectionId, int frames, qint64 bytes, quint64 dropped)
+{
+    ConnectionEntry *entry = m_registry.findById(connectionId);
+    if (!entry) {
+        return;
+    }
+
+    const bool wasCongested = entry->queue.frames > 0;
+    entry->queue.frames = frames;
+    entry->queue.bytes = bytes;
+    entry->queue.dropped = dropped;
+    emit outboundQueueChanged(entry->userId, frames, bytes, dropped);
+
+    if (wasCongested != (frames > 0)) {
+        notePresence(PresenceChange::Updated, *entry);
+    }
+}
+
+void WebSocketServer::setOutboundQueuePolicy(const OutboundQueuePolicy &policy)
+{
+    m_queuePolicy = policy;
+    for (ConnectionShard *shard : std::as_const(m_shards)) {
+        QMetaObject::invokeMethod(shard, [shard, policy]() {
+            shard->setQueuePolicy(policy);
+        }, Qt::QueuedConnection);
+    }
+}
+
+void WebSocketServer::setBatchingEnabled(bool enabled, int windowMs)
+{
+    for (ConnectionShard *shard : std::as_const(m_shards)) {
+        QMetaObject::invokeMethod(shard, [shard, enabled, windowMs]() {
+            shard->setBatching(enabled, windowMs);
+        }, Qt::QueuedConnection);
+    }
+}
+
+OutboundQueueStats WebSocketServer::outboundQueueStats(const QString &userId) const
+{
+    const ConnectionEntry *entry = findConnection(userId);
+    return entry ? entry->queue : OutboundQueueStats();
+}
+
+void WebSocketServer::notePresence(PresenceChange change, const ConnectionEntry &entry)
+{
+    PendingPresence pending{change, entry.id, {entry.userId, entry.peerAddress, entry.queue.frames > 0}, false};
+
+    auto existing = m_pendingPresenceIndex.constFind(entry.id);
+    if (existing != m_pendingPresenceIndex.cend()) {
+        PendingPresence &queued = m_pendingPresence[existing.value()];
+        if (queued.change == PresenceChange::Joined && change == PresenceChange::Left) {
+            // Never published, so nobody needs to hear about it
+            queued.cancelled = true;
+            m_pendingPresenceIndex.erase(existing);
+            return;
+        }
+        if (queued.change == PresenceChange::Joined) {
+            queued.user = pending.user;   // Join with the latest state
+        } else {
+            queued = pending;            // Last update or the leave wins
+        }
+        return;
+    }
+
+    m_pendingPresenceIndex.insert(entry.id, m_pendingPresence.size());
+    m_pendingPresence.append(pending);
+    if (!m_presenceTimer->isActive()) {
+        m_presenceTimer->start();
+    }
+}
+
+void WebSocketServer::flushPresence()
+{
+    const QList<PendingPresence> pending = std::move(m_pendingPresence);
+    m_pendingPresence.clear();
+    m_pendingPresenceIndex.clear();
+
+    bool countChanged = false;
+    for (const PendingPresence &change : pending) {
+        if (change.cancelled) {
+            continue;
+        }
+
+        // Publish before emitting, so a consumer resyncing from inside a
+        // handler gets a snapshot at exactly this version
+        ++m_presenceVersion;
+        switch (change.change) {
+        case PresenceChange::Joined:
+            m_presence.insert(change.connectionId, change.user);
+            countChanged = true;
+            emit userJoined(change.user, m_presenceVersion);
+            break;
+        case PresenceChange::Left:
+            m_presence.remove(change.connectionId);
+            countChanged = true;
+            emit userLeft(change.user.userId, m_presenceVersion);
+            break;
+        case PresenceChange::Updated:
+            m_presence.insert(change.connectionId, change.user);
+            emit userUpdated(change.user, m_presenceVersion);
+            break;
+        }
+    }
+
+    if (countChanged) {
+        emit userCountChanged(m_presence.size());
+    }
+}
+
+PresenceSnapshot WebSocketServer::presenceSnapshot() const
+{
+    PresenceSnapshot snapshot;
+    snapshot.version = m_presenceVersion;
+    snapshot.users = m_presence.values();
+    return snapshot;
 }
 
 QStringList WebSocketServer::getConnectedUsers() const
 {
     QStringList users;
-    for (QWebSocket *client : m_clients) {
-        QString userId = m_clientIds.value(client, "Unknown");
-        QString userInfo = QString("%1 - %2").arg(userId, client->peerAddress().toString());
+    const QList<ConnectionEntry> entries = m_registry.entries();
+    users.reserve(entries.size());
+    for (const ConnectionEntry &entry : entries) {
+        QString userInfo = QString("%1 - %2").arg(entry.userId, entry.peerAddress);
         users.append(userInfo);
     }
     return users;
 }
 
-QString WebSocketServer::generateUserId(QWebSocket *socket)
+QString WebSocketServer::generateUserId(quint64 connectionId) const
 {
-    static int userCounter = 1;
-    return QString("User #%1").arg(userCounter++);
+    return QString("User #%1").arg(connectionId);
 }
 
-void WebSocketServer::sendMessageToClient(const QString &userId, const QString &message)
+void WebSocketServer::sendMessageToClient(const QString &userId, const QString &message,
+                                          DeliveryClass delivery, const QString &coalesceKey)
 {
-    QString encryptedMessage = CryptoManager::encryptMessage(message);
-    if (encryptedMessage.isEmpty()) {
+    if (message.isEmpty()) {
         qWarning() << "Cannot send empty message";
         return;
     }
-    
-    
-    QWebSocket *targetSocket = getSocketByUserId(userId);
-    if (targetSocket) {
-        
-        if (targetSocket->state() == QAbstractSocket::ConnectedState) {
-            qint64 bytesSent = targetSocket->sendTextMessage(encryptedMessage);
-        } else {
-            qWarning() << "✗ Socket not connected, state:" << targetSocket->state();
-        }
-    } else {
+
+    const ConnectionEntry *entry = findConnection(userId);
+    if (!entry) {
         qWarning() << "✗ Client" << userId << "not found";
+        return;
     }
+
+    // Encryption happens on the shard thread
+    ConnectionShard *shard = entry->shard;
+    const quint64 connectionId = entry->id;
+    QMetaObject::invokeMethod(shard, [shard, connectionId, message, delivery, coalesceKey]() {
+        shard->sendToConnection(connectionId, message, delivery, coalesceKey);
+    }, Qt::QueuedConnection);
 }
 
-void WebSocketServer::broadcastToAll(const QString &message)
+void WebSocketServer::broadcastToAll(const QString &message,
+                                     DeliveryClass delivery, const QString &coalesceKey)
 {
-    
-    QString encryptedMessage = CryptoManager::encryptMessage(message);
-    
-    if (encryptedMessage.isEmpty()) {
-        qWarning() << "✗ Cannot send empty encrypted message";
+    if (message.isEmpty()) {
+        qWarning() << "✗ Cannot broadcast empty message";
         return;
     }
-    
-    // Send message to all connected clients
-    int sentCount = 0;
-    int totalClients = 0;
-    for (QWebSocket *client : m_clients) {
-        totalClients++;
-        QString userId = m_clientIds.value(client, "Unknown");
-        
-        if (client && client->state() == QAbstractSocket::ConnectedState) {
-            qint64 bytesSent = client->sendTextMessage(encryptedMessage);
-            sentCount++;
-        } else {
-        }
-    }
-    
-    if (sentCount > 0) {
-    } else {
+
+    // Each shard encrypts once for all of its clients, off this thread, and
+    // may fold the message into a batch with others sent in the same tick
+    for (ConnectionShard *shard : std::as_const(m_shards)) {
+        QMetaObject::invokeMethod(shard, [shard, message, delivery, coalesceKey]() {
+            shard->broadcast(message, delivery, coalesceKey);
+        }, Qt::QueuedConnection);
     }
 }
 
-QWebSocket* WebSocketServer::getSocketByUserId(const QString &userId)
+const ConnectionEntry* WebSocketServer::findConnection(const QString &userId) const
 {
-    // Extract just the user ID part (before " - IP") and trim whitespace
-    QString cleanUserId = userId.split(" - ").first().trimmed();
-    
-    for (auto it = m_clientIds.begin(); it != m_clientIds.end(); ++it) {
-        if (it.value() == cleanUserId || it.value().trimmed() == userId.trimmed()) {
-            return it.key();
-        }
+    if (const ConnectionEntry *entry = m_registry.findByUserId(userId)) {
+        return entry;
+    }
+
+    // Fall back to the display form "User #1 - 127.0.0.1"
+    const int separator = userId.indexOf(QLatin1String(" - "));
+    if (separator < 0) {
+        return m_registry.findByUserId(userId.trimmed());
     }
-    return nullptr;
+    return m_registry.findByUserId(userId.left(separator).trimmed());
 }
 
 QString WebSocketServer::getServerIpAddress() const
 {
-    // Get the first non-loopback IPv4 address
-    QList<QHostAddress> addresses = QNetworkInterface::allAddresses();
-    
-    for (const QHostAddress &address : addresses) {
-        // Skip loopback and IPv6 addresses
-        if (address.protocol() == QAbstractSocket::IPv4Protocol && 
-            !address.isLoopback() && 
-            address != QHostAddress::LocalHost) {
-            
-            QString ip = address.toString();
-            return ip;
-        }
-    }
-    
-    // Fallback to localhost if no network interface found
-    return "localhost";
+    return NetworkIdentity::instance().advertisedHost();
 }
@@ -4,43 +4,102 @@
 #include <QObject>
 #include <QWebSocketServer>
 #include <QWebSocket>
+#include <QJsonObject>
+#include <QVector>
 #include <QMap>
+#include "Model/Network/ConnectionRegistry.h"
+#include "Model/Network/Presence.h"
+#include "Model/Network/OutboundQueue.h"
 
 class TusServer;
+class ConnectionShard;
+class QThread;
+class QTimer;
 class WebSocketServer : public QObject
 {
     Q_OBJECT
 public:
-    explicit WebSocketServer(quint16 port, QObject *parent = nullptr);
+    // shardCount < 0 picks one worker thread per core, 0 keeps every socket on
+    // the calling thread (the old single-threaded behaviour)
+    explicit WebSocketServer(quint16 port, int shardCount = -1, QObject *parent = nullptr);
     ~WebSocketServer();
 
     // void sendMessage(const QString &message);
-    void sendMessageToClient(const QString &userId, const QString &message);
-    void broadcastToAll(const QString &message);
+    void sendMessageToClient(const QString &userId, const QString &message,
+                             DeliveryClass delivery = DeliveryClass::Reliable,
+                             const QString &coalesceKey = QString());
+    void broadcastToAll(const QString &message,
+                        DeliveryClass delivery = DeliveryClass::Reliable,
+                        const QString &coalesceKey = QString());
     QStringList getConnectedUsers() const;
-    int getConnectedUserCount() const { return m_clients.size(); }
+    // State matching the version of the last presence event emitted
+    PresenceSnapshot presenceSnapshot() const;
+    quint64 presenceVersion() const { return m_presenceVersion; }
+    int getConnectedUserCount() const { return m_registry.size(); }
+    int shardCount() const { return m_shards.size(); }
+
+    // Backpressure thresholds applied to every connection's outbound queue
+    void setOutboundQueuePolicy(const OutboundQueuePolicy &policy);
+    OutboundQueuePolicy outboundQueuePolicy() const { return m_queuePolicy; }
+    // Last reported queue depth, for monitoring
+    OutboundQueueStats outboundQueueStats(const QString &userId) const;
+    // Coalesce messages sent within windowMs (0: one event-loop tick) into a
+    // single frame for clients that negotiated batching
+    void setBatchingEnabled(bool enabled, int windowMs = 0);
     
-    // Get server's IP address (for file sharing)
+    // Cached advertised host (for file sharing), see NetworkIdentity
     QString getServerIpAddress() const;
 
 signals:
-    void messageReceived(const QString &message, const QString &senderId);
-    void userListChanged(const QStringList &users);
+    // Frames are decrypted and parsed on the shard threads; only JSON objects get here
+    void messageReceived(const QJsonObject &message, const QString &senderId);
+    // Presence deltas, each one version ahead of the previous. Joins, leaves
+    // and updates within one event-loop tick are coalesced: a client that
+    // connects and drops in the same tick produces no events at all.
+    void userJoined(const PresenceEntry &user, quint64 version);
+    void userLeft(const QString &userId, quint64 version);
+    void userUpdated(const PresenceEntry &user, quint64 version);
+    // Once per coalesced batch of presence changes
     void userCountChanged(int count);
+    void outboundQueueChanged(const QString &userId, int frames, qint64 bytes, quint64 dropped);
 
 private slots:
     void onNewConnection();
-    void processMessage(QString message);
-    void socketDisconnected();
+    void onConnectionClosed(quint64 connectionId);
+    void onQueueStatsChanged(quint64 connectionId, int frames, qint64 bytes, quint64 dropped);
+    void flushPresence();
 
 private:
-    void updateUserList();
-    QString generateUserId(QWebSocket *socket);
-    QWebSocket* getSocketByUserId(const QString &userId);
+    void startShards(int shardCount);
+    void stopShards();
+    enum class PresenceChange {
+        Joined,
+        Left,
+        Updated
+    };
+    struct PendingPresence {
+        PresenceChange change;
+        quint64 connectionId;
+        PresenceEntry user;
+        bool cancelled;
+    };
+    void notePresence(PresenceChange change, const ConnectionEntry &entry);
+    QString generateUserId(quint64 connectionId) const;
+    const ConnectionEntry* findConnection(const QString &userId) const;
 
     QWebSocketServer *m_pWebSocketServer;
-    QList<QWebSocket *> m_clients;
-    QMap<QWebSocket *, QString> m_clientIds;
+    QVector<ConnectionShard *> m_shards;
+    QVector<QThread *> m_shardThreads;
+    int m_nextShard;
+    ConnectionRegistry m_registry;
+    OutboundQueuePolicy m_queuePolicy;
+
+    // Presence as published to consumers, in accept order
+    QMap<quint64, PresenceEntry> m_presence;
+    quint64 m_presenceVersion;
+    QList<PendingPresence> m_pendingPresence;
+    QHash<quint64, int> m_pendingPresenceIndex;
+    QTimer *m_presenceTimer;
     TusServer *m_tusServer;
 };
 
@@ -0,0 +1,90 @@
+#include "ServerOptions.h"
+#include "NetworkIdentity.h"
+#include <QCoreApplication>
+#include <QDebug>
+
+void ServerOptions::addTo(QCommandLineParser &parser)
+{
+    parser.addOption(QCommandLineOption("shards",
+        "Number of WebSocket worker threads (default: one per core, 0: run on the main thread).",
+        "count", "-1"));
+    parser.addOption(QCommandLineOption("batch-window",
+        "Coalesce outgoing messages for this many milliseconds (0: one event-loop tick, default: off).",
+        "ms", "-1"));
+    parser.addOption(QCommandLineOption("compression",
+        "Codec for message payloads above the threshold: none, deflate or zstd (default: deflate).",
+        "codec", "deflate"));
+    parser.addOption(QCommandLineOption("compression-threshold",
+        "Smallest payload in bytes that gets compressed, 0-65535 (default: 512).",
+        "bytes", "512"));
+    parser.addOption(QCommandLineOption("queue-high-watermark",
+        "Stop writing to a client's socket once this many bytes are buffered (default: 1048576).",
+        "bytes", "1048576"));
+    parser.addOption(QCommandLineOption("queue-low-watermark",
+        "Resume writing once the socket buffer drains below this (default: 262144).",
+        "bytes", "262144"));
+    parser.addOption(QCommandLineOption("queue-max-bytes",
+        "Bytes queued per client on top of the socket buffer before it is disconnected (default: 8388608).",
+        "bytes", "8388608"));
+    parser.addOption(QCommandLineOption("evict-after",
+        "Disconnect a client that stays congested this long (default: 30000).",
+        "ms", "30000"));
+    parser.addOption(QCommandLineOption("database",
+        "Path of the SQLite database (default: server_chat.db next to the executable).",
+        "path"));
+    parser.addOption(QCommandLineOption("cipher",
+        "Preferred message cipher: auto, aes-256-gcm or chacha20-poly1305 (default: auto, ChaCha20 without AES instructions).",
+        "name", "auto"));
+    parser.addOption(QCommandLineOption("advertise-host",
+        "Host name or address put in file links and TUS URLs (default: first non-loopback IPv4).",
+        "host"));
+}
+
+ServerOptions ServerOptions::fromParser(const QCommandLineParser &parser)
+{
+    ServerOptions options;
+    options.shards = parser.value("shards").toInt();
+    options.batchWindowMs = parser.value("batch-window").toInt();
+
+    const QString codec = parser.value("compression");
+    options.compression.codec = codec == "none" ? PayloadCodec::None
+                              : codec == "zstd" ? PayloadCodec::Zstd
+                                                : PayloadCodec::Deflate;
+    options.compression.threshold = parser.value("compression-threshold").toInt();
+    if (!CryptoManager::setCompressionPolicy(options.compression)) {
+        options.compression = CryptoManager::compressionPolicy();
+    }
+
+    OutboundQueuePolicy queue;
+    queue.highWatermark = parser.value("queue-high-watermark").toLongLong();
+    queue.lowWatermark = parser.value("queue-low-watermark").toLongLong();
+    queue.maxQueuedBytes = parser.value("queue-max-bytes").toLongLong();
+    queue.evictAfterMs = parser.value("evict-after").toInt();
+    if (queue.lowWatermark <= 0 || queue.highWatermark <= queue.lowWatermark
+        || queue.maxQueuedBytes <= 0 || queue.evictAfterMs <= 0) {
+        qWarning() << "Outbound queue limits need 0 < low watermark < high watermark and positive"
+                   << "max bytes and eviction time - using the defaults";
+    } else {
+        options.queue = queue;
+    }
+
+    options.cipher = parser.value("cipher");
+    AeadCipher cipher;
+    if (CryptoManager::cipherFromName(options.cipher, cipher)) {
+        CryptoManager::setPreferredCipher(cipher);
+    } else if (options.cipher != "auto") {
+        qWarning() << "Unknown cipher" << options.cipher << "- following the CPU";
+        options.cipher = "auto";
+    }
+
+    // Use absolute path for database to ensure consistency
+    options.databasePath = parser.value("database");
+    if (options.databasePath.isEmpty()) {
+        options.databasePath = QCoreApplication::applicationDirPath() + "/server_chat.db";
+    }
+
+    // Resolves the network identity once, on the main thread
+    options.advertisedHost = parser.value("advertise-host");
+    NetworkIdentity::instance().setOverride(options.advertisedHost);
+    return options;
+}
@@ -0,0 +1,25 @@
+#ifndef SERVEROPTIONS_H
+#define SERVEROPTIONS_H
+
+#include <QCommandLineParser>
+#include <QString>
+#include "CryptoManager.h"
+#include "Model/Network/OutboundQueue.h"
+
+// Command line shared by the GUI and headless server executables
+struct ServerOptions {
+    int shards = -1;
+    int batchWindowMs = -1;   // < 0: batching off
+    CompressionPolicy compression;
+    OutboundQueuePolicy queue;  // Per-connection backpressure limits
+    QString databasePath;
+    QString advertisedHost;
+    QString cipher = "auto";  // Preferred AEAD; auto follows the CPU   // empty: detect from the network interfaces
+
+    // Registers the options on parser; call before parser.process()
+    static void addTo(QCommandLineParser &parser);
+    // Reads them back after parser.process() and applies process-wide settings
+    static ServerOptions fromParser(const QCommandLineParser &parser);
+};
+
+#endif // SERVEROPTIONS_H
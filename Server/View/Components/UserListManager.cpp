@@ -19,64 +19,132 @@ void UserListManager::updateUsers(const QStringList &users)
     if (!m_listWidget) return;
 
     m_listWidget->clear();
+    m_items.clear();
 
+    for (const QString &user : users) {
+        createUserItem(user);
+    }
+
+    refreshListState();
+}
+
+void UserListManager::addUser(const QString &user)
+{
+    if (!m_listWidget) return;
+
+    const QString userId = userIdOf(user);
+    if (m_items.contains(userId)) {
+        updateUser(userId, user, true);
+        return;
+    }
+
+    createUserItem(user);
+    refreshListState();
+}
+
+void UserListManager::removeUser(const QString &userId)
+{
+    if (!m_listWidget) return;
+
+    QListWidgetItem *item = m_items.take(userIdOf(userId));
+    if (!item) {
+        return;
+    }
+
+    // Deleting the item also deletes its card
+    delete m_listWidget->takeItem(m_listWidget->row(item));
+    refreshListState();
+}
+
+void UserListManager::updateUser(const QString &userId, const QString &user, bool isOnline)
+{
+    QListWidgetItem *item = itemForUser(userId);
+    if (!item) {
+        return;
+    }
+
+    item->setData(Qt::UserRole, user);
+    if (UserCard *card = cardForUser(userId)) {
+        card->setName(user);
+        card->setOnlineStatus(isOnline);
+    }
+}
+
+QListWidgetItem *UserListManager::itemForUser(const QString &userId) const
+{
+    return m_items.value(userIdOf(userId), nullptr);
+}
+
+UserCard *UserListManager::cardForUser(const QString &userId) const
+{
+    QListWidgetItem *item = itemForUser(userId);
+    if (!item || !m_listWidget) {
+        return nullptr;
+    }
+    return qobject_cast<UserCard*>(m_listWidget->itemWidget(item));
+}
+
+QString UserListManager::userIdOf(const QString &user)
+{
+    return user.split(" - ").first().trimmed();
+}
+
+void UserListManager::refreshListState()
+{
     // Update count label
     if (m_countLabel) {
-        m_countLabel->setText(QString("%1 User").arg(users.size()));
+        m_countLabel->setText(QString("%1 User").arg(m_items.size()));
     }
 
     // Handle Empty State
-    if (users.isEmpty()) {
-        if (m_stackedWidget) {
-            m_stackedWidget->setCurrentIndex(1); // Show Empty State
-        }
-        return;
-    } else {
-        if (m_stackedWidget) {
-            m_stackedWidget->setCurrentIndex(0); // Show List
-        }
+    if (m_stackedWidget) {
+        m_stackedWidget->setCurrentIndex(m_items.isEmpty() ? 1 : 0); // 1: Empty State, 0: List
     }
+}
 
-    for (const QString &user : users) {
-        QListWidgetItem *item = new QListWidgetItem(m_listWidget);
-        UserCard *card = new UserCard(m_listWidget);
-        card->setName(user);
-        card->setMessage("Click to open chat"); // Placeholder
-        card->setTime(""); // Placeholder
-        card->setLayoutDirection(Qt::LeftToRight);
-        
-        // Generate avatar from name initials
-        QPixmap userAvatar(48, 48);
-        // Generate a random-ish color based on name hash
-        int hash = qHash(user);
-        QColor bg = QColor::fromHsl(qAbs(hash) % 360, 200, 150); 
-        userAvatar.fill(bg);
-        QPainter p2(&userAvatar);
-        p2.setPen(Qt::white);
-        
-        QFont f = p2.font();
-        f.setPixelSize(24);
-        p2.setFont(f);
-        QString initials = user.left(1).toUpper();
-        if (user.contains(" ")) {
-            initials += user.split(" ").last().left(1).toUpper();
-        }
-        p2.drawText(userAvatar.rect(), Qt::AlignCenter, initials);
-        card->setAvatar(userAvatar);
-        
-        // Online status (assume online if in list)
-        card->setOnlineStatus(true);
-
-        // Set size hint explicitly with some padding to prevent overlap
-        item->setSizeHint(QSize(244, 112)); 
-        m_listWidget->setItemWidget(item, card);
-        item->setData(Qt::UserRole, user);
-
-        connect(card, &UserCard::clicked, this, [this, item]() {
-            m_listWidget->setCurrentItem(item);
-            onItemClicked(item);
-        });
+QListWidgetItem *UserListManager::createUserItem(const QString &user)
+{
+    QListWidgetItem *item = new QListWidgetItem(m_listWidget);
+    UserCard *card = new UserCard(m_listWidget);
+    card->setName(user);
+    card->setMessage("Click to open chat"); // Placeholder
+    card->setTime(""); // Placeholder
+    card->setLayoutDirection(Qt::LeftToRight);
+    
+    // Generate avatar from name initials
+    QPixmap userAvatar(48, 48);
+    // Generate a random-ish color based on name hash
+    int hash = qHash(user);
+    QColor bg = QColor::fromHsl(qAbs(hash) % 360, 200, 150); 
+    userAvatar.fill(bg);
+    QPainter p2(&userAvatar);
+    p2.setPen(Qt::white);
+    
+    QFont f = p2.font();
+    f.setPixelSize(24);
+    p2.setFont(f);
+    QString initials = user.left(1).toUpper();
+    if (user.contains(" ")) {
+        initials += user.split(" ").last().left(1).toUpper();
     }
+    p2.drawText(userAvatar.rect(), Qt::AlignCenter, initials);
+    card->setAvatar(userAvatar);
+    
+    // Online status (assume online if in list)
+    card->setOnlineStatus(true);
+
+    // Set size hint explicitly with some padding to prevent overlap
+    item->setSizeHint(QSize(244, 112)); 
+    m_listWidget->setItemWidget(item, card);
+    item->setData(Qt::UserRole, user);
+
+    connect(card, &UserCard::clicked, this, [this, item]() {
+        m_listWidget->setCurrentItem(item);
+        onItemClicked(item);
+    });
+
+    m_items.insert(userIdOf(user), item);
+    return item;
 }
 
 void UserListManager::updateSelection(const QString &currentUser, bool isPrivateChat)
@@ -5,6 +5,9 @@
 #include <QListWidget>
 #include <QLabel>
 #include <QStackedWidget>
+#include <QHash>
+
+class UserCard;
 
 class UserListManager : public QObject
 {
@@ -12,7 +15,16 @@ class UserListManager : public QObject
 public:
     explicit UserListManager(QListWidget *listWidget, QLabel *countLabel, QStackedWidget *stackedWidget, QObject *parent = nullptr);
 
+    // Full rebuild, for the initial state and presence resyncs
     void updateUsers(const QStringList &users);
+    // Incremental presence updates; users are keyed by their id ("User #1"),
+    // the part of the display string before " - "
+    void addUser(const QString &user);
+    void removeUser(const QString &userId);
+    void updateUser(const QString &userId, const QString &user, bool isOnline);
+    UserCard *cardForUser(const QString &userId) const;
+    QListWidgetItem *itemForUser(const QString &userId) const;
+    static QString userIdOf(const QString &user);
     void updateSelection(const QString &currentUser, bool isPrivateChat);
     void updateUserCount(int count);
 
@@ -23,9 +35,13 @@ private slots:
     void onItemClicked(QListWidgetItem *item);
 
 private:
+    QListWidgetItem *createUserItem(const QString &user);
+    void refreshListState();
+
     QListWidget *m_listWidget;
     QLabel *m_countLabel;
     QStackedWidget *m_stackedWidget;
+    QHash<QString, QListWidgetItem *> m_items;
 };
 
 #endif // USERLISTMANAGER_H
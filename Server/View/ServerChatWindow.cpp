@@ -10,7 +10,8 @@
 #include <QResizeEvent>
 #include <QRegularExpression>
 
-#include "../../CommonCore/NotificationManager.h"
+#include "NotificationManager.h"
+#include "NetworkIdentity.h"
 // --- ADD THESE INCLUDES ---
 #include <QFileDialog>
 #include <QMessageBox>
@@ -18,6 +19,7 @@
 #include <QLabel>
 #include <QHBoxLayout>
 #include <QPixmap>
+#include <QPointer>
 #include <QListWidget>
 #include <QStandardPaths>
 #include <QDir>
@@ -39,7 +41,7 @@
 #include <QVideoEncoderSettings>
 #include <QMultimedia>
 #endif
-#include "TusUploader.h"
+#include "TransferScheduler.h"
 #include "AudioWaveform.h"
 #include "MessageAliases.h"
 #include "InfoCard.h"
@@ -261,6 +263,27 @@ void ServerChatWindow::updateUserList(const QStringList &users)
     }
 }
 
+void ServerChatWindow::addUser(const QString &user)
+{
+    if (m_userListManager) {
+        m_userListManager->addUser(user);
+    }
+}
+
+void ServerChatWindow::removeUser(const QString &userId)
+{
+    if (m_userListManager) {
+        m_userListManager->removeUser(userId);
+    }
+}
+
+void ServerChatWindow::updateUser(const QString &userId, const QString &user, bool isOnline)
+{
+    if (m_userListManager) {
+        m_userListManager->updateUser(userId, user, isOnline);
+    }
+}
+
 void ServerChatWindow::updateUserCount(int count)
 {
     if (m_userListManager) {
@@ -382,7 +405,11 @@ void ServerChatWindow::onSendFileClicked()
     if (filePath.isEmpty()) {
         return;
     }
+    uploadFile(filePath);
+}
 
+void ServerChatWindow::uploadFile(const QString &filePath)
+{
     // **FIX: ایجاد FileMessageItem قبل از شروع آپلود**
     QFileInfo fileInfo(filePath);
     QString fileName = fileInfo.fileName();
@@ -396,7 +423,7 @@ void ServerChatWindow::onSendFileClicked()
         "", // URL بعداً set می‌شود
         "You",
         MessageDirection::Outgoing,
-        "localhost",
+        NetworkIdentity::instance().advertisedHost(),
         timestamp
     );
     
@@ -407,19 +434,20 @@ void ServerChatWindow::onSendFileClicked()
     addMessageItem(fileItem);
 
     // This is the server you started with ./tusd
-    QUrl tusEndpoint("http://localhost:1080/files/");
-    TusUploader *uploader = new TusUploader(this);
+    QUrl tusEndpoint(NetworkIdentity::instance().tusEndpoint());
+    QPointer<TransferJob> upload = TransferScheduler::instance().submitUpload(
+        filePath, tusEndpoint, TransferScheduler::priorityFor(fileName));
+    fileItem->setTransfer(upload);
 
     // **FIX: اتصال progress به InfoCard**
     InfoCard* infoCard = fileItem->findChild<InfoCard*>();
     if (infoCard) {
-        connect(uploader, &TusUploader::uploadProgress, infoCard, &InfoCard::updateProgress);
+        connect(upload, &TransferJob::progress, infoCard, &InfoCard::updateProgress);
         // **NEW: اتصال دکمه Cancel**
         connect(infoCard, &InfoCard::cancelClicked, this, [=]() {
             // Cancel upload safely
-            if (uploader) {
-                uploader->cancelUpload();
-                uploader->deleteLater();
+            if (upload) {
+                upload->cancel();
             }
             // **FIX: حذف QListWidgetItem از لیست چت**
             for (int i = 0; i < ui->chatHistoryWdgt->count(); ++i) {
@@ -434,9 +462,9 @@ void ServerChatWindow::onSendFileClicked()
         });
     }
 
-    // --- Connect signals from the uploader ---
+    // --- Connect signals from the upload ---
 
-    connect(uploader, &TusUploader::finished, this, [=](const QString &uploadUrl, qint64 uploadedSize) {
+    connect(upload, &TransferJob::finished, this, [=](const QString &uploadUrl, qint64 uploadedSize) {
         // Update file item with actual URL
         if (fileItem) {
             fileItem->setFileUrl(uploadUrl);
@@ -446,18 +474,14 @@ void ServerChatWindow::onSendFileClicked()
             infoCard->setState(InfoCard::State::Completed_Sent);
         }
         // Emit signal for saving to database and sending via WebSocket
-        emit fileUploaded(fileName, uploadUrl, uploadedSize, "localhost");
-        uploader->deleteLater();
+        emit fileUploaded(fileName, uploadUrl, uploadedSize, NetworkIdentity::instance().advertisedHost());
     });
 
-    connect(uploader, &TusUploader::error, this, [=](const QString &error) {
+    connect(upload, &TransferJob::error, this, [=](const QString &error) {
         QMessageBox::critical(this, "Upload Error", error);
         // حذف FileMessageItem در صورت خطا
         fileItem->deleteLater();
-        uploader->deleteLater();
     });
-    // --- Start the upload ---
-    uploader->startUpload(filePath, tusEndpoint);
 }
 
 void ServerChatWindow::handleSendMessage()
@@ -912,7 +936,7 @@ void ServerChatWindow::onRecorderStateChanged(QMediaRecorder::RecorderState stat
                     "You",
                     MessageDirection::Outgoing,
                     QDateTime::currentDateTime().toString("hh:mm"),
-                    "localhost",
+                    NetworkIdentity::instance().advertisedHost(),
                     waveform
                 );
                 
@@ -920,17 +944,18 @@ void ServerChatWindow::onRecorderStateChanged(QMediaRecorder::RecorderState stat
                 addMessageItem(voiceItem);
                 
                 // Now upload with waveform data
-                TusUploader *uploader = new TusUploader(this);
-                QUrl tusEndpoint = QUrl("http://localhost:1080/files/");
+                QUrl tusEndpoint = QUrl(NetworkIdentity::instance().tusEndpoint());
+                TransferJob *upload = TransferScheduler::instance().submitUpload(
+                    recordingPath, tusEndpoint, TransferPriority::Voice);
 
                 // Connect progress to VoiceMessageItem
-                connect(uploader, &TusUploader::uploadProgress, this, [voiceItem](qint64 bytesSent, qint64 bytesTotal) {
+                connect(upload, &TransferJob::progress, this, [voiceItem](qint64 bytesSent, qint64 bytesTotal) {
                     if (voiceItem && bytesTotal > 0) {
                         voiceItem->setInProgressState(bytesSent, bytesTotal);
                     }
                 });
 
-                connect(uploader, &TusUploader::finished, this, [this, uploader, fileInfo, waveform, voiceItem](const QString &fileUrl, qint64 uploadedSize, const QByteArray &) {
+                connect(upload, &TransferJob::finished, this, [this, fileInfo, waveform, voiceItem](const QString &fileUrl, qint64 uploadedSize, const QByteArray &) {
                     
                     // Update voice item with actual URL
                     if (voiceItem) {
@@ -939,22 +964,17 @@ void ServerChatWindow::onRecorderStateChanged(QMediaRecorder::RecorderState stat
                     }
                     
                     // Emit with waveform data
-                    emit fileUploaded(fileInfo.fileName(), fileUrl, fileInfo.size(), "localhost", waveform);
-                    
-                    uploader->deleteLater();
+                    emit fileUploaded(fileInfo.fileName(), fileUrl, fileInfo.size(), NetworkIdentity::instance().advertisedHost(), waveform);
                 });
 
-                connect(uploader, &TusUploader::error, this, [this, uploader, voiceItem](const QString &errorMsg) {
+                connect(upload, &TransferJob::error, this, [voiceItem](const QString &errorMsg) {
                     
                     // Remove voice item on error
                     if (voiceItem) {
                         voiceItem->deleteLater();
                     }
-                    
-                    uploader->deleteLater();
                 });
 
-                uploader->startUpload(recordingPath, tusEndpoint, false);
                 waveformGen->deleteLater();
             });
             
@@ -1007,35 +1027,36 @@ void ServerChatWindow::setupInputArea()
 // --- ADD THIS NEW FUNCTION ---
 void ServerChatWindow::updateUserCardInfo(const QString &username, const QString &lastMessage, const QString &time, int unreadCount)
 {
-    for (int i = 0; i < ui->userListWdgt->count(); ++i) {
-        QListWidgetItem *item = ui->userListWdgt->item(i);
-        QString itemUser = item->data(Qt::UserRole).toString();
-        QString cleanItemUser = itemUser.split(" - ").first().trimmed();
-        
-        // Match against full string OR clean user ID
-        if (itemUser == username || cleanItemUser == username) {
-            QWidget *widget = ui->userListWdgt->itemWidget(item);
-            if (UserCard *card = qobject_cast<UserCard*>(widget)) {
-                if (!lastMessage.isEmpty()) {
-                    card->setMessage(lastMessage);
-                }
-                if (!time.isEmpty()) {
-                    card->setTime(time);
-                }
-                
-                // Only update unread count if we are NOT currently chatting with this user
-                // If we are chatting with them, the count should remain cleared (0)
-                // Check against both full and clean ID for current target
-                bool isCurrentTarget = (m_currentTargetUser == itemUser || m_currentTargetUser == cleanItemUser);
-                
-                if (m_isPrivateChat && isCurrentTarget) {
-                    card->setUnreadCount(0);
-                } else {
-                    card->setUnreadCount(unreadCount);
-                }
-            }
-            break;
-        }
+    if (!m_userListManager) {
+        return;
+    }
+
+    // Indexed by user id, so per-message updates do not scan the list
+    QListWidgetItem *item = m_userListManager->itemForUser(username);
+    UserCard *card = m_userListManager->cardForUser(username);
+    if (!item || !card) {
+        return;
+    }
+
+    QString itemUser = item->data(Qt::UserRole).toString();
+    QString cleanItemUser = UserListManager::userIdOf(itemUser);
+
+    if (!lastMessage.isEmpty()) {
+        card->setMessage(lastMessage);
+    }
+    if (!time.isEmpty()) {
+        card->setTime(time);
+    }
+    
+    // Only update unread count if we are NOT currently chatting with this user
+    // If we are chatting with them, the count should remain cleared (0)
+    // Check against both full and clean ID for current target
+    bool isCurrentTarget = (m_currentTargetUser == itemUser || m_currentTargetUser == cleanItemUser);
+    
+    if (m_isPrivateChat && isCurrentTarget) {
+        card->setUnreadCount(0);
+    } else {
+        card->setUnreadCount(unreadCount);
     }
 }
 
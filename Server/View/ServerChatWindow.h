@@ -75,6 +75,9 @@ public:
     void refreshMessageItem(QWidget *messageItem);
 
     void updateUserList(const QStringList &users);
+    void addUser(const QString &user);
+    void removeUser(const QString &userId);
+    void updateUser(const QString &userId, const QString &user, bool isOnline);
     void updateUserCount(int count);
     void setPrivateChatMode(const QString &userId);
     void setBroadcastMode();
@@ -91,6 +94,7 @@ private:
     bool m_isPrivateChat;
     QString m_currentTargetUser;
     QProgressBar *m_uploadProgressBar;
+    void uploadFile(const QString &filePath);
     
     // Voice recording
     void updateInputModeButtons();
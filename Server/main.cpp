@@ -3,23 +3,34 @@
 #include "Model/Network/WebSocketServer.h"
 #include "Model/Network/TusServer.h"
 #include "Model/Core/DatabaseManager.h"
+#include "Model/Core/ChatRouter.h"
 #include "ServerController.h"
 #include <QMessageBox>
+#include <QCommandLineParser>
+#include "ServerOptions.h"
 
 int main(int argc, char *argv[])
 {
     QApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    ServerOptions::addTo(parser);
+    parser.process(app);
+    const ServerOptions options = ServerOptions::fromParser(parser);
     
     // Server-only setup
     ServerChatWindow *serverWindow = new ServerChatWindow();
     
     // Initialize server components
-    WebSocketServer *wsServer = new WebSocketServer(8080);  // Pass port to constructor
+    WebSocketServer *wsServer = new WebSocketServer(8080, options.shards);
     TusServer *tusServer = new TusServer();
+    wsServer->setOutboundQueuePolicy(options.queue);
+    if (options.batchWindowMs >= 0) {
+        wsServer->setBatchingEnabled(true, options.batchWindowMs);
+    }
     
-    // Use absolute path for database to ensure consistency
-    QString dbPath = QCoreApplication::applicationDirPath() + "/server_chat.db";
-    DatabaseManager *db = new DatabaseManager(dbPath);  // Pass database path
+    DatabaseManager *db = new DatabaseManager(options.databasePath);  // Pass database path
     
     // Initialize database
     if (!db->initDatabase()) {
@@ -28,12 +39,9 @@ int main(int argc, char *argv[])
         return 1;
     }
     
-    // Create server controller
-    ServerController *controller = new ServerController(
-        serverWindow,
-        wsServer,
-        db
-    );
+    // Routing runs without the GUI; the controller only attaches the window
+    ChatRouter *router = new ChatRouter(wsServer, db);
+    ServerController *controller = new ServerController(serverWindow, router);
     
     // Start TUS server (WebSocketServer starts in constructor)
     if (!tusServer->start(1080)) {  // Use start() method
@@ -51,6 +59,7 @@ int main(int argc, char *argv[])
     // Cleanup
     tusServer->stop();  // Use stop() method
     delete controller;
+    delete router;
     delete db;
     delete tusServer;
     delete wsServer;
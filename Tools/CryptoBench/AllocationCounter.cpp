@@ -0,0 +1,54 @@
+#include "AllocationCounter.h"
+#include <atomic>
+#include <cstddef>
+
+namespace {
+std::atomic<quint64> g_allocations{0};
+}
+
+#if defined(__GLIBC__)
+
+// Defining malloc in the executable interposes it for every shared library;
+// glibc still exports its own implementation under these names
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *pointer, size_t size);
+
+void *malloc(size_t size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *pointer, size_t size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(pointer, size);
+}
+}
+
+bool AllocationCounter::isSupported()
+{
+    return true;
+}
+
+#else
+
+bool AllocationCounter::isSupported()
+{
+    return false;
+}
+
+#endif
+
+quint64 AllocationCounter::count()
+{
+    return g_allocations.load(std::memory_order_relaxed);
+}
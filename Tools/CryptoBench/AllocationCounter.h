@@ -0,0 +1,17 @@
+#ifndef ALLOCATIONCOUNTER_H
+#define ALLOCATIONCOUNTER_H
+
+#include <QtGlobal>
+
+// Counts heap allocations made anywhere in the process (Qt, OpenSSL and
+// operator new all end up in malloc). Only available where malloc can be
+// wrapped, which is glibc; elsewhere isSupported() is false and the count
+// stays at zero.
+namespace AllocationCounter {
+
+bool isSupported();
+quint64 count();
+
+}
+
+#endif // ALLOCATIONCOUNTER_H
@@ -0,0 +1,767 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QRandomGenerator>
+#include <QTextStream>
+#include <QDateTime>
+#include <QList>
+#include <QCryptographicHash>
+#include <QFile>
+#include <QTemporaryDir>
+#include <QThread>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include "CryptoManager.h"
+#include "AeadContext.h"
+#include "ChunkedStream.h"
+#include "DownloadWriter.h"
+#include "MessageSession.h"
+#include "AllocationCounter.h"
+#include <openssl/evp.h>
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <memory>
+
+// Offline measurements for CryptoManager. Each benchmark prints a plain text
+// table to stdout (the suite can print JSON instead); nothing here talks to
+// the network.
+
+namespace {
+
+struct Sample {
+    QString name;
+    QByteArray payload;
+};
+
+QByteArray textMessage(int contentLength)
+{
+    static const QString words[] = {
+        "the", "meeting", "moved", "to", "three", "please", "check", "the",
+        "attached", "notes", "before", "we", "start", "and", "send", "feedback"
+    };
+    QString content;
+    QRandomGenerator rng(42);
+    while (content.size() < contentLength) {
+        if (!content.isEmpty()) {
+            content += ' ';
+        }
+        content += words[rng.bounded(16)];
+    }
+    content.truncate(contentLength);
+
+    return QString(R"({"type":"text","content":"%1","sender":"Client","timestamp":"%2"})")
+        .arg(content, QDateTime::currentDateTime().toString("hh:mm"))
+        .toUtf8();
+}
+
+QByteArray voiceMessage()
+{
+    // Same shape ClientController sends: 50 downsampled RMS values
+    QRandomGenerator rng(7);
+    QString waveform = "[";
+    for (int i = 0; i < 50; ++i) {
+        if (i > 0) waveform += ",";
+        waveform += QString::number(rng.generateDouble(), 'f', 4);
+    }
+    waveform += "]";
+
+    return QString(R"({"type":"voice","fileName":"voice_20240101_120000.m4a","fileSize":48213,"fileUrl":"http://192.168.1.20:1080/files/3f2a9c1e","duration":0,"waveform":%1,"sender":"Client","timestamp":"12:00"})")
+        .arg(waveform)
+        .toUtf8();
+}
+
+QByteArray batchOf(const QByteArray &message, int count)
+{
+    QByteArray batch("[");
+    for (int i = 0; i < count; ++i) {
+        if (i > 0) batch.append(',');
+        batch.append(message);
+    }
+    batch.append(']');
+    return batch;
+}
+
+QList<Sample> envelopeSamples()
+{
+    return {
+        {"short text", textMessage(24)},
+        {"long text", textMessage(2000)},
+        {"voice", voiceMessage()},
+        {"batch x20", batchOf(textMessage(120), 20)},
+    };
+}
+
+// Bytes on the wire and round-trip cost for every available codec
+int runEnvelope(QTextStream &out, int iterations)
+{
+    const CompressionPolicy original = CryptoManager::compressionPolicy();
+
+    out << qSetFieldWidth(12) << Qt::left << "payload" << "codec"
+        << qSetFieldWidth(10) << Qt::right << "plain" << "binary" << "text"
+        << "saved" << "us/op" << qSetFieldWidth(0) << Qt::endl;
+
+    for (const Sample &sample : envelopeSamples()) {
+        qint64 baseline = -1;
+        for (PayloadCodec codec : {PayloadCodec::None, PayloadCodec::Deflate, PayloadCodec::Zstd}) {
+            if (!CryptoManager::isCodecAvailable(codec)) {
+                continue;
+            }
+
+            CompressionPolicy policy = original;
+            policy.codec = codec;
+            policy.threshold = 0;
+            CryptoManager::setCompressionPolicy(policy);
+
+            QByteArray envelope;
+            QElapsedTimer timer;
+            timer.start();
+            for (int i = 0; i < iterations; ++i) {
+                envelope = CryptoManager::encryptPayload(sample.payload, AeadCipher::Aes256Gcm, codec);
+                if (CryptoManager::decryptPayload(envelope) != sample.payload) {
+                    out << "round trip failed for " << sample.name << Qt::endl;
+                    CryptoManager::setCompressionPolicy(original);
+                    return 1;
+                }
+            }
+            const double usPerOp = double(timer.nsecsElapsed()) / 1000.0 / iterations;
+
+            const qint64 binary = envelope.size();
+            const qint64 text = envelope.toBase64().size();
+            if (baseline < 0) {
+                baseline = binary;
+            }
+            const double saved = 100.0 * double(baseline - binary) / double(baseline);
+
+            out << qSetFieldWidth(12) << Qt::left << sample.name << CryptoManager::codecName(codec)
+                << qSetFieldWidth(10) << Qt::right << sample.payload.size() << binary << text
+                << QString::number(saved, 'f', 1) + "%" << QString::number(usPerOp, 'f', 1)
+                << qSetFieldWidth(0) << Qt::endl;
+        }
+    }
+
+    CryptoManager::setCompressionPolicy(original);
+    return 0;
+}
+
+// What every call used to do: allocate, fetch the cipher, expand the key
+bool sealWithFreshContext(const QByteArray &plaintext, const QByteArray &key, const QByteArray &iv,
+                          QByteArray &ciphertext, QByteArray &tag)
+{
+    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+    if (!ctx) {
+        return false;
+    }
+    ciphertext.resize(plaintext.size());
+    tag.resize(16);
+    int outlen = 0;
+    const bool ok = EVP_EncryptInit_ex(ctx, EVP_aes_256_gcm(), nullptr, nullptr, nullptr) == 1
+        && EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_IVLEN, iv.size(), nullptr) == 1
+        && EVP_EncryptInit_ex(ctx, nullptr, nullptr,
+                              reinterpret_cast<const unsigned char*>(key.constData()),
+                              reinterpret_cast<const unsigned char*>(iv.constData())) == 1
+        && EVP_EncryptUpdate(ctx, reinterpret_cast<unsigned char*>(ciphertext.data()), &outlen,
+                             reinterpret_cast<const unsigned char*>(plaintext.constData()), plaintext.size()) == 1
+        && EVP_EncryptFinal_ex(ctx, reinterpret_cast<unsigned char*>(ciphertext.data()) + outlen, &outlen) == 1
+        && EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, 16, tag.data()) == 1;
+    EVP_CIPHER_CTX_free(ctx);
+    return ok;
+}
+
+// Per-message cost of a fresh EVP context against the cached per-thread one
+int runContext(QTextStream &out, int iterations)
+{
+    const QByteArray key = CryptoManager::generateAES256Key();
+    const QByteArray iv = CryptoManager::generateGCMIV();
+
+    out << qSetFieldWidth(10) << Qt::right << "bytes" << "fresh" << "cached" << "speedup"
+        << qSetFieldWidth(0) << Qt::endl;
+
+    for (int size : {16, 64, 256, 1024, 4096, 65536}) {
+        QByteArray plaintext(size, Qt::Uninitialized);
+        QRandomGenerator(size).fillRange(reinterpret_cast<quint32*>(plaintext.data()), size / 4);
+        QByteArray ciphertext, tag;
+
+        QElapsedTimer timer;
+        timer.start();
+        for (int i = 0; i < iterations; ++i) {
+            if (!sealWithFreshContext(plaintext, key, iv, ciphertext, tag)) {
+                out << "fresh context failed" << Qt::endl;
+                return 1;
+            }
+        }
+        const double freshUs = double(timer.nsecsElapsed()) / 1000.0 / iterations;
+
+        QByteArray ivCopy = iv;
+        timer.restart();
+        for (int i = 0; i < iterations; ++i) {
+            if (!CryptoManager::encryptAESGCM256(plaintext, key, ciphertext, ivCopy, tag)) {
+                out << "cached context failed" << Qt::endl;
+                return 1;
+            }
+        }
+        const double cachedUs = double(timer.nsecsElapsed()) / 1000.0 / iterations;
+
+        out << qSetFieldWidth(10) << Qt::right << size
+            << QString::number(freshUs, 'f', 2) << QString::number(cachedUs, 'f', 2)
+            << QString::number(freshUs / cachedUs, 'f', 2) + "x"
+            << qSetFieldWidth(0) << Qt::endl;
+    }
+    return 0;
+}
+
+// Both AEAD suites over chat message sizes and upload chunk sizes
+int runCipher(QTextStream &out, int iterations)
+{
+    const QByteArray key = CryptoManager::generateAES256Key();
+    const QByteArray iv = CryptoManager::generateGCMIV();
+    const auto *ivBytes = reinterpret_cast<const unsigned char*>(iv.constData());
+
+    out << "AES instructions: " << (AeadContext::hasAesAcceleration() ? "yes" : "no")
+        << ", preferred: " << CryptoManager::cipherName(CryptoManager::preferredCipher()) << Qt::endl;
+    out << qSetFieldWidth(10) << Qt::right << "bytes" << qSetFieldWidth(14) << "gcm MB/s" << "chacha MB/s"
+        << qSetFieldWidth(10) << "ratio" << qSetFieldWidth(0) << Qt::endl;
+
+    for (int size : {64, 256, 1024, 4096, 65536, 1024 * 1024, 5 * 1024 * 1024}) {
+        QByteArray buffer(size, 'x');
+        unsigned char tag[AeadContext::TagSize];
+        auto *data = reinterpret_cast<unsigned char*>(buffer.data());
+        const int reps = int(qMax<qint64>(3, qint64(iterations) * 1024 / qMax(size, 1024)));
+
+        double mbPerSecond[2] = {0, 0};
+        for (AeadCipher cipher : {AeadCipher::Aes256Gcm, AeadCipher::ChaCha20Poly1305}) {
+            AeadContext ctx(AeadContext::Direction::Encrypt, cipher);
+            if (!ctx.setKey(key)) {
+                out << "cannot load " << CryptoManager::cipherName(cipher) << Qt::endl;
+                return 1;
+            }
+            QElapsedTimer timer;
+            timer.start();
+            for (int i = 0; i < reps; ++i) {
+                if (!ctx.seal(ivBytes, nullptr, 0, data, size, data, tag)) {
+                    out << CryptoManager::cipherName(cipher) << " failed" << Qt::endl;
+                    return 1;
+                }
+            }
+            const double seconds = double(timer.nsecsElapsed()) / 1e9;
+            mbPerSecond[int(cipher)] = double(size) * reps / seconds / 1e6;
+        }
+
+        out << qSetFieldWidth(10) << Qt::right << size << qSetFieldWidth(14)
+            << QString::number(mbPerSecond[0], 'f', 1) << QString::number(mbPerSecond[1], 'f', 1)
+            << qSetFieldWidth(10) << QString::number(mbPerSecond[1] / mbPerSecond[0], 'f', 2) + "x"
+            << qSetFieldWidth(0) << Qt::endl;
+    }
+    return 0;
+}
+
+// Random-IV envelopes against counter-nonce session envelopes, round trip
+int runSession(QTextStream &out, int iterations)
+{
+    const CompressionPolicy original = CryptoManager::compressionPolicy();
+    CompressionPolicy policy = original;
+    policy.codec = PayloadCodec::None;
+    CryptoManager::setCompressionPolicy(policy);
+
+    out << qSetFieldWidth(12) << Qt::left << "payload"
+        << qSetFieldWidth(10) << Qt::right << "plain" << "iv bytes" << "ctr bytes"
+        << "iv us/op" << "ctr us/op" << qSetFieldWidth(0) << Qt::endl;
+
+    for (const Sample &sample : envelopeSamples()) {
+        QByteArray envelope;
+        QElapsedTimer timer;
+        timer.start();
+        for (int i = 0; i < iterations; ++i) {
+            envelope = CryptoManager::encryptPayload(sample.payload);
+            if (CryptoManager::decryptPayload(envelope) != sample.payload) {
+                out << "random IV round trip failed" << Qt::endl;
+                CryptoManager::setCompressionPolicy(original);
+                return 1;
+            }
+        }
+        const double ivUs = double(timer.nsecsElapsed()) / 1000.0 / iterations;
+        const qsizetype ivBytes = envelope.size();
+
+        const QByteArray salt = MessageSession::generateSalt();
+        MessageSession sender;
+        MessageSession receiver;
+        sender.start(salt, 0, AeadCipher::Aes256Gcm, AeadContext::Direction::Encrypt);
+        receiver.start(salt, 0, AeadCipher::Aes256Gcm, AeadContext::Direction::Decrypt);
+        timer.restart();
+        for (int i = 0; i < iterations; ++i) {
+            envelope = CryptoManager::encryptPayload(sample.payload, sender);
+            if (CryptoManager::decryptPayload(envelope, &receiver) != sample.payload) {
+                out << "session round trip failed" << Qt::endl;
+                CryptoManager::setCompressionPolicy(original);
+                return 1;
+            }
+        }
+        const double counterUs = double(timer.nsecsElapsed()) / 1000.0 / iterations;
+
+        out << qSetFieldWidth(12) << Qt::left << sample.name
+            << qSetFieldWidth(10) << Qt::right << sample.payload.size() << ivBytes << envelope.size()
+            << QString::number(ivUs, 'f', 2) << QString::number(counterUs, 'f', 2)
+            << qSetFieldWidth(0) << Qt::endl;
+    }
+
+    CryptoManager::setCompressionPolicy(original);
+    return 0;
+}
+
+QByteArray sha256Of(const QString &path)
+{
+    QFile file(path);
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    if (!file.open(QIODevice::ReadOnly) || !hash.addData(&file)) {
+        return QByteArray();
+    }
+    return hash.result();
+}
+
+// Streaming file encryption against a plain copy of the same file, so the
+// MB/s figures can be read relative to what the disk manages anyway
+int runFile(QTextStream &out, qint64 fileMiB, int segmentKiB)
+{
+    QTemporaryDir dir;
+    if (!dir.isValid()) {
+        out << "cannot create a temporary directory" << Qt::endl;
+        return 1;
+    }
+    const QString plainPath = dir.filePath("plain.bin");
+    const QString copyPath = dir.filePath("copy.bin");
+    const QString sealedPath = dir.filePath("sealed.bin");
+    const QString openedPath = dir.filePath("opened.bin");
+
+    {
+        QFile plain(plainPath);
+        if (!plain.open(QIODevice::WriteOnly)) {
+            out << "cannot write " << plainPath << Qt::endl;
+            return 1;
+        }
+        QByteArray block(1024 * 1024, Qt::Uninitialized);
+        QRandomGenerator rng(1);
+        for (qint64 i = 0; i < fileMiB; ++i) {
+            rng.fillRange(reinterpret_cast<quint32*>(block.data()), block.size() / 4);
+            plain.write(block);
+        }
+    }
+    const QByteArray expected = sha256Of(plainPath);
+    const double megabytes = double(fileMiB) * 1024 * 1024 / 1e6;
+    auto mbPerSecond = [megabytes](qint64 nsecs) {
+        return QString::number(megabytes / (double(nsecs) / 1e9), 'f', 1);
+    };
+
+    QElapsedTimer timer;
+    timer.start();
+    if (!QFile::copy(plainPath, copyPath)) {
+        out << "copy failed" << Qt::endl;
+        return 1;
+    }
+    out << fileMiB << " MiB file, " << segmentKiB << " KiB segments, plain copy "
+        << mbPerSecond(timer.nsecsElapsed()) << " MB/s" << Qt::endl;
+    out << qSetFieldWidth(20) << Qt::left << "cipher" << qSetFieldWidth(14) << Qt::right
+        << "encrypt MB/s" << "decrypt MB/s" << "overhead" << qSetFieldWidth(0) << Qt::endl;
+
+    int result = 0;
+    for (AeadCipher cipher : {AeadCipher::Aes256Gcm, AeadCipher::ChaCha20Poly1305}) {
+        CryptoManager::setPreferredCipher(cipher);
+
+        timer.restart();
+        if (!CryptoManager::encryptFile(plainPath, sealedPath, QByteArray(), segmentKiB * 1024)) {
+            out << "encryptFile failed" << Qt::endl;
+            result = 1;
+            break;
+        }
+        const qint64 encryptNs = timer.nsecsElapsed();
+
+        timer.restart();
+        if (!CryptoManager::decryptFile(sealedPath, openedPath)) {
+            out << "decryptFile failed" << Qt::endl;
+            result = 1;
+            break;
+        }
+        const qint64 decryptNs = timer.nsecsElapsed();
+
+        if (sha256Of(openedPath) != expected) {
+            out << "file round trip failed" << Qt::endl;
+            result = 1;
+            break;
+        }
+
+        const qint64 overhead = QFile(sealedPath).size() - QFile(plainPath).size();
+        out << qSetFieldWidth(20) << Qt::left << CryptoManager::cipherName(cipher)
+            << qSetFieldWidth(14) << Qt::right << mbPerSecond(encryptNs) << mbPerSecond(decryptNs)
+            << QString("%1 B").arg(overhead) << qSetFieldWidth(0) << Qt::endl;
+    }
+
+    CryptoManager::clearPreferredCipher();
+    return result;
+}
+
+QByteArray randomBytes(qint64 size)
+{
+    QByteArray data((size + 3) & ~qint64(3), Qt::Uninitialized);
+    QRandomGenerator(quint32(size)).fillRange(reinterpret_cast<quint32*>(data.data()), data.size() / 4);
+    data.resize(size);
+    return data;
+}
+
+// The download writer fed an encrypted stream in network-sized reads:
+// throughput, copies per received byte and the most it ever buffered
+int runDownload(QTextStream &out, qint64 fileMiB)
+{
+    QTemporaryDir dir;
+    if (!dir.isValid()) {
+        out << "cannot create a temporary directory" << Qt::endl;
+        return 1;
+    }
+
+    // Same chunk size as TusUploader
+    const int chunkSize = 5 * 1024 * 1024;
+    const QByteArray key = CryptoManager::generateAES256Key();
+    const QByteArray plain = randomBytes(fileMiB * 1024 * 1024);
+    ChunkedStream stream;
+    if (!stream.create(key, CryptoManager::preferredCipher(), chunkSize)) {
+        out << "cannot create stream" << Qt::endl;
+        return 1;
+    }
+    QByteArray sealed = stream.header();
+    const qint64 chunks = stream.chunkCount(plain.size());
+    for (qint64 i = 0; i < chunks; ++i) {
+        QByteArray chunk = plain.mid(i * chunkSize, chunkSize);
+        const qsizetype length = chunk.size();
+        chunk.resize(length + AeadContext::TagSize);
+        stream.sealChunk(quint32(i), i == chunks - 1, chunk.data(), length);
+        sealed.append(chunk);
+    }
+
+    out << fileMiB << " MiB encrypted download, " << chunks << " chunks of " << chunkSize / 1024 << " KiB" << Qt::endl;
+    out << qSetFieldWidth(14) << Qt::left << "reads" << qSetFieldWidth(12) << Qt::right
+        << "MB/s" << "copies/B" << "peak KiB" << "in place" << "from slab" << qSetFieldWidth(0) << Qt::endl;
+
+    struct ReadPattern {
+        QString name;
+        qint64 minRead;
+        qint64 maxRead;
+    };
+    const QList<ReadPattern> patterns = {
+        {"16 KiB", 16 * 1024, 16 * 1024},
+        {"64K-2M", 64 * 1024, 2 * 1024 * 1024},
+        {"16 MiB", 16 * 1024 * 1024, 16 * 1024 * 1024},
+    };
+    const QString path = dir.filePath("download.bin");
+    const QByteArray expected = QCryptographicHash::hash(plain, QCryptographicHash::Sha256);
+
+    for (const ReadPattern &pattern : patterns) {
+        DownloadWriter writer;
+        bool failed = false;
+        QObject::connect(&writer, &DownloadWriter::failed, [&failed, &out](const QString &message) {
+            out << message << Qt::endl;
+            failed = true;
+        });
+
+        QRandomGenerator rng(7);
+        QElapsedTimer timer;
+        timer.start();
+        writer.open(path, true, key, QByteArray());
+        for (qint64 offset = 0; offset < sealed.size() && !failed;) {
+            const qint64 read = qMin(sealed.size() - offset,
+                                     pattern.minRead + qint64(rng.bounded(quint32(pattern.maxRead - pattern.minRead + 1))));
+            writer.append(sealed.mid(offset, read));
+            offset += read;
+        }
+        writer.finish();
+        const qint64 elapsedNs = timer.nsecsElapsed();
+
+        if (failed || sha256Of(path) != expected) {
+            out << "download round trip failed" << Qt::endl;
+            return 1;
+        }
+
+        const DownloadWriterStats &stats = writer.stats();
+        out << qSetFieldWidth(14) << Qt::left << pattern.name << qSetFieldWidth(12) << Qt::right
+            << QString::number(double(sealed.size()) / (double(elapsedNs) / 1e9) / 1e6, 'f', 1)
+            << QString::number(double(stats.bytesCopied) / double(stats.bytesReceived), 'f', 3)
+            << stats.peakBuffered / 1024 << stats.chunksInPlace << stats.chunksFromSlab
+            << qSetFieldWidth(0) << Qt::endl;
+    }
+    return 0;
+}
+
+// One operation of the suite; returns false when the crypto call failed.
+// Each thread gets its own from an OpFactory so no state is shared.
+using Op = std::function<bool()>;
+using OpFactory = std::function<Op(qint64 size)>;
+
+struct Measurement {
+    QString op;
+    qint64 bytes;
+    int threads;
+    qint64 ops;
+    double nsPerOp;       // Per operation on one thread
+    double mbPerSecond;   // All threads together
+    double allocsPerOp;
+};
+
+QString printableText(qint64 size)
+{
+    static const char alphabet[] = "abcdefghijklmnopqrstuvwxyz ";
+    QString text(size, Qt::Uninitialized);
+    QRandomGenerator rng(quint32(size));
+    for (qint64 i = 0; i < size; ++i) {
+        text[i] = QChar(alphabet[rng.bounded(int(sizeof(alphabet) - 1))]);
+    }
+    return text;
+}
+
+QList<QPair<QString, OpFactory>> suiteOps()
+{
+    QList<QPair<QString, OpFactory>> ops;
+
+    ops.append({"encryptMessage", [](qint64 size) -> Op {
+        const QString message = printableText(size);
+        return [message]() { return !CryptoManager::encryptMessage(message).isEmpty(); };
+    }});
+    ops.append({"decryptMessage", [](qint64 size) -> Op {
+        const QString message = printableText(size);
+        const QString encrypted = CryptoManager::encryptMessage(message);
+        return [encrypted, size]() { return CryptoManager::decryptMessage(encrypted).size() == size; };
+    }});
+
+    struct Gcm {
+        QByteArray key = CryptoManager::generateAES256Key();
+        QByteArray iv = CryptoManager::generateGCMIV();
+        QByteArray plaintext, ciphertext, tag, output;
+    };
+    ops.append({"encryptAESGCM256", [](qint64 size) -> Op {
+        auto state = std::make_shared<Gcm>();
+        state->plaintext = randomBytes(size);
+        return [state]() {
+            return CryptoManager::encryptAESGCM256(state->plaintext, state->key, state->ciphertext,
+                                                   state->iv, state->tag);
+        };
+    }});
+    ops.append({"decryptAESGCM256", [](qint64 size) -> Op {
+        auto state = std::make_shared<Gcm>();
+        state->plaintext = randomBytes(size);
+        CryptoManager::encryptAESGCM256(state->plaintext, state->key, state->ciphertext, state->iv, state->tag);
+        return [state]() {
+            return CryptoManager::decryptAESGCM256(state->ciphertext, state->key, state->iv,
+                                                   state->tag, state->output);
+        };
+    }});
+
+    // The chunk API that replaced encryptChunk/decryptChunk. Sizes below
+    // the minimum chunk size are a short final chunk.
+    struct Chunk {
+        ChunkedStream stream;
+        QByteArray buffer, sealed;
+    };
+    auto makeChunk = [](qint64 size) {
+        auto state = std::make_shared<Chunk>();
+        state->stream.create(CryptoManager::generateAES256Key(), CryptoManager::preferredCipher(),
+                             int(qMax<qint64>(ChunkedStream::MinChunkSize, size)));
+        state->buffer = randomBytes(size + AeadContext::TagSize);
+        return state;
+    };
+    ops.append({"sealChunk", [makeChunk](qint64 size) -> Op {
+        auto state = makeChunk(size);
+        return [state, size]() { return state->stream.sealChunk(0, true, state->buffer.data(), size); };
+    }});
+    ops.append({"openChunk", [makeChunk](qint64 size) -> Op {
+        auto state = makeChunk(size);
+        state->stream.sealChunk(0, true, state->buffer.data(), size);
+        state->sealed = state->buffer;
+        state->buffer.detach();
+        // Decrypts in place, so the ciphertext is restored first: compare
+        // with the memcpy row
+        return [state, size]() {
+            memcpy(state->buffer.data(), state->sealed.constData(), state->sealed.size());
+            return state->stream.openChunk(0, true, state->buffer.data(), size + AeadContext::TagSize);
+        };
+    }});
+    ops.append({"memcpy", [](qint64 size) -> Op {
+        auto from = std::make_shared<QByteArray>(randomBytes(size + AeadContext::TagSize));
+        auto to = std::make_shared<QByteArray>(from->size(), Qt::Uninitialized);
+        return [from, to]() {
+            memcpy(to->data(), from->constData(), from->size());
+            return true;
+        };
+    }});
+
+    return ops;
+}
+
+bool measure(const QString &name, const OpFactory &factory, qint64 size, int threads,
+             qint64 reps, Measurement &result)
+{
+    QList<Op> ops;
+    for (int t = 0; t < threads; ++t) {
+        ops.append(factory(size));
+        if (!ops.last()()) {   // Warm up: first-use allocations are not per-op cost
+            return false;
+        }
+    }
+
+    std::atomic<bool> ok{true};
+    auto run = [&ok, reps](const Op &op) {
+        for (qint64 i = 0; i < reps; ++i) {
+            if (!op()) {
+                ok = false;
+                return;
+            }
+        }
+    };
+
+    QList<QThread *> workers;
+    for (int t = 1; t < threads; ++t) {
+        const Op &op = ops.at(t);
+        workers.append(QThread::create([&run, &op]() { run(op); }));
+    }
+
+    const quint64 allocationsBefore = AllocationCounter::count();
+    QElapsedTimer timer;
+    timer.start();
+    for (QThread *worker : std::as_const(workers)) {
+        worker->start();
+    }
+    run(ops.first());
+    for (QThread *worker : std::as_const(workers)) {
+        worker->wait();
+    }
+    const qint64 elapsedNs = timer.nsecsElapsed();
+    const quint64 allocations = AllocationCounter::count() - allocationsBefore;
+    qDeleteAll(workers);
+
+    const qint64 totalOps = reps * threads;
+    result.op = name;
+    result.bytes = size;
+    result.threads = threads;
+    result.ops = totalOps;
+    result.nsPerOp = double(elapsedNs) / double(reps);
+    result.mbPerSecond = double(size) * double(totalOps) / (double(elapsedNs) / 1e9) / 1e6;
+    result.allocsPerOp = double(allocations) / double(totalOps);
+    return ok;
+}
+
+// ns/op, MB/s and allocations/op of the public crypto entry points from
+// 16 B to 16 MB, on one thread and on every core
+int runSuite(QTextStream &out, int iterations, int threadCount, bool json)
+{
+    const QList<qint64> sizes = {16, 256, 4096, 65536, 1024 * 1024, 16 * 1024 * 1024};
+    QList<int> threadCounts = {1};
+    if (threadCount > 1) {
+        threadCounts.append(threadCount);
+    }
+
+    if (!json) {
+        out << "AES instructions: " << (AeadContext::hasAesAcceleration() ? "yes" : "no")
+            << ", cipher: " << CryptoManager::cipherName(CryptoManager::preferredCipher())
+            << ", allocation counting: " << (AllocationCounter::isSupported() ? "yes" : "no") << Qt::endl;
+        out << qSetFieldWidth(18) << Qt::left << "op" << qSetFieldWidth(10) << Qt::right
+            << "bytes" << "threads" << qSetFieldWidth(14) << "ns/op" << "MB/s"
+            << qSetFieldWidth(10) << "allocs/op" << qSetFieldWidth(0) << Qt::endl;
+    }
+
+    QJsonArray results;
+    for (const auto &entry : suiteOps()) {
+        for (qint64 size : sizes) {
+            // Roughly the same bytes per measurement, whatever the size
+            const qint64 reps = qMax<qint64>(3, qMin<qint64>(iterations, (256LL << 20) / size));
+            for (int threads : std::as_const(threadCounts)) {
+                Measurement m;
+                if (!measure(entry.first, entry.second, size, threads, reps, m)) {
+                    out << entry.first << " failed at " << size << " bytes" << Qt::endl;
+                    return 1;
+                }
+
+                if (json) {
+                    QJsonObject row;
+                    row["op"] = m.op;
+                    row["bytes"] = m.bytes;
+                    row["threads"] = m.threads;
+                    row["ops"] = m.ops;
+                    row["ns_per_op"] = m.nsPerOp;
+                    row["mb_per_s"] = m.mbPerSecond;
+                    row["allocs_per_op"] = AllocationCounter::isSupported() ? QJsonValue(m.allocsPerOp)
+                                                                            : QJsonValue();
+                    results.append(row);
+                    continue;
+                }
+
+                out << qSetFieldWidth(18) << Qt::left << m.op << qSetFieldWidth(10) << Qt::right
+                    << m.bytes << m.threads << qSetFieldWidth(14)
+                    << QString::number(m.nsPerOp, 'f', 0) << QString::number(m.mbPerSecond, 'f', 1)
+                    << qSetFieldWidth(10)
+                    << (AllocationCounter::isSupported() ? QString::number(m.allocsPerOp, 'f', 2) : QString("n/a"))
+                    << qSetFieldWidth(0) << Qt::endl;
+            }
+        }
+    }
+
+    if (json) {
+        QJsonObject report;
+        report["benchmark"] = "suite";
+        report["aes_acceleration"] = AeadContext::hasAesAcceleration();
+        report["cipher"] = CryptoManager::cipherName(CryptoManager::preferredCipher());
+        report["iterations"] = iterations;
+        report["results"] = results;
+        out << QJsonDocument(report).toJson(QJsonDocument::Indented);
+    }
+    return 0;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("CryptoManager benchmarks");
+    parser.addHelpOption();
+    parser.addPositionalArgument("benchmark", "Benchmark to run: envelope, context, cipher, session, file, download, suite");
+    QCommandLineOption iterationsOption("iterations", "Repetitions per measurement.", "count", "2000");
+    QCommandLineOption fileSizeOption("file-size", "Size of the file benchmark's input.", "MiB", "256");
+    QCommandLineOption segmentOption("segment", "Segment size for the file benchmark.", "KiB", "1024");
+    QCommandLineOption threadsOption("threads", "Threads for the suite's parallel runs (default: one per core).", "count", "0");
+    QCommandLineOption jsonOption("json", "Print the suite's results as JSON.");
+    parser.addOptions({iterationsOption, fileSizeOption, segmentOption, threadsOption, jsonOption});
+    parser.process(app);
+
+    const QStringList args = parser.positionalArguments();
+    const QString benchmark = args.isEmpty() ? QString("envelope") : args.first();
+    const int iterations = qMax(1, parser.value(iterationsOption).toInt());
+
+    QTextStream out(stdout);
+    if (benchmark == "envelope") {
+        return runEnvelope(out, iterations);
+    }
+    if (benchmark == "context") {
+        return runContext(out, iterations);
+    }
+    if (benchmark == "cipher") {
+        return runCipher(out, iterations);
+    }
+    if (benchmark == "session") {
+        return runSession(out, iterations);
+    }
+    if (benchmark == "suite") {
+        int threads = parser.value(threadsOption).toInt();
+        if (threads <= 0) {
+            threads = QThread::idealThreadCount();
+        }
+        return runSuite(out, iterations, threads, parser.isSet(jsonOption));
+    }
+    if (benchmark == "download") {
+        return runDownload(out, qMax(1, parser.value(fileSizeOption).toInt()));
+    }
+    if (benchmark == "file") {
+        return runFile(out, qMax(1, parser.value(fileSizeOption).toInt()),
+                       qMax(4, parser.value(segmentOption).toInt()));
+    }
+
+    out << "Unknown benchmark: " << benchmark << Qt::endl;
+    return 2;
+}
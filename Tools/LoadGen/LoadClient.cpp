@@ -0,0 +1,289 @@
+#include "LoadClient.h"
+#include "CryptoManager.h"
+#include "WireProtocol.h"
+#include <QDateTime>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QTimer>
+
+namespace {
+// Servers from before negotiation never send a welcome
+constexpr int kHandshakeTimeoutMs = 5000;
+}
+
+LoadClient::LoadClient(int index, const LoadConfig &config)
+    : QObject(nullptr)
+    , m_index(index)
+    , m_config(config)
+    , m_socket(new QWebSocket(QString(), QWebSocketProtocol::VersionLatest, this))
+    , m_sendTimer(new QTimer(this))
+    , m_pingTimer(new QTimer(this))
+    , m_connectStartUs(0)
+    , m_binaryWire(false)
+    , m_versionedEnvelope(false)
+    , m_cipher(AeadCipher::Aes256Gcm)
+    , m_codec(PayloadCodec::None)
+    , m_closing(false)
+    , m_started(false)
+    , m_nextSeq(1)
+    , m_rng(quint32(index) * 2654435761u + 1)
+{
+    connect(m_socket, &QWebSocket::connected, this, &LoadClient::onConnected);
+    connect(m_socket, &QWebSocket::disconnected, this, &LoadClient::onDisconnected);
+    connect(m_socket, &QWebSocket::binaryMessageReceived, this, &LoadClient::onBinaryMessageReceived);
+    connect(m_socket, &QWebSocket::textMessageReceived, this, &LoadClient::onTextMessageReceived);
+
+    if (m_config.messagesPerSecond > 0) {
+        m_sendTimer->setInterval(qMax(1, int(1000.0 / m_config.messagesPerSecond)));
+    }
+    connect(m_sendTimer, &QTimer::timeout, this, &LoadClient::sendNextMessage);
+
+    m_pingTimer->setInterval(qMax(1, m_config.pingIntervalMs));
+    connect(m_pingTimer, &QTimer::timeout, this, &LoadClient::sendPing);
+
+    m_clock.start();
+}
+
+void LoadClient::start(int delayMs)
+{
+    QTimer::singleShot(delayMs, this, [this]() {
+        m_connectStartUs = m_clock.nsecsElapsed() / 1000;
+        m_socket->open(m_config.url);
+    });
+}
+
+void LoadClient::markMeasurement()
+{
+    m_stats.messagesAtMark = m_stats.messagesSent;
+    m_stats.bytesAtMark = m_stats.bytesSent;
+}
+
+void LoadClient::stopSending()
+{
+    // Also keeps a late welcome from starting the timers
+    m_started = true;
+    m_sendTimer->stop();
+    m_pingTimer->stop();
+}
+
+void LoadClient::close()
+{
+    m_closing = true;
+    stopSending();
+    m_socket->close();
+}
+
+void LoadClient::onConnected()
+{
+    m_stats.connected = true;
+    m_stats.connectUs = m_clock.nsecsElapsed() / 1000 - m_connectStartUs;
+
+    QStringList capabilities;
+    if (m_config.binary) {
+        capabilities << WireProtocol::CapBinary;
+    }
+    if (m_config.batch) {
+        capabilities << WireProtocol::CapBatch;
+    }
+    capabilities << WireProtocol::CapEnvelope;
+    QJsonObject hello = WireProtocol::makeControlMessage(WireProtocol::TypeHello, capabilities);
+    hello["ciphers"] = QJsonArray::fromStringList(CryptoManager::supportedCiphers());
+    hello["codecs"] = QJsonArray::fromStringList(CryptoManager::supportedCodecs());
+    m_sessionSalt = MessageSession::generateSalt();
+    hello["salt"] = QString::fromLatin1(m_sessionSalt.toBase64());
+    send(QJsonDocument(hello).toJson(QJsonDocument::Compact));
+    QTimer::singleShot(kHandshakeTimeoutMs, this, &LoadClient::startSending);
+}
+
+void LoadClient::startSending()
+{
+    if (m_started || m_closing) {
+        return;
+    }
+    m_started = true;
+
+    // Spread clients across the interval so they do not all fire together
+    const int sendInterval = m_sendTimer->interval();
+    if (m_config.messagesPerSecond > 0) {
+        QTimer::singleShot(int(m_rng.bounded(quint32(sendInterval))), this, [this]() {
+            if (!m_closing) {
+                m_sendTimer->start();
+            }
+        });
+    }
+    QTimer::singleShot(int(m_rng.bounded(quint32(m_pingTimer->interval()))), this, [this]() {
+        if (!m_closing) {
+            m_pingTimer->start();
+        }
+    });
+}
+
+void LoadClient::onDisconnected()
+{
+    stopSending();
+    if (m_stats.connected && !m_closing) {
+        m_stats.droppedByServer = true;
+    }
+}
+
+void LoadClient::onBinaryMessageReceived(const QByteArray &message)
+{
+    processPlaintext(CryptoManager::decryptPayload(message, &m_inbound));
+}
+
+void LoadClient::onTextMessageReceived(const QString &message)
+{
+    processPlaintext(CryptoManager::decryptPayload(QByteArray::fromBase64(message.toLatin1()), &m_inbound));
+}
+
+void LoadClient::processPlaintext(const QByteArray &plaintext)
+{
+    QJsonDocument doc = QJsonDocument::fromJson(plaintext);
+    if (doc.isObject()) {
+        handleMessage(doc.object());
+    } else if (doc.isArray()) {
+        const QJsonArray batch = doc.array();
+        for (const QJsonValue &value : batch) {
+            handleMessage(value.toObject());
+        }
+    }
+}
+
+void LoadClient::handleMessage(const QJsonObject &obj)
+{
+    const QString type = obj["type"].toString();
+    if (type == WireProtocol::TypeWelcome) {
+        const QStringList accepted = WireProtocol::capabilitiesOf(obj);
+        m_binaryWire = accepted.contains(WireProtocol::CapBinary);
+        m_versionedEnvelope = accepted.contains(WireProtocol::CapEnvelope);
+        if (!m_versionedEnvelope) {
+            startSending();
+            return;
+        }
+        if (!CryptoManager::cipherFromName(obj["cipher"].toString(), m_cipher)) {
+            m_cipher = AeadCipher::Aes256Gcm;
+        }
+        m_codec = CryptoManager::negotiateCodec(WireProtocol::codecsOf(obj));
+        const QByteArray serverSalt = QByteArray::fromBase64(obj["salt"].toString().toLatin1());
+        if (!serverSalt.isEmpty()) {
+            m_inbound.start(serverSalt, quint32(obj["stream"].toInt()), m_cipher, AeadContext::Direction::Decrypt);
+            m_outbound.start(m_sessionSalt, 0, m_cipher, AeadContext::Direction::Encrypt);
+        }
+        startSending();
+        return;
+    }
+
+    if (type == WireProtocol::TypePong) {
+        const quint64 seq = quint64(obj["seq"].toInteger());
+        auto it = m_pingsInFlight.find(seq);
+        if (it == m_pingsInFlight.end()) {
+            return;
+        }
+        m_stats.rttUs.append(m_clock.nsecsElapsed() / 1000 - it.value());
+        m_pingsInFlight.erase(it);
+        m_stats.pongsReceived++;
+        m_stats.serverDropped = quint64(obj["dropped"].toInteger());
+    }
+}
+
+void LoadClient::sendNextMessage()
+{
+    const int total = m_config.weightText + m_config.weightFile + m_config.weightVoice;
+    if (total <= 0) {
+        return;
+    }
+
+    const int pick = int(m_rng.bounded(quint32(total)));
+    if (pick < m_config.weightText) {
+        send(buildTextMessage());
+    } else if (pick < m_config.weightText + m_config.weightFile) {
+        send(buildFileMessage());
+    } else {
+        send(buildVoiceMessage());
+    }
+    m_stats.messagesSent++;
+}
+
+void LoadClient::sendPing()
+{
+    const quint64 seq = m_nextSeq++;
+    const qint64 sentUs = m_clock.nsecsElapsed() / 1000;
+    m_pingsInFlight.insert(seq, sentUs);
+
+    QJsonObject ping;
+    ping["type"] = QString(WireProtocol::TypePing);
+    ping["seq"] = qint64(seq);
+    ping["sent"] = sentUs;
+    send(QJsonDocument(ping).toJson(QJsonDocument::Compact));
+    m_stats.pingsSent++;
+}
+
+void LoadClient::send(const QByteArray &plaintext)
+{
+    if (m_socket->state() != QAbstractSocket::ConnectedState) {
+        return;
+    }
+
+    QByteArray envelope;
+    if (!m_versionedEnvelope) {
+        envelope = CryptoManager::encryptLegacyPayload(plaintext);
+    } else if (m_outbound.isActive()) {
+        envelope = CryptoManager::encryptPayload(plaintext, m_outbound, m_codec);
+    } else {
+        envelope = CryptoManager::encryptPayload(plaintext, m_cipher, m_codec);
+    }
+    if (envelope.isEmpty()) {
+        return;
+    }
+
+    if (m_binaryWire) {
+        m_stats.bytesSent += quint64(m_socket->sendBinaryMessage(envelope));
+    } else {
+        m_stats.bytesSent += quint64(m_socket->sendTextMessage(QString::fromLatin1(envelope.toBase64())));
+    }
+}
+
+QByteArray LoadClient::buildTextMessage()
+{
+    static const char alphabet[] = "abcdefghijklmnopqrstuvwxyz     ";
+    QString content;
+    content.reserve(m_config.textLength);
+    for (int i = 0; i < m_config.textLength; ++i) {
+        content += QChar(alphabet[m_rng.bounded(int(sizeof(alphabet) - 1))]);
+    }
+
+    return QString(R"({"type":"text","content":"%1","sender":"Client","timestamp":"%2"})")
+        .arg(content, QDateTime::currentDateTime().toString(Qt::ISODate))
+        .toUtf8();
+}
+
+QByteArray LoadClient::buildFileMessage()
+{
+    const QString fileName = QString("loadgen_%1_%2.bin").arg(m_index).arg(m_stats.messagesSent);
+    return QString(R"({"type":"file","fileName":"%1","fileSize":%2,"fileUrl":"%3","sender":"Client","timestamp":"%4"})")
+        .arg(fileName)
+        .arg(1024 * (1 + m_rng.bounded(4096)))
+        .arg(QString("http://%1:1080/files/loadgen-%2").arg(m_config.url.host()).arg(m_stats.messagesSent))
+        .arg(QDateTime::currentDateTime().toString(Qt::ISODate))
+        .toUtf8();
+}
+
+QByteArray LoadClient::buildVoiceMessage()
+{
+    // Same shape as ClientController: 50 downsampled RMS values
+    QString waveformJson = "[";
+    for (int i = 0; i < 50; ++i) {
+        if (i > 0) waveformJson += ",";
+        waveformJson += QString::number(m_rng.generateDouble(), 'f', 4);
+    }
+    waveformJson += "]";
+
+    const QString fileName = QString("voice_loadgen_%1_%2.m4a").arg(m_index).arg(m_stats.messagesSent);
+    return QString(R"({"type":"voice","fileName":"%1","fileSize":%2,"fileUrl":"%3","duration":0,"waveform":%4,"sender":"Client","timestamp":"%5"})")
+        .arg(fileName)
+        .arg(20000 + m_rng.bounded(80000))
+        .arg(QString("http://%1:1080/files/voice-%2").arg(m_config.url.host()).arg(m_stats.messagesSent))
+        .arg(waveformJson)
+        .arg(QDateTime::currentDateTime().toString(Qt::ISODate))
+        .toUtf8();
+}
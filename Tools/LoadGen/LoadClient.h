@@ -0,0 +1,103 @@
+#ifndef LOADCLIENT_H
+#define LOADCLIENT_H
+
+#include <QObject>
+#include <QWebSocket>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QRandomGenerator>
+#include <QUrl>
+#include <QVector>
+#include "AeadContext.h"
+#include "CryptoManager.h"
+#include "MessageSession.h"
+
+class QTimer;
+
+struct LoadConfig {
+    QUrl url;
+    double messagesPerSecond = 1.0;  // Per client
+    int pingIntervalMs = 200;
+    int weightText = 80;             // Relative mix of message types
+    int weightFile = 10;
+    int weightVoice = 10;
+    int textLength = 120;
+    bool binary = true;              // Offer binary frames in the hello
+    bool batch = true;               // Offer batch frames in the hello
+};
+
+struct LoadStats {
+    bool connected = false;
+    bool droppedByServer = false;    // Closed before we stopped
+    qint64 connectUs = -1;
+    quint64 messagesSent = 0;
+    quint64 bytesSent = 0;           // On the wire, after encryption/base64
+    quint64 messagesAtMark = 0;      // Both counters when the measured window began
+    quint64 bytesAtMark = 0;
+    quint64 pingsSent = 0;
+    quint64 pongsReceived = 0;
+    quint64 serverDropped = 0;       // Last outbound drop count the server reported
+    QVector<qint64> rttUs;
+};
+
+// One simulated chat client speaking the same encrypted JSON protocol as
+// WebSocketClient. Lives on a worker thread; every slot is invoked queued.
+class LoadClient : public QObject
+{
+    Q_OBJECT
+public:
+    LoadClient(int index, const LoadConfig &config);
+
+public slots:
+    void start(int delayMs);
+    // Start of the measured window: rates leave out what was sent before
+    void markMeasurement();
+    void stopSending();
+    void close();
+
+public:
+    // Only call once the client's thread has stopped or via a blocking queued call
+    LoadStats stats() const { return m_stats; }
+
+private slots:
+    void onConnected();
+    void onDisconnected();
+    void onBinaryMessageReceived(const QByteArray &message);
+    void onTextMessageReceived(const QString &message);
+    void sendNextMessage();
+    void sendPing();
+
+private:
+    // After the welcome, or a timeout for servers that never answer: once
+    // the server has our salt it only takes session envelopes
+    void startSending();
+    void processPlaintext(const QByteArray &plaintext);
+    void handleMessage(const QJsonObject &obj);
+    void send(const QByteArray &plaintext);
+    QByteArray buildTextMessage();
+    QByteArray buildFileMessage();
+    QByteArray buildVoiceMessage();
+
+    int m_index;
+    LoadConfig m_config;
+    QWebSocket *m_socket;
+    QTimer *m_sendTimer;
+    QTimer *m_pingTimer;
+    QElapsedTimer m_clock;
+    qint64 m_connectStartUs;
+    bool m_binaryWire;
+    bool m_versionedEnvelope;
+    AeadCipher m_cipher;
+    PayloadCodec m_codec;
+    QByteArray m_sessionSalt;
+    MessageSession m_outbound;
+    MessageSession m_inbound;
+    bool m_closing;
+    bool m_started;
+    quint64 m_nextSeq;
+    QHash<quint64, qint64> m_pingsInFlight;
+    QRandomGenerator m_rng;
+    LoadStats m_stats;
+};
+
+#endif // LOADCLIENT_H
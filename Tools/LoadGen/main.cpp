@@ -0,0 +1,217 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDebug>
+#include <QTextStream>
+#include <QThread>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <algorithm>
+#include "LoadClient.h"
+#include "CryptoManager.h"
+
+// Opens N simulated clients against a running server, drives them at a fixed
+// per-client message rate and reports connect time, ping round-trip
+// percentiles, throughput and what the server dropped.
+
+namespace {
+
+qint64 percentile(QVector<qint64> &sorted, double p)
+{
+    if (sorted.isEmpty()) {
+        return -1;
+    }
+    const qsizetype index = qMin(sorted.size() - 1, qsizetype(p * double(sorted.size())));
+    return sorted.at(index);
+}
+
+QString formatUs(qint64 us)
+{
+    if (us < 0) {
+        return "n/a";
+    }
+    if (us < 10000) {
+        return QString("%1 us").arg(us);
+    }
+    return QString("%1 ms").arg(double(us) / 1000.0, 0, 'f', 2);
+}
+
+bool parseMix(const QString &mix, LoadConfig &config)
+{
+    const QStringList parts = mix.split(':');
+    if (parts.size() != 3) {
+        return false;
+    }
+    bool ok1 = false, ok2 = false, ok3 = false;
+    config.weightText = parts[0].toInt(&ok1);
+    config.weightFile = parts[1].toInt(&ok2);
+    config.weightVoice = parts[2].toInt(&ok3);
+    return ok1 && ok2 && ok3;
+}
+
+void report(QTextStream &out, const QList<LoadStats> &results, double seconds)
+{
+    int connected = 0;
+    int droppedByServer = 0;
+    quint64 messages = 0, measuredMessages = 0, measuredBytes = 0;
+    quint64 pings = 0, pongs = 0, serverDropped = 0;
+    QVector<qint64> connectTimes, rtts;
+
+    for (const LoadStats &stats : results) {
+        if (stats.connected) {
+            connected++;
+            connectTimes.append(stats.connectUs);
+        }
+        if (stats.droppedByServer) {
+            droppedByServer++;
+        }
+        messages += stats.messagesSent;
+        measuredMessages += stats.messagesSent - stats.messagesAtMark;
+        measuredBytes += stats.bytesSent - stats.bytesAtMark;
+        pings += stats.pingsSent;
+        pongs += stats.pongsReceived;
+        serverDropped += stats.serverDropped;
+        rtts += stats.rttUs;
+    }
+
+    std::sort(connectTimes.begin(), connectTimes.end());
+    std::sort(rtts.begin(), rtts.end());
+
+    out << "clients          " << connected << "/" << results.size() << " connected, "
+        << droppedByServer << " closed by server" << Qt::endl;
+    out << "connect time     p50 " << formatUs(percentile(connectTimes, 0.50))
+        << "  p99 " << formatUs(percentile(connectTimes, 0.99))
+        << "  max " << formatUs(connectTimes.isEmpty() ? -1 : connectTimes.last()) << Qt::endl;
+    out << "messages sent    " << messages << " (" << QString::number(double(measuredMessages) / seconds, 'f', 1)
+        << " msg/s, " << QString::number(double(measuredBytes) / seconds / 1e6, 'f', 2)
+        << " MB/s on the wire after the ramp)" << Qt::endl;
+    out << "round trip       p50 " << formatUs(percentile(rtts, 0.50))
+        << "  p99 " << formatUs(percentile(rtts, 0.99))
+        << "  p999 " << formatUs(percentile(rtts, 0.999))
+        << "  max " << formatUs(rtts.isEmpty() ? -1 : rtts.last()) << Qt::endl;
+    out << "pings            " << pongs << "/" << pings << " answered" << Qt::endl;
+    out << "server drops     " << serverDropped << " frames shed from outbound queues" << Qt::endl;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("chat_loadgen");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Load generator for the chat server");
+    parser.addHelpOption();
+    QCommandLineOption urlOption("url", "Server URL.", "url", "ws://127.0.0.1:8080");
+    QCommandLineOption clientsOption({"c", "clients"}, "Number of simulated clients.", "count", "100");
+    QCommandLineOption rateOption({"r", "rate"}, "Messages per second per client.", "rate", "1");
+    QCommandLineOption durationOption({"d", "duration"}, "Seconds to send after the last client started.", "seconds", "30");
+    QCommandLineOption rampOption("ramp", "Milliseconds between client connects.", "ms", "5");
+    QCommandLineOption mixOption("mix", "Relative weights of text:file:voice messages.", "weights", "80:10:10");
+    QCommandLineOption pingOption("ping-interval", "Milliseconds between latency probes per client.", "ms", "200");
+    QCommandLineOption textLengthOption("text-length", "Characters per text message.", "chars", "120");
+    QCommandLineOption threadsOption("threads", "Worker threads hosting the clients (default: one per core).", "count", "0");
+    QCommandLineOption textFramesOption("text-frames", "Do not offer binary frames (base64 text like old clients).");
+    QCommandLineOption noBatchOption("no-batch", "Do not offer batch frames.");
+    QCommandLineOption cipherOption("cipher", "Preferred cipher: auto, aes-256-gcm or chacha20-poly1305.", "name", "auto");
+    parser.addOptions({urlOption, clientsOption, rateOption, durationOption, rampOption, mixOption,
+                       pingOption, textLengthOption, threadsOption, textFramesOption, noBatchOption,
+                       cipherOption});
+    parser.process(app);
+
+    LoadConfig config;
+    config.url = QUrl(parser.value(urlOption));
+    config.messagesPerSecond = parser.value(rateOption).toDouble();
+    config.pingIntervalMs = parser.value(pingOption).toInt();
+    config.textLength = qMax(1, parser.value(textLengthOption).toInt());
+    config.binary = !parser.isSet(textFramesOption);
+    config.batch = !parser.isSet(noBatchOption);
+    if (!parseMix(parser.value(mixOption), config)) {
+        qCritical() << "Invalid --mix, expected text:file:voice weights";
+        return 2;
+    }
+
+    const QString cipherName = parser.value(cipherOption);
+    if (cipherName != "auto") {
+        AeadCipher cipher;
+        if (!CryptoManager::cipherFromName(cipherName, cipher)) {
+            qCritical() << "Unknown --cipher" << cipherName;
+            return 2;
+        }
+        CryptoManager::setPreferredCipher(cipher);
+    }
+
+    const int clientCount = qMax(1, parser.value(clientsOption).toInt());
+    const int rampMs = qMax(0, parser.value(rampOption).toInt());
+    const int durationMs = qMax(1, parser.value(durationOption).toInt()) * 1000;
+    int threadCount = parser.value(threadsOption).toInt();
+    if (threadCount <= 0) {
+        threadCount = qMax(1, QThread::idealThreadCount());
+    }
+
+    QList<QThread *> threads;
+    for (int i = 0; i < threadCount; ++i) {
+        QThread *thread = new QThread(&app);
+        thread->setObjectName(QStringLiteral("loadgen-%1").arg(i));
+        thread->start();
+        threads.append(thread);
+    }
+
+    QList<LoadClient *> clients;
+    clients.reserve(clientCount);
+    for (int i = 0; i < clientCount; ++i) {
+        LoadClient *client = new LoadClient(i, config);
+        QThread *thread = threads.at(i % threadCount);
+        client->moveToThread(thread);
+        QObject::connect(thread, &QThread::finished, client, &QObject::deleteLater);
+        clients.append(client);
+
+        const int delay = i * rampMs;
+        QMetaObject::invokeMethod(client, [client, delay]() { client->start(delay); }, Qt::QueuedConnection);
+    }
+
+    QTextStream out(stdout);
+    out << "Starting " << clientCount << " clients against " << config.url.toString()
+        << " on " << threadCount << " thread(s)" << Qt::endl;
+
+    QElapsedTimer sendClock;
+    const int rampTotalMs = (clientCount - 1) * rampMs;
+    // Rates cover only this window, so messages sent during the ramp are
+    // counted out on every client when it opens
+    QTimer::singleShot(rampTotalMs, [&]() {
+        sendClock.start();
+        for (LoadClient *client : std::as_const(clients)) {
+            QMetaObject::invokeMethod(client, &LoadClient::markMeasurement, Qt::QueuedConnection);
+        }
+    });
+
+    // Stop sending, then give outstanding pongs a moment before collecting
+    const int graceMs = 1000;
+    double measuredSeconds = double(durationMs) / 1000.0;
+    QTimer::singleShot(rampTotalMs + durationMs, [&]() {
+        measuredSeconds = sendClock.isValid() ? double(sendClock.elapsed()) / 1000.0 : measuredSeconds;
+        for (LoadClient *client : std::as_const(clients)) {
+            QMetaObject::invokeMethod(client, &LoadClient::stopSending, Qt::QueuedConnection);
+        }
+        QTimer::singleShot(graceMs, &app, &QCoreApplication::quit);
+    });
+
+    app.exec();
+
+    QList<LoadStats> results;
+    results.reserve(clients.size());
+    for (LoadClient *client : std::as_const(clients)) {
+        QMetaObject::invokeMethod(client, &LoadClient::close, Qt::BlockingQueuedConnection);
+        LoadStats stats;
+        QMetaObject::invokeMethod(client, [client, &stats]() { stats = client->stats(); }, Qt::BlockingQueuedConnection);
+        results.append(stats);
+    }
+
+    for (QThread *thread : std::as_const(threads)) {
+        thread->quit();
+        thread->wait();
+    }
+
+    report(out, results, qMax(0.001, measuredSeconds));
+    return 0;
+}